@@ -0,0 +1,152 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Minimal stand-in for the Arduino core so the sketch's emulator and library
+// sources can be compiled natively for the host tools.
+
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+#define PROGMEM
+#define strncpy_P strncpy
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+
+#define DEC 10
+
+// Time does not pass on its own in a host build. Delays advance a virtual
+// microsecond clock, which simulated devices can use to check bus timing.
+// host_on_delay, if set, is called after every delay, so a device can change
+// its pins once enough time has passed.
+extern unsigned long host_micros;
+extern void (*host_on_delay)();
+
+inline void delayMicroseconds(unsigned int us) {
+  host_micros += us;
+  if(host_on_delay) {
+    host_on_delay();
+  }
+}
+
+inline void delay(unsigned long ms) {
+  host_micros += ms * 1000;
+  if(host_on_delay) {
+    host_on_delay();
+  }
+}
+
+inline unsigned long micros() {
+  return host_micros;
+}
+
+inline unsigned long millis() {
+  return host_micros / 1000;
+}
+
+inline void randomSeed(unsigned long seed) {
+  srand((unsigned)seed);
+}
+
+inline long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+// Serial text goes to stdout. Binary writes go to 'sink' if one is set, so
+// tools can capture transfers the sketch makes to the host. If 'fd' is set, the
+// serial port is that file descriptor instead, e.g. a pseudo-terminal that a
+// stand-in device serves, and both directions go through it.
+class HostSerial {
+  private:
+    void text(const char *str, size_t len) {
+      if(quiet) {
+        return;
+      }
+      if(fd >= 0) {
+        fdWrite(str, len);
+      }
+      else {
+        fwrite(str, 1, len, stdout);
+      }
+    }
+
+    void fdWrite(const void *data, size_t len);
+
+  public:
+    bool quiet = false;
+    void (*sink)(const uint8_t *data, size_t len) = nullptr;
+    int fd = -1;
+
+    void begin(unsigned long) {}
+
+    // Without 'fd', nothing is ever received. With it, available() waits up to a
+    // millisecond for input and advances the clock by the time waited, so polling
+    // loops neither spin nor stall their timeouts.
+    int available();
+    int read();
+
+    size_t write(uint8_t byte) {
+      return write(&byte, 1);
+    }
+
+    size_t write(const uint8_t *data, size_t len) {
+      if(sink) {
+        sink(data, len);
+      }
+      else if(fd >= 0) {
+        fdWrite(data, len);
+      }
+      else if(!quiet) {
+        fwrite(data, 1, len, stdout);
+      }
+      return len;
+    }
+
+    void print(const char *str) {
+      text(str, strlen(str));
+    }
+
+    void println(const char *str) {
+      text(str, strlen(str));
+      text("\n", 1);
+    }
+
+    void println(int value, int) {
+      char buf[16];
+      snprintf(buf, sizeof buf, "%d\n", value);
+      text(buf, strlen(buf));
+    }
+
+    void flush() {
+      if(fd < 0) {
+        fflush(stdout);
+      }
+    }
+};
+
+extern HostSerial Serial;
+
+#endif // _HOST_ARDUINO_H
@@ -0,0 +1,76 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Stand-in for the Arduino EEPROM library. The EEPROM is an array in memory,
+// erased to 0xFF like a new part, which tools can inspect or preload.
+
+#ifndef _HOST_EEPROM_H
+#define _HOST_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// The ATmega328P's EEPROM size.
+#define HOST_EEPROM_SIZE 1024
+
+class EEPROMClass {
+  public:
+    uint8_t data[HOST_EEPROM_SIZE];
+
+    EEPROMClass() {
+      clear();
+    }
+
+    void clear() {
+      memset(data, 0xFF, sizeof data);
+    }
+
+    uint8_t read(int idx) {
+      return data[idx];
+    }
+
+    void write(int idx, uint8_t val) {
+      data[idx] = val;
+    }
+
+    void update(int idx, uint8_t val) {
+      data[idx] = val;
+    }
+
+    uint16_t length() {
+      return HOST_EEPROM_SIZE;
+    }
+
+    template <typename T>
+    T &get(int idx, T &t) {
+      memcpy(&t, &data[idx], sizeof(T));
+      return t;
+    }
+
+    template <typename T>
+    const T &put(int idx, const T &t) {
+      memcpy(&data[idx], &t, sizeof(T));
+      return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // _HOST_EEPROM_H
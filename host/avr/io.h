@@ -0,0 +1,61 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Mock AVR port registers for host builds. Each register is a byte with an
+// optional write hook, so a host tool can attach a simulated chip that reacts
+// to the pin changes made by the sketch's bus code (see mock_8253.h).
+
+#ifndef _HOST_AVR_IO_H
+#define _HOST_AVR_IO_H
+
+#include <stdint.h>
+
+class MockRegister {
+  public:
+    uint8_t value = 0;
+
+    operator uint8_t() const {
+      return value;
+    }
+
+    MockRegister &operator=(uint8_t new_value) {
+      value = new_value;
+      if(on_write) {
+        on_write(*this);
+      }
+      return *this;
+    }
+
+    MockRegister &operator|=(uint8_t bits) {
+      return *this = (uint8_t)(value | bits);
+    }
+
+    MockRegister &operator&=(uint8_t bits) {
+      return *this = (uint8_t)(value & bits);
+    }
+
+    // Called after any write to any register.
+    static void (*on_write)(MockRegister &reg);
+};
+
+extern MockRegister PORTB, PORTC, PORTD;
+extern MockRegister PINB, PINC, PIND;
+extern MockRegister DDRB, DDRC, DDRD;
+
+#endif // _HOST_AVR_IO_H
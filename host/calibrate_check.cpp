@@ -0,0 +1,180 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Check the sketch's bus timing calibration against the mock chip.
+//
+//   calibrate_check [--8254] [--margin <us>] [--quiet] [<setup> <access> <pulse>]
+//
+// The mock chip is given minimum bus times, in microseconds: address setup before
+// RD or WR falls, read access time and WR pulse width. Accesses that break them
+// fail as they would on a marginal board (see mock_8253.h). The sketch's own
+// calibrate_bus_timing() is then run, and the tool checks that it found exactly
+// those minima plus the margin, capped at the defaults; that the result was stored
+// in EEPROM and bus_timing_load() reads it back; and that the known-answer
+// sequence runs at the stored timing without a violation. Where a minimum is above
+// the default delay, calibration must fail and leave the EEPROM empty.
+//
+// With no times given, a built-in set of cases is run.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -fpermissive -DDEBUG_EMU=0 -Ihost -Isketches/validate host/calibrate_check.cpp
+//     host/mock_8253.cpp host/host_arduino.cpp sketches/validate/arduino_8253.cpp
+//     sketches/validate/calibrate.cpp sketches/validate/lib.cpp -o calibrate_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <EEPROM.h>
+#include "mock_8253.h"
+#include "calibrate.h"
+
+// Globals the sketch file defines on the board.
+PitType pit_type = kModel8253;
+Pit emu = Pit(pit_type);
+unsigned long pit_cps = 0;
+
+static const MockBusTiming default_cases[] = {
+  { 0, 0, 0 },
+  { 1, 2, 3 },
+  { 3, 1, 2 },
+  { 2, 3, 1 },
+  { 4, 4, 4 },
+  { 5, 0, 0 },
+  { 0, 6, 0 },
+  { 0, 0, 5 },
+};
+
+#define NUM_DEFAULT_CASES (sizeof default_cases / sizeof default_cases[0])
+
+static bool timing_equal(const bus_timing_t &a, const bus_timing_t &b) {
+  return a.pin_change == b.pin_change && a.bus_read == b.bus_read && a.bus_write == b.bus_write;
+}
+
+static u8 expect_field(unsigned long required, u8 margin, u8 default_us, bool &possible) {
+  if(required > default_us) {
+    possible = false;
+  }
+  return (u8)(required + margin < default_us ? required + margin : default_us);
+}
+
+static bool run_case(const MockBusTiming &t, u8 margin) {
+  const bus_timing_t defaults = { PIN_CHANGE_DELAY, BUS_READ_DELAY, BUS_WRITE_DELAY };
+  bool possible = true;
+  bus_timing_t expected;
+  expected.pin_change = expect_field(t.address_setup_us, margin, PIN_CHANGE_DELAY, possible);
+  expected.bus_read = expect_field(t.read_access_us, margin, BUS_READ_DELAY, possible);
+  expected.bus_write = expect_field(t.write_pulse_us, margin, BUS_WRITE_DELAY, possible);
+  if(!possible) {
+    expected = defaults;
+  }
+
+  Mock8253 board(pit_type);
+  board.setTiming(t);
+  board.attach();
+  EEPROM.clear();
+  bus_timing = defaults;
+
+  bool calibrated = calibrate_bus_timing(margin);
+  bus_timing_t found = bus_timing;
+  bool ok = true;
+
+  fprintf(stderr, "setup %lu access %lu pulse %lu: ", t.address_setup_us, t.read_access_us, t.write_pulse_us);
+
+  if(calibrated != possible) {
+    fprintf(stderr, "calibration %s, expected it to %s. ", calibrated ? "passed" : "failed", possible ? "pass" : "fail");
+    ok = false;
+  }
+  if(!timing_equal(found, expected)) {
+    fprintf(stderr, "found %u/%u/%u, expected %u/%u/%u. ", found.pin_change, found.bus_read, found.bus_write,
+            expected.pin_change, expected.bus_read, expected.bus_write);
+    ok = false;
+  }
+
+  // The stored record, as the next start would see it.
+  bus_timing = defaults;
+  bool loaded = bus_timing_load();
+  if(loaded != possible || (loaded && !timing_equal(bus_timing, expected))) {
+    fprintf(stderr, "EEPROM record %s. ", loaded ? "wrong" : "missing");
+    ok = false;
+  }
+
+  if(possible) {
+    board.takeViolations();
+    if(!calibrate_check(CALIBRATE_TRIALS) || board.takeViolations() != 0) {
+      fprintf(stderr, "stored timing is not clean. ");
+      ok = false;
+    }
+  }
+
+  board.detach();
+  fprintf(stderr, "%u/%u/%u %s\n", found.pin_change, found.bus_read, found.bus_write, ok ? "pass" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  u8 margin = CALIBRATE_MARGIN;
+  bool quiet = false;
+  std::vector<unsigned long> times;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--8254") == 0) {
+      pit_type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--margin") == 0 && i + 1 < argc) {
+      margin = (u8)atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--quiet") == 0) {
+      quiet = true;
+    }
+    else if(argv[i][0] >= '0' && argv[i][0] <= '9') {
+      times.push_back(strtoul(argv[i], NULL, 10));
+    }
+    else {
+      times.clear();
+      break;
+    }
+  }
+  if(times.size() != 0 && times.size() != 3) {
+    fprintf(stderr, "usage: %s [--8254] [--margin us] [--quiet] [<setup> <access> <pulse>]\n", argv[0]);
+    return 2;
+  }
+
+  Serial.quiet = quiet;
+  emu = Pit(pit_type);
+
+  std::vector<MockBusTiming> cases;
+  if(times.size() == 3) {
+    cases.push_back({ times[0], times[1], times[2] });
+  }
+  else {
+    cases.assign(default_cases, default_cases + NUM_DEFAULT_CASES);
+  }
+
+  int failed = 0;
+  for(const MockBusTiming &t : cases) {
+    failed += !run_case(t, margin);
+  }
+
+  fprintf(stderr, "%d of %d failed\n", failed, (int)cases.size());
+  return failed ? 1 : 0;
+}
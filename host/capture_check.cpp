@@ -0,0 +1,183 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Compare an output capture from the sketch's logic analyzer mode against the
+// emulator.
+//
+//   capture_check [--8254] [--mask <hex>] <script> <capture-file>
+//       Decode a capture received from the board (a raw serial log is fine)
+//       and compare it to the emulator after running the setup in <script>.
+//       --8254 if the board carries an 8254.
+//   capture_check --mock [8253|8254] [--mask <hex>] <script> <cycles>
+//       Mock-register build: run the setup and the sketch's own capture code
+//       against a simulated chip attached to the mock AVR registers, then
+//       decode and compare the transfer exactly as for a real board.
+//
+// The emulator is the same model as the chip that made the capture.
+//
+// The setup script must match what the sketch did before capturing, e.g.
+// capture_test.ops for test_capture().
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -fpermissive -DDEBUG_EMU=0 -Ihost -Isketches/validate host/capture_check.cpp
+//     host/mock_8253.cpp host/host_arduino.cpp sketches/validate/capture.cpp
+//     sketches/validate/arduino_8253.cpp sketches/validate/lib.cpp -o capture_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "mock_8253.h"
+#include "pit_capture.h"
+#include "pit_oracle.h"
+
+static std::vector<u8> transfer;
+
+static void collect_transfer(const uint8_t *data, size_t len) {
+  transfer.insert(transfer.end(), data, data + len);
+}
+
+// Drive the setup through the sketch's hardware functions.
+static void run_on_board(const OpSequence &ops) {
+  for(const PitOp &op : ops) {
+    switch(op.op) {
+      case WriteCommand:
+        pit_write_port(COMMAND, (u8)op.arg);
+        break;
+      case ReadChannel:
+        pit_read_port((pit_port)op.chan);
+        break;
+      case WriteChannel:
+        pit_write_port((pit_port)op.chan, (u8)op.arg);
+        break;
+      case Tick:
+        for(uint32_t i = 0; i < op.arg; i++) {
+          pit_clock_tick();
+        }
+        break;
+      case FlipGate:
+        pit_set_gate(op.chan, op.arg != 0);
+        break;
+    }
+  }
+}
+
+static bool read_file(const char *path, std::vector<u8> &data) {
+  FILE *in = fopen(path, "rb");
+  if(!in) {
+    perror(path);
+    return false;
+  }
+  u8 buf[4096];
+  size_t n;
+  while((n = fread(buf, 1, sizeof buf, in)) > 0) {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(in);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  bool mock = false;
+  PitType chip_type = kModel8253;
+  u8 mask = 0x07;
+  const char *args[2] = {NULL, NULL};
+  int n_args = 0;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--mock") == 0) {
+      mock = true;
+      if(i + 1 < argc && (strcmp(argv[i + 1], "8253") == 0 || strcmp(argv[i + 1], "8254") == 0)) {
+        chip_type = strcmp(argv[++i], "8254") == 0 ? kModel8254 : kModel8253;
+      }
+    }
+    else if(strcmp(argv[i], "--8254") == 0) {
+      chip_type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--mask") == 0 && i + 1 < argc) {
+      mask = (u8)strtoul(argv[++i], NULL, 16) & 0x07;
+    }
+    else if(n_args < 2) {
+      args[n_args++] = argv[i];
+    }
+  }
+
+  if(n_args != 2) {
+    fprintf(stderr, "usage: %s [--mock [8253|8254] | --8254] [--mask <hex>] <script> <capture-file|cycles>\n",
+      argv[0]);
+    return 2;
+  }
+
+  FILE *in = fopen(args[0], "r");
+  if(!in) {
+    perror(args[0]);
+    return 1;
+  }
+  OpSequence setup;
+  bool ok = read_ops(in, setup);
+  fclose(in);
+  if(!ok) {
+    return 1;
+  }
+
+  if(mock) {
+    Mock8253 board(chip_type);
+    board.attach();
+    Serial.quiet = true;
+    Serial.sink = collect_transfer;
+
+    run_on_board(setup);
+    unsigned long cycles = capture_outputs(strtoul(args[1], NULL, 0));
+    capture_send();
+
+    Serial.sink = nullptr;
+    Serial.quiet = false;
+    board.detach();
+    printf("mock: captured %lu cycles in %u runs, %lu byte transfer\n",
+      cycles, capture_get_run_count(), (unsigned long)transfer.size());
+  }
+  else if(!read_file(args[1], transfer)) {
+    return 1;
+  }
+
+  OutputCapture capture;
+  if(!capture_decode(transfer.data(), transfer.size(), capture)) {
+    fprintf(stderr, "no valid capture found\n");
+    return 1;
+  }
+
+  Pit emu(chip_type);
+  PitOpResult result;
+  for(const PitOp &op : setup) {
+    apply_op(emu, op, result);
+  }
+
+  u8 emu_state = 0;
+  u8 pit_state = 0;
+  long cycle = capture_compare(emu, capture, mask, emu_state, pit_state);
+  if(cycle >= 0) {
+    printf("outputs differ at cycle %ld: emu %X pit %X\n", cycle, emu_state, pit_state);
+    return 1;
+  }
+
+  printf("%lu cycles in %lu runs match\n", capture.cycles, (unsigned long)capture.runs.size());
+  return 0;
+}
@@ -0,0 +1,237 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Threaded check of the output edge queue (pit_edge_queue.h).
+//
+//   edge_queue_check [--8254] [--seed <n>] [--ticks <n>]
+//
+// A producer thread clocks a Pit with all three channels counting, in random 
+// bursts, with the queue attached to every channel. A consumer thread drains it 
+// concurrently, alternating drain() and drainUntil(). Afterwards the same bursts 
+// are run on a second Pit that records its edges directly, and the tool checks
+// that the consumer saw those edges in order with none invented or repeated;
+// that drainUntil() never passed its limit; and that every edge is accounted for
+// as either pushed or dropped.
+//
+// It runs twice: with the producer paced to stay well within a roomy queue, as
+// an emulator running in real time would be, where no edge may be dropped; and
+// unpaced with a tiny queue and a consumer that sleeps between drains, so that
+// the drop path is exercised too.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -DDEBUG_EMU=0 -Ihost -Isketches/validate host/edge_queue_check.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o edge_queue_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "pit_edge_queue.h"
+#include "pit_oracle.h"
+
+// Counts for channels 0-2 and the modes they run in, so that each produces a
+// steady stream of edges at a different rate.
+static const u16 channel_count[3] = { 7, 10, 4 };
+static const TimerMode channel_mode[3] = { kRateGenerator, kSquareWaveGenerator, kSquareWaveGenerator };
+
+// Random burst lengths, shared by the producer and the reference run.
+static std::vector<unsigned long> make_bursts(uint32_t seed, unsigned long long ticks) {
+  std::mt19937 rng(seed);
+  std::vector<unsigned long> bursts;
+  while(ticks) {
+    unsigned long n = 1 + rng() % 2000;
+    if(n > ticks) {
+      n = (unsigned long)ticks;
+    }
+    bursts.push_back(n);
+    ticks -= n;
+  }
+  return bursts;
+}
+
+static bool same_edge(const QueuedEdge &a, const QueuedEdge &b) {
+  return a.ticks == b.ticks && a.channel == b.channel && a.level == b.level;
+}
+
+static void record_edge(void *context, int channel, bool level, unsigned long long ticks) {
+  QueuedEdge edge;
+  edge.ticks = ticks;
+  edge.channel = (uint8_t)channel;
+  edge.level = level;
+  static_cast<std::vector<QueuedEdge> *>(context)->push_back(edge);
+}
+
+template <size_t Capacity>
+static bool run_case(const char *name, PitType type, const std::vector<unsigned long> &bursts, 
+                     bool paced, unsigned consumer_sleep_us) {
+  std::unique_ptr<EdgeQueue<Capacity>> owner(new EdgeQueue<Capacity>());
+  EdgeQueue<Capacity> &queue = *owner;
+
+  std::atomic<bool> done{false};
+  std::vector<QueuedEdge> received;
+  uint64_t past_limit = 0;
+
+  std::thread producer([&]() {
+    Pit pit(type);
+    setup_pit(pit, channel_count, channel_mode);
+    for(int c = 0; c < 3; c++) {
+      queue.attach(pit.channel[c]);
+    }
+    for(unsigned long n : bursts) {
+      // A burst makes at most about one edge per tick, so waiting for the queue to
+      // be three quarters empty leaves room for any burst.
+      while(paced && queue.size() > Capacity / 4) {
+        std::this_thread::yield();
+      }
+      pit.run(n);
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  std::thread consumer([&]() {
+    QueuedEdge buf[64];
+    bool by_limit = false;
+
+    for(;;) {
+      bool finished = done.load(std::memory_order_acquire);
+      if(by_limit && !received.empty()) {
+        // Take edges up to a little past the last one seen, as an audio callback
+        // takes edges up to the end of its buffer.
+        uint64_t limit = received.back().ticks + 50;
+        queue.drainUntil(limit, [&](const QueuedEdge &edge) {
+          past_limit += (edge.ticks > limit);
+          received.push_back(edge);
+        });
+      }
+      else {
+        size_t n = queue.drain(buf, 64);
+        received.insert(received.end(), buf, buf + n);
+      }
+      by_limit = !by_limit;
+
+      if(finished && queue.size() == 0) {
+        break;
+      }
+      if(consumer_sleep_us) {
+        std::this_thread::sleep_for(std::chrono::microseconds(consumer_sleep_us));
+      }
+    }
+  });
+
+  producer.join();
+  consumer.join();
+
+  std::vector<QueuedEdge> expected;
+  Pit ref(type);
+  setup_pit(ref, channel_count, channel_mode);
+  for(int c = 0; c < 3; c++) {
+    ref.channel[c].setOutputHandler(&record_edge, &expected);
+  }
+  for(unsigned long n : bursts) {
+    ref.run(n);
+  }
+
+  // Every received edge must appear in the reference, in order. Dropped edges
+  // are gaps.
+  size_t next = 0;
+  size_t unmatched = 0;
+  for(const QueuedEdge &edge : received) {
+    while(next < expected.size() && !same_edge(expected[next], edge)) {
+      next++;
+    }
+    if(next == expected.size()) {
+      unmatched++;
+    }
+    else {
+      next++;
+    }
+  }
+
+  bool ok = true;
+  fprintf(stderr, "%s: %lu edges, %lu received, %lu dropped, high water %lu: ", name, 
+          (unsigned long)expected.size(), (unsigned long)received.size(), (unsigned long)queue.getDropped(),
+          (unsigned long)queue.getHighWater());
+
+  if(unmatched) {
+    fprintf(stderr, "%lu edges out of order or not produced. ", (unsigned long)unmatched);
+    ok = false;
+  }
+  if(past_limit) {
+    fprintf(stderr, "%lu edges drained past their limit. ", (unsigned long)past_limit);
+    ok = false;
+  }
+  if(queue.getPushed() != received.size()) {
+    fprintf(stderr, "%lu pushed but %lu received. ", (unsigned long)queue.getPushed(), 
+            (unsigned long)received.size());
+    ok = false;
+  }
+  if(queue.getPushed() + queue.getDropped() != expected.size()) {
+    fprintf(stderr, "pushed + dropped is not the edge count. ");
+    ok = false;
+  }
+  if(paced && (queue.getDropped() || received.size() != expected.size())) {
+    fprintf(stderr, "edges lost although the producer was paced. ");
+    ok = false;
+  }
+  if(queue.getHighWater() > Capacity - 1) {
+    fprintf(stderr, "high water is past the capacity. ");
+    ok = false;
+  }
+  fprintf(stderr, "%s\n", ok ? "pass" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  PitType type = kModel8253;
+  uint32_t seed = 1;
+  unsigned long long ticks = 2000000;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--8254") == 0) {
+      type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+      ticks = strtoull(argv[++i], NULL, 0);
+    }
+    else {
+      fprintf(stderr, "usage: %s [--8254] [--seed n] [--ticks n]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<unsigned long> bursts = make_bursts(seed, ticks);
+
+  int failed = 0;
+  failed += !run_case<4096>("paced", type, bursts, true, 0);
+  failed += !run_case<16>("tiny queue", type, bursts, false, 100);
+
+  fprintf(stderr, "%d of 2 failed\n", failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+#include <poll.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "avr/io.h"
+
+HostSerial Serial;
+EEPROMClass EEPROM;
+
+unsigned long host_micros = 0;
+void (*host_on_delay)() = nullptr;
+
+MockRegister PORTB, PORTC, PORTD;
+MockRegister PINB, PINC, PIND;
+MockRegister DDRB, DDRC, DDRD;
+
+void (*MockRegister::on_write)(MockRegister &reg) = nullptr;
+
+int HostSerial::available() {
+  if(fd < 0) {
+    return 0;
+  }
+  struct pollfd p = { fd, POLLIN, 0 };
+  int ready = poll(&p, 1, 1);
+  if(ready > 0 && (p.revents & POLLIN)) {
+    return 1;
+  }
+  if(ready > 0) {
+    // Hung up, with no one on the other end: wait as if polling.
+    usleep(1000);
+  }
+  host_micros += 1000;
+  return 0;
+}
+
+int HostSerial::read() {
+  uint8_t byte;
+  if(fd < 0 || ::read(fd, &byte, 1) != 1) {
+    return -1;
+  }
+  return byte;
+}
+
+void HostSerial::fdWrite(const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while(len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if(n <= 0) {
+      return;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+}
@@ -0,0 +1,545 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Compare a logic-analyzer capture of a real 8253/8254 bus against the emulator.
+//
+//   la_compare [--8254] [--chan <c>] [--ops <file>] <capture.csv|capture.vcd>
+//
+// The capture is decoded in one pass over the memory-mapped file, so captures
+// larger than memory work. Signals are matched by name, ignoring case and
+// punctuation (so "WR#", "/WR" and "wr" are all WR):
+//   CLK, WR, RD, A0, A1, D0-D7    required; the data bus may instead be one 8-bit
+//                                 vector or CSV column named D or DATA
+//   CS                            optional; without it every strobe is a bus cycle
+//   GATE0-2, OUT0-2               optional; GATE and OUT alone are channel --chan
+//                                 (default 2). A channel with no GATE signal is
+//                                 assumed strapped HIGH, as on the PC.
+//
+// A CSV capture has a header row of signal names, with the time in the first
+// column, and one row per sample. A VCD capture may use any time scale.
+//
+// Each CLK falling edge clocks the emulator once. Writes are applied on the
+// rising edge of WR and reads are compared on the rising edge of RD, using the
+// data bus as it was while the strobe was low. OUT pins are compared just before
+// each CLK falling edge, when they have settled from the previous tick or bus
+// cycle. Channels the emulator considers undefined are not compared. The first
+// mismatch is reported, and --ops writes the decoded bus activity up to it as an
+// op script for pit_minimize.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/la_compare.cpp host/host_arduino.cpp
+//     sketches/validate/lib.cpp -o la_compare
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pit_oracle.h"
+
+enum Pin {
+  kPinClk,
+  kPinWr,
+  kPinRd,
+  kPinCs,
+  kPinA0,
+  kPinA1,
+  kPinGate0,
+  kPinOut0 = kPinGate0 + 3,
+  kPinD0 = kPinOut0 + 3,
+  kNumPins = kPinD0 + 8
+};
+
+// Source signals that are not a single pin.
+#define SIGNAL_IGNORED -1
+#define SIGNAL_DATA_BUS -2
+
+#define PIN(p) (1ul << (p))
+#define REQUIRED_PINS (PIN(kPinClk) | PIN(kPinWr) | PIN(kPinRd) | PIN(kPinA0) | PIN(kPinA1) | (0xFFul << kPinD0))
+
+static const char *pin_names[kNumPins] = {
+  "CLK", "WR", "RD", "CS", "A0", "A1", "GATE0", "GATE1", "GATE2", "OUT0", "OUT1", "OUT2",
+  "D0", "D1", "D2", "D3", "D4", "D5", "D6", "D7"
+};
+
+// Map a signal name to a pin, SIGNAL_DATA_BUS or SIGNAL_IGNORED.
+static int signal_from_name(const char *name, size_t len, u8 chan) {
+  char norm[32];
+  size_t n = 0;
+
+  for(size_t i = 0; i < len && n < sizeof norm - 1; i++) {
+    if(isalnum((unsigned char)name[i])) {
+      norm[n++] = (char)toupper((unsigned char)name[i]);
+    }
+  }
+  norm[n] = 0;
+
+  if(strcmp(norm, "D") == 0 || strcmp(norm, "DATA") == 0) {
+    return SIGNAL_DATA_BUS;
+  }
+  if(strcmp(norm, "GATE") == 0) {
+    return kPinGate0 + chan;
+  }
+  if(strcmp(norm, "OUT") == 0) {
+    return kPinOut0 + chan;
+  }
+  for(int p = 0; p < kNumPins; p++) {
+    if(strcmp(norm, pin_names[p]) == 0) {
+      return p;
+    }
+  }
+  return SIGNAL_IGNORED;
+}
+
+// Applies decoded pin states to the emulator, one sample at a time.
+class BusDecoder {
+
+  private:
+    Pit pit;
+    uint32_t present;
+    uint32_t prev;
+    bool first;
+    FILE *ops_out;
+    unsigned long pending_ticks;
+
+    void writeOp(const PitOp &op) {
+      if(!ops_out) {
+        return;
+      }
+      if(op.op == Tick) {
+        pending_ticks += op.arg;
+        return;
+      }
+      flushTicks();
+      char buf[32];
+      format_op(op, buf, sizeof buf);
+      fprintf(ops_out, "%s\n", buf);
+    }
+
+    void fail(const char *time, size_t time_len, const char *fmt, unsigned a, unsigned b, unsigned c) {
+      fprintf(stderr, "mismatch at sample %llu (time %.*s), tick %llu: ", samples, (int)time_len, time,
+        pit.getCycles());
+      fprintf(stderr, fmt, a, b, c);
+      fprintf(stderr, "\n");
+      if(ops_out) {
+        flushTicks();
+        fprintf(ops_out, "# mismatch\n");
+      }
+    }
+
+  public:
+    unsigned long long samples = 0;
+    unsigned long long writes = 0;
+    unsigned long long reads = 0;
+    unsigned long long compares = 0;
+
+    BusDecoder(PitType type, uint32_t present, FILE *ops_out) :
+      pit(type), present(present), prev(0), first(true), ops_out(ops_out), pending_ticks(0) {}
+
+    void flushTicks() {
+      if(ops_out && pending_ticks) {
+        fprintf(ops_out, "tick %lu\n", pending_ticks);
+        pending_ticks = 0;
+      }
+    }
+
+    unsigned long long getTicks() {
+      return pit.getCycles();
+    }
+
+    // Process one sample. Returns false on the first mismatch.
+    bool step(uint32_t now, const char *time, size_t time_len) {
+      samples++;
+
+      if(first) {
+        first = false;
+        for(u8 c = 0; c < 3; c++) {
+          bool level = (present & PIN(kPinGate0 + c)) ? (now & PIN(kPinGate0 + c)) != 0 : true;
+          pit.setGate(c, level);
+          writeOp(make_op(FlipGate, c, level));
+        }
+        prev = now;
+        return true;
+      }
+
+      uint32_t rise = now & ~prev;
+      uint32_t fall = prev & ~now;
+      // Chip select and address are taken from the last sample of the strobe.
+      bool selected = !(present & PIN(kPinCs)) || !(prev & PIN(kPinCs));
+      u8 port = (u8)(((prev >> kPinA0) & 1) | (((prev >> kPinA1) & 1) << 1));
+      u8 data = (u8)(prev >> kPinD0);
+
+      if(fall & PIN(kPinClk)) {
+        // OUT has settled from everything before this edge.
+        u8 defined = (u8)~pit.getUndefinedMask();
+        u8 outputs = pit.getOutputs();
+        compares++;
+        for(u8 c = 0; c < 3; c++) {
+          if(!(present & PIN(kPinOut0 + c)) || !(defined & (1 << c))) {
+            continue;
+          }
+          bool captured = (prev & PIN(kPinOut0 + c)) != 0;
+          if(captured != (((outputs >> c) & 1) != 0)) {
+            fail(time, time_len, "OUT%u capture %u emulator %u", c, captured, !captured);
+            return false;
+          }
+        }
+        pit.run(1);
+        writeOp(make_op(Tick, 0, 1));
+      }
+
+      if((rise & PIN(kPinWr)) && selected) {
+        pit.ioWrite(port, data);
+        writes++;
+        writeOp(port == PIT_COMMAND_PORT ? make_op(WriteCommand, 0, data) : make_op(WriteChannel, port, data));
+      }
+
+      if((rise & PIN(kPinRd)) && selected && port < 3) {
+        bool defined = !(pit.getUndefinedMask() & (1 << port));
+        u8 byte = pit.ioRead(port);
+        reads++;
+        writeOp(make_op(ReadChannel, port, 0));
+        if(defined && byte != data) {
+          fail(time, time_len, "read from channel %u, capture %02X emulator %02X", port, data, byte);
+          return false;
+        }
+      }
+
+      for(u8 c = 0; c < 3; c++) {
+        if((rise | fall) & PIN(kPinGate0 + c)) {
+          bool level = (now & PIN(kPinGate0 + c)) != 0;
+          pit.setGate(c, level);
+          writeOp(make_op(FlipGate, c, level));
+        }
+      }
+
+      prev = now;
+      return true;
+    }
+};
+
+struct MappedFile {
+  const char *data = NULL;
+  size_t size = 0;
+
+  bool open(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0) {
+      perror(path);
+      return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+      perror(path);
+      close(fd);
+      return false;
+    }
+    size = (size_t)st.st_size;
+    if(size) {
+      void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(p == MAP_FAILED) {
+        perror(path);
+        close(fd);
+        return false;
+      }
+      madvise(p, size, MADV_SEQUENTIAL);
+      data = (const char *)p;
+    }
+    close(fd);
+    return true;
+  }
+
+  ~MappedFile() {
+    if(data) {
+      munmap((void *)data, size);
+    }
+  }
+};
+
+static uint32_t check_pins(uint32_t present) {
+  uint32_t missing = REQUIRED_PINS & ~present;
+  for(int p = 0; p < kNumPins; p++) {
+    if(missing & PIN(p)) {
+      fprintf(stderr, "capture has no %s signal\n", pin_names[p]);
+    }
+  }
+  return missing;
+}
+
+static uint32_t mark_present(int signal) {
+  if(signal == SIGNAL_DATA_BUS) {
+    return 0xFFul << kPinD0;
+  }
+  return signal >= 0 ? PIN(signal) : 0;
+}
+
+// Set a signal's bits in a pin state.
+static uint32_t apply_signal(uint32_t state, int signal, unsigned long value) {
+  if(signal == SIGNAL_DATA_BUS) {
+    return (state & ~(0xFFul << kPinD0)) | ((value & 0xFF) << kPinD0);
+  }
+  if(signal >= 0) {
+    return value ? (state | PIN(signal)) : (state & ~PIN(signal));
+  }
+  return state;
+}
+
+// CSV: a header row of names, then one row per sample with the time first.
+static int compare_csv(const char *p, const char *end, PitType type, u8 chan, FILE *ops_out) {
+  std::vector<int> columns;
+  uint32_t present = 0;
+
+  const char *eol = (const char *)memchr(p, '\n', end - p);
+  if(!eol) {
+    eol = end;
+  }
+  for(const char *field = p; field <= eol && field < end;) {
+    const char *comma = (const char *)memchr(field, ',', eol - field);
+    const char *field_end = comma ? comma : eol;
+    columns.push_back(columns.empty() ? SIGNAL_IGNORED : signal_from_name(field, field_end - field, chan));
+    present |= mark_present(columns.back());
+    if(!comma) {
+      break;
+    }
+    field = comma + 1;
+  }
+  if(check_pins(present)) {
+    return 1;
+  }
+
+  BusDecoder decoder(type, present, ops_out);
+  uint32_t state = 0;
+
+  for(p = eol + (eol < end); p < end; ) {
+    eol = (const char *)memchr(p, '\n', end - p);
+    if(!eol) {
+      eol = end;
+    }
+    const char *time = p;
+    size_t time_len = 0;
+    size_t col = 0;
+
+    for(const char *field = p; field < eol && col < columns.size(); col++) {
+      const char *comma = (const char *)memchr(field, ',', eol - field);
+      const char *field_end = comma ? comma : eol;
+      if(col == 0) {
+        time_len = field_end - field;
+      }
+      else if(columns[col] != SIGNAL_IGNORED) {
+        while(field < field_end && (*field == ' ' || *field == '"')) {
+          field++;
+        }
+        // Most fields are a single 0 or 1; skip strtoul() for those.
+        unsigned long value = (field_end - field == 1) ? (unsigned long)(*field - '0') : strtoul(field, NULL, 0);
+        state = apply_signal(state, columns[col], value);
+      }
+      if(!comma) {
+        break;
+      }
+      field = comma + 1;
+    }
+
+    if(col > 0 && !decoder.step(state, time, time_len)) {
+      return 1;
+    }
+    p = eol + 1;
+  }
+
+  decoder.flushTicks();
+  fprintf(stderr, "%llu samples, %llu ticks, %llu writes, %llu reads, %llu output checks: no mismatch\n",
+    decoder.samples, decoder.getTicks(), decoder.writes, decoder.reads, decoder.compares);
+  return 0;
+}
+
+// Short VCD identifiers packed into an integer key.
+static uint64_t vcd_id_key(const char *id, size_t len) {
+  uint64_t key = len;
+  for(size_t i = 0; i < len && i < 7; i++) {
+    key |= (uint64_t)(u8)id[i] << (8 * (i + 1));
+  }
+  return key;
+}
+
+static const char *skip_space(const char *p, const char *end) {
+  while(p < end && isspace((unsigned char)*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *token_end(const char *p, const char *end) {
+  while(p < end && !isspace((unsigned char)*p)) {
+    p++;
+  }
+  return p;
+}
+
+static int compare_vcd(const char *p, const char *end, PitType type, u8 chan, FILE *ops_out) {
+  std::unordered_map<uint64_t, int> ids;
+  uint32_t present = 0;
+
+  // Header: collect $var declarations up to $enddefinitions.
+  for(p = skip_space(p, end); p < end; p = skip_space(p, end)) {
+    const char *t = token_end(p, end);
+    std::string tok(p, t);
+    p = t;
+    if(tok == "$enddefinitions") {
+      break;
+    }
+    if(tok == "$var") {
+      const char *fields[4];
+      size_t lens[4];
+      for(int i = 0; i < 4; i++) {
+        p = skip_space(p, end);
+        t = token_end(p, end);
+        fields[i] = p;
+        lens[i] = t - p;
+        p = t;
+      }
+      // type, size, id, name
+      int signal = signal_from_name(fields[3], lens[3], chan);
+      if(signal == SIGNAL_DATA_BUS && strtoul(fields[1], NULL, 10) != 8) {
+        signal = SIGNAL_IGNORED;
+      }
+      ids[vcd_id_key(fields[2], lens[2])] = signal;
+      present |= mark_present(signal);
+    }
+  }
+  if(check_pins(present)) {
+    return 1;
+  }
+
+  BusDecoder decoder(type, present, ops_out);
+  uint32_t state = 0;
+  const char *time = "0";
+  size_t time_len = 1;
+  bool dirty = false;
+
+  p = token_end(p, end);
+  for(p = skip_space(p, end); p < end; p = skip_space(p, end)) {
+    const char *t = token_end(p, end);
+    char kind = *p;
+
+    if(kind == '#') {
+      // All changes at the previous time are in; process them as one sample.
+      if(dirty && !decoder.step(state, time, time_len)) {
+        return 1;
+      }
+      dirty = false;
+      time = p + 1;
+      time_len = t - time;
+    }
+    else if(kind == '0' || kind == '1' || kind == 'x' || kind == 'X' || kind == 'z' || kind == 'Z') {
+      auto it = ids.find(vcd_id_key(p + 1, t - p - 1));
+      if(it != ids.end()) {
+        state = apply_signal(state, it->second, kind == '1');
+        dirty = true;
+      }
+    }
+    else if(kind == 'b' || kind == 'B') {
+      unsigned long value = 0;
+      for(const char *d = p + 1; d < t; d++) {
+        value = (value << 1) | (*d == '1');
+      }
+      p = skip_space(t, end);
+      t = token_end(p, end);
+      auto it = ids.find(vcd_id_key(p, t - p));
+      if(it != ids.end()) {
+        state = apply_signal(state, it->second, value);
+        dirty = true;
+      }
+    }
+    else if(kind == 'r' || kind == 'R') {
+      // Real values carry no pins; skip the identifier.
+      t = token_end(skip_space(t, end), end);
+    }
+    // Keywords such as $dumpvars and $end only group changes.
+    p = t;
+  }
+  if(dirty && !decoder.step(state, time, time_len)) {
+    return 1;
+  }
+
+  decoder.flushTicks();
+  fprintf(stderr, "%llu samples, %llu ticks, %llu writes, %llu reads, %llu output checks: no mismatch\n",
+    decoder.samples, decoder.getTicks(), decoder.writes, decoder.reads, decoder.compares);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  PitType type = kModel8253;
+  u8 chan = 2;
+  const char *ops_path = NULL;
+  const char *path = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--8254") == 0) {
+      type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--chan") == 0 && i + 1 < argc) {
+      chan = (u8)(strtoul(argv[++i], NULL, 0) % 3);
+    }
+    else if(strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+      ops_path = argv[++i];
+    }
+    else if(!path && argv[i][0] != '-') {
+      path = argv[i];
+    }
+    else {
+      path = NULL;
+      break;
+    }
+  }
+  if(!path) {
+    fprintf(stderr, "usage: %s [--8254] [--chan c] [--ops file] <capture.csv|capture.vcd>\n", argv[0]);
+    return 2;
+  }
+
+  MappedFile file;
+  if(!file.open(path)) {
+    return 1;
+  }
+
+  FILE *ops_out = NULL;
+  if(ops_path) {
+    ops_out = fopen(ops_path, "w");
+    if(!ops_out) {
+      perror(ops_path);
+      return 1;
+    }
+  }
+
+  const char *p = file.data ? file.data : "";
+  const char *end = p + file.size;
+  const char *first = skip_space(p, end);
+  int rc = (first < end && *first == '$') ? compare_vcd(p, end, type, chan, ops_out)
+                                          : compare_csv(p, end, type, chan, ops_out);
+  if(ops_out) {
+    fclose(ops_out);
+  }
+  return rc;
+}
@@ -0,0 +1,173 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "mock_8253.h"
+
+#define CLK_BIT BIT5    // PORTB
+#define GATE2_BIT BIT4  // PORTB
+#define RD_BIT BIT3     // PORTC
+#define WR_BIT BIT4     // PORTC
+#define RESET_BIT BIT5  // PORTC
+
+Mock8253 *Mock8253::active = nullptr;
+
+Mock8253::Mock8253(PitType type) : type(type), chip(type) {
+  powerUp();
+}
+
+void Mock8253::attach() {
+  active = this;
+  MockRegister::on_write = onWrite;
+  host_on_delay = onDelay;
+
+  // Start powered, with RD and WR inactive (HIGH).
+  PORTC.value |= RESET_BIT | RD_BIT | WR_BIT;
+  last_portb = PORTB.value;
+  last_portc = PORTC.value;
+  address = (PORTB.value >> 2) & 0x03;
+  prev_address = address;
+  address_time = host_micros;
+  read_pending = false;
+  updateOutputs();
+}
+
+void Mock8253::detach() {
+  if(active == this) {
+    MockRegister::on_write = nullptr;
+    host_on_delay = nullptr;
+    active = nullptr;
+  }
+}
+
+void Mock8253::onWrite(MockRegister &reg) {
+  if(active && (&reg == &PORTB || &reg == &PORTC)) {
+    active->update();
+  }
+}
+
+void Mock8253::onDelay() {
+  if(active && active->read_pending && host_micros - active->strobe_time >= active->timing.read_access_us) {
+    active->driveBus();
+  }
+}
+
+void Mock8253::powerUp() {
+  chip = Pit(type);
+  chip.channel[0].setGate(GATE01_STRAP);
+  chip.channel[1].setGate(GATE01_STRAP);
+  if(PORTB.value & GATE2_BIT) {
+    chip.channel[2].setGate(true);
+  }
+}
+
+void Mock8253::updateOutputs() {
+  PINC.value = (PINC.value & ~0x07) | (powered ? chip.getOutputs() : 0);
+}
+
+// Put the byte being read on the data bus.
+void Mock8253::driveBus() {
+  PIND.value = (PIND.value & 0x03) | (read_byte & 0xFC);
+  PINB.value = (PINB.value & 0xFC) | (read_byte & 0x03);
+  read_pending = false;
+}
+
+// The port an access starting now goes to: the previous address if the current
+// one has not been held for the setup time.
+u8 Mock8253::strobePort() {
+  strobe_time = host_micros;
+  if(host_micros - address_time < timing.address_setup_us) {
+    violations++;
+    return prev_address;
+  }
+  return address;
+}
+
+void Mock8253::update() {
+  u8 portb = PORTB.value;
+  u8 portc = PORTC.value;
+  u8 changed_b = portb ^ last_portb;
+  u8 changed_c = portc ^ last_portc;
+  last_portb = portb;
+  last_portc = portc;
+
+  if(changed_c & RESET_BIT) {
+    powered = (portc & RESET_BIT) != 0;
+    if(powered) {
+      powerUp();
+    }
+  }
+
+  if(!powered) {
+    updateOutputs();
+    return;
+  }
+
+  u8 port = (portb >> 2) & 0x03;
+  if(port != address) {
+    prev_address = address;
+    address = port;
+    address_time = host_micros;
+    if(!(portc & WR_BIT)) {
+      // Moved during a write strobe. The write goes where the address is when WR rises.
+      access_port = port;
+    }
+  }
+
+  if((changed_b & GATE2_BIT)) {
+    chip.channel[2].setGate((portb & GATE2_BIT) != 0);
+  }
+
+  if((changed_b & CLK_BIT) && !(portb & CLK_BIT)) {
+    chip.tick();
+  }
+
+  if((changed_c & WR_BIT) && !(portc & WR_BIT)) {
+    access_port = strobePort();
+  }
+
+  if((changed_c & WR_BIT) && (portc & WR_BIT) && (portc & RD_BIT)) {
+    if(host_micros - strobe_time < timing.write_pulse_us) {
+      violations++;
+    }
+    else {
+      chip.ioWrite(access_port, (PORTD.value & 0xFC) | (portb & 0x03));
+    }
+  }
+
+  if(changed_c & RD_BIT) {
+    if(!(portc & RD_BIT)) {
+      read_byte = chip.ioRead(strobePort());
+      read_pending = true;
+      if(timing.read_access_us == 0) {
+        driveBus();
+      }
+    }
+    else {
+      if(read_pending) {
+        // RD rose before the data was valid: whatever was sampled was the floating bus.
+        violations++;
+        read_pending = false;
+      }
+      PIND.value |= 0xFC;
+      PINB.value |= 0x03;
+    }
+  }
+
+  updateOutputs();
+}
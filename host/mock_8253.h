@@ -0,0 +1,103 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// A simulated 8253 wired to the mock port registers the same way the real chip
+// is wired to the Uno (see arduino_8253.h). With it attached, the sketch's own
+// bus, clock and capture code runs unmodified in a host build:
+//  - CLK falling edge ticks the chip.
+//  - WR rising edge (with RD high) latches the data bus into the addressed port.
+//  - RD falling edge drives the addressed port's byte onto PIND/PINB.
+//  - GATE2 follows PORTB bit 4. Gates 0 and 1 are held at GATE01_STRAP.
+//  - RESET LOW powers the chip off; going HIGH powers up a fresh chip.
+//  - OUT0..OUT2 are reflected on PINC bits 0-2 after every change.
+//
+// Bus timing is not checked unless setTiming() is given minimum times. Each is
+// measured on the host's virtual microsecond clock, which only the sketch's
+// delays advance, and a violation fails the way a marginal bus would:
+//  - An address change less than address_setup_us before RD or WR falls is not
+//    seen; the access goes to the previous port.
+//  - WR held LOW for less than write_pulse_us: the write is lost.
+//  - The data bus floats HIGH until read_access_us after RD falls.
+
+#ifndef _MOCK_8253_H
+#define _MOCK_8253_H
+
+#include "arduino_8253.h"
+#include "pit_emulator.h"
+
+struct MockBusTiming {
+  unsigned long address_setup_us;
+  unsigned long read_access_us;
+  unsigned long write_pulse_us;
+};
+
+class Mock8253 {
+
+  private:
+    PitType type;
+    Pit chip;
+    bool powered = true;
+    u8 last_portb = 0;
+    u8 last_portc = 0;
+
+    MockBusTiming timing = {0, 0, 0};
+    unsigned long violations = 0;
+    u8 address = 0;
+    u8 prev_address = 0;
+    unsigned long address_time = 0;
+    u8 access_port = 0;
+    unsigned long strobe_time = 0;
+    bool read_pending = false;
+    u8 read_byte = 0;
+
+    static Mock8253 *active;
+    static void onWrite(MockRegister &reg);
+    static void onDelay();
+
+    void powerUp();
+    void updateOutputs();
+    void driveBus();
+    u8 strobePort();
+    void update();
+
+  public:
+    Mock8253(PitType type);
+
+    // Connect to the mock registers. Only one mock chip may be attached at a time.
+    void attach();
+    void detach();
+
+    Pit &getChip() {
+      return chip;
+    }
+
+    void setTiming(const MockBusTiming &t) {
+      timing = t;
+    }
+
+    // Accesses that broke the timing given to setTiming(), since the last call.
+    unsigned long takeViolations() {
+      unsigned long v = violations;
+      violations = 0;
+      return v;
+    }
+};
+
+#endif // _MOCK_8253_H
@@ -0,0 +1,182 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Run many fuzz sequences at once as coroutine tests, batching their bus ops.
+//
+//   pit_batch_check [options]
+//     --emu <type>      emulator model under test (default 8253)
+//     --ref <type>      model the backend runs as a stand-in device (default 8253)
+//     --port <dev>      run on a validator board instead of the stand-in; may be repeated
+//     --cache <file>    answer from, and record into, a result cache in front of the device
+//     --tests <n>       tests to run (default 64); with --port, run as many at a time as there are boards
+//     --ops <n>         fuzz ops per test (default 200)
+//     --seed <n>        seed of the first test; test i uses seed + i (default 1)
+//
+// Each test generates test_fuzzer()'s sequence for its seed, runs it on a local
+// emulator and co_awaits the same ops on its own lane of the backend, comparing
+// results as it goes. Every test that diverges is written to stdout as an op
+// script up to the first divergent op. Batch statistics go to stderr.
+//
+// Every backend keeps each lane's state and runs only its new ops: the stand-in
+// as an emulator per lane, boards as described in pit_serial_batch.h. A cache
+// answers a lane for as long as it matches what the device has run before.
+// Boards run one test each at a time, so that no lane has to be replayed onto a
+// board another lane was using.
+//
+// Build (from the repository root):
+//   g++ -std=c++20 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_batch_check.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o pit_batch_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+
+#include "pit_cache.h"
+#include "pit_coro.h"
+#include "pit_serial_batch.h"
+
+static PitType parse_type(const char *s) {
+  return strcmp(s, "8254") == 0 ? kModel8254 : kModel8253;
+}
+
+static PitTask fuzz_test(PitLane lane, PitType emu_type, uint32_t seed, size_t count) {
+  OpSequence ops = fuzz_sequence(seed, count);
+  Pit emu(emu_type);
+  PitOpResult expected;
+
+  for(size_t i = 0; i < ops.size(); i++) {
+    apply_op(emu, ops[i], expected);
+    PitOpResult actual = co_await lane.op(ops[i]);
+
+    if(!results_match(expected, actual, ops[i])) {
+      printf("# seed %u diverges at op %lu\n", (unsigned)seed, (unsigned long)i);
+      write_ops(stdout, OpSequence(ops.begin(), ops.begin() + i + 1));
+      co_return false;
+    }
+  }
+  co_return true;
+}
+
+int main(int argc, char **argv) {
+  PitType emu_type = kModel8253;
+  PitType ref_type = kModel8253;
+  const char *cache_path = NULL;
+  unsigned tests = 64;
+  std::vector<const char *> ports;
+  size_t count = 200;
+  uint32_t seed = 1;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--emu") == 0 && i + 1 < argc) {
+      emu_type = parse_type(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--ref") == 0 && i + 1 < argc) {
+      ref_type = parse_type(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+      ports.push_back(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+      cache_path = argv[++i];
+    }
+    else if(strcmp(argv[i], "--tests") == 0 && i + 1 < argc) {
+      tests = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+      count = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    }
+    else {
+      fprintf(stderr, "usage: %s [--emu type] [--ref type] [--port dev] [--cache file] [--tests n] [--ops n] "
+        "[--seed n]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<std::unique_ptr<PitSerialBoard>> boards;
+  std::vector<PitSerialBoard *> board_ptrs;
+  for(const char *port : ports) {
+    boards.emplace_back(new PitSerialBoard(port));
+    if(!boards.back()->open()) {
+      fprintf(stderr, "%s: no board\n", port);
+      return 1;
+    }
+    if(boards.size() > 1 && boards.back()->getModel() != boards[0]->getModel()) {
+      fprintf(stderr, "%s: not the same model as %s\n", port, ports[0]);
+      return 1;
+    }
+    ref_type = boards[0]->getModel();
+    board_ptrs.push_back(boards.back().get());
+  }
+  unsigned wave = boards.empty() ? tests : (unsigned)boards.size();
+
+  PitResultCache cache;
+  std::unique_ptr<SerialBatchBackend> serial;
+  std::unique_ptr<PitBatchBackend> device;
+  std::unique_ptr<CachedBatchBackend> cached;
+
+  if(!boards.empty()) {
+    serial.reset(new SerialBatchBackend(board_ptrs));
+  }
+  else {
+    device.reset(new EmuBatchBackend(ref_type, true));
+  }
+  PitBatchBackend *backend = serial ? (PitBatchBackend *)serial.get() : device.get();
+
+  if(cache_path) {
+    if(!cache.open(cache_path, ref_type)) {
+      return 1;
+    }
+    cached.reset(new CachedBatchBackend(cache, *backend));
+    backend = cached.get();
+  }
+
+  PitScheduler scheduler(*backend);
+  unsigned failed = 0;
+  for(unsigned first = 0; first < tests; first += wave) {
+    std::vector<PitTask> tasks;
+    for(unsigned t = first; t < tests && t < first + wave; t++) {
+      tasks.push_back(fuzz_test(PitLane(scheduler), emu_type, seed + t, count));
+    }
+
+    if(!scheduler.run(tasks)) {
+      fprintf(stderr, "backend failed\n");
+      return 1;
+    }
+    for(PitTask &task : tasks) {
+      failed += !task.getPassed();
+    }
+  }
+
+  fprintf(stderr, "%u of %u tests diverged; %lu ops in %lu batches (largest %lu)\n", failed, tests,
+    scheduler.getOps(), scheduler.getBatches(), (unsigned long)scheduler.getLargestBatch());
+  if(serial) {
+    fprintf(stderr, "boards: %lu exchanges, %lu lanes moved onto a board, %lu ops replayed\n",
+      serial->getExchanges(), serial->getSwitches(), serial->getReplayedOps());
+  }
+  if(cached) {
+    cached->flush();
+    fprintf(stderr, "cache: %lu hits, %lu misses\n", cache.getHits(), cache.getMisses());
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,368 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Persistent store of results returned by real hardware, keyed by the hash of
+// the canonical op sequence that produced them. Hardware time is scarce (one
+// board manages roughly 100k ops/sec at best), so anything the chip has already
+// answered is answered again from disk.
+//
+// Results are only valid for the model of chip that produced them, so the
+// model is part of the file header and a cache opened for another model is
+// refused.
+//
+// The file is an append-only log:
+//   header:  "P8253RC2", u8 model (0 = 8253, 1 = 8254)
+//   record:  u32 n_ops, n_ops * { u8 op, u8 chan, u32 arg }, n_ops * { u8 byte, u8 outputs }
+// All integers are little-endian. A truncated trailing record (e.g. from a
+// killed process) is ignored on load.
+
+#ifndef _PIT_CACHE_H
+#define _PIT_CACHE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pit_oracle.h"
+
+#define CACHE_MAGIC "P8253RC2"
+#define CACHE_MAGIC_LEN 8
+
+class PitResultCache {
+
+  private:
+    struct Entry {
+      OpSequence ops;
+      OpResults results;
+    };
+
+    // A reference to the first 'len' ops of a stored entry.
+    struct PrefixRef {
+      size_t entry;
+      size_t len;
+    };
+
+    std::string path;
+    PitType model = kModel8253;
+    FILE *file = nullptr;
+    std::vector<Entry> entries;
+    std::unordered_multimap<uint64_t, PrefixRef> index;
+
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+
+    static void put_u32(std::vector<u8> &buf, uint32_t v) {
+      for(int i = 0; i < 4; i++) {
+        buf.push_back((u8)(v >> (i * 8)));
+      }
+    }
+
+    static uint32_t get_u32(const u8 *p) {
+      return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    // Index every prefix of an entry so that a sequence the hardware has run as
+    // the start of a longer sequence is also a hit.
+    void indexEntry(size_t e) {
+      const OpSequence &ops = entries[e].ops;
+      uint64_t hash = OPS_HASH_INIT;
+      for(size_t i = 0; i < ops.size(); i++) {
+        hash = hash_op(hash, ops[i]);
+        index.insert({hash, PrefixRef{e, i + 1}});
+      }
+    }
+
+    const PrefixRef *find(const OpSequence &ops) const {
+      auto range = index.equal_range(hash_ops(ops));
+      for(auto it = range.first; it != range.second; ++it) {
+        if(matches(it->second, ops)) {
+          return &it->second;
+        }
+      }
+      return nullptr;
+    }
+
+    bool matches(const PrefixRef &ref, const OpSequence &ops) const {
+      if(ref.len != ops.size()) {
+        return false;
+      }
+      const OpSequence &stored = entries[ref.entry].ops;
+      for(size_t i = 0; i < ref.len; i++) {
+        if(stored[i] != ops[i]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool load() {
+      FILE *in = fopen(path.c_str(), "rb");
+      if(!in) {
+        return true;
+      }
+
+      PitType file_model;
+      if(!readHeader(in, file_model)) {
+        fprintf(stderr, "%s: not a result cache\n", path.c_str());
+        fclose(in);
+        return false;
+      }
+      if(file_model != model) {
+        fprintf(stderr, "%s: holds %s results, not %s\n", path.c_str(), model_name(file_model), model_name(model));
+        fclose(in);
+        return false;
+      }
+
+      u8 len_buf[4];
+      std::vector<u8> buf;
+      while(fread(len_buf, 1, 4, in) == 4) {
+        uint32_t n = get_u32(len_buf);
+        buf.resize((size_t)n * 8);
+        if(fread(buf.data(), 1, buf.size(), in) != buf.size()) {
+          break;
+        }
+
+        Entry entry;
+        entry.ops.resize(n);
+        entry.results.resize(n);
+        for(uint32_t i = 0; i < n; i++) {
+          const u8 *p = &buf[i * 6];
+          entry.ops[i] = make_op((FuzzerOp)p[0], p[1], get_u32(p + 2));
+        }
+        for(uint32_t i = 0; i < n; i++) {
+          const u8 *p = &buf[n * 6 + i * 2];
+          entry.results[i].byte = p[0];
+          entry.results[i].outputs = p[1];
+          entry.results[i].undefined = 0;
+        }
+        entries.push_back(entry);
+        indexEntry(entries.size() - 1);
+      }
+      fclose(in);
+      return true;
+    }
+
+    static bool readHeader(FILE *in, PitType &file_model) {
+      char magic[CACHE_MAGIC_LEN];
+      int m;
+      if(fread(magic, 1, CACHE_MAGIC_LEN, in) != CACHE_MAGIC_LEN || memcmp(magic, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0) {
+        return false;
+      }
+      if((m = fgetc(in)) == EOF || m > 1) {
+        return false;
+      }
+      file_model = m ? kModel8254 : kModel8253;
+      return true;
+    }
+
+  public:
+    PitResultCache() {}
+
+    static const char *model_name(PitType type) {
+      return type == kModel8254 ? "8254" : "8253";
+    }
+
+    // The model of chip a cache file holds results for. Returns false if the file
+    // does not exist or is not a cache.
+    static bool fileModel(const char *cache_path, PitType &file_model) {
+      FILE *in = fopen(cache_path, "rb");
+      if(!in) {
+        return false;
+      }
+      bool ok = readHeader(in, file_model);
+      fclose(in);
+      return ok;
+    }
+
+    ~PitResultCache() {
+      close();
+    }
+
+    // Load an existing cache file of results from a 'cache_model' chip, or create
+    // it if it does not exist.
+    bool open(const char *cache_path, PitType cache_model) {
+      close();
+      path = cache_path;
+      model = cache_model;
+      entries.clear();
+      index.clear();
+
+      if(!load()) {
+        return false;
+      }
+
+      file = fopen(path.c_str(), "ab");
+      if(!file) {
+        perror(path.c_str());
+        return false;
+      }
+      if(ftell(file) == 0) {
+        fwrite(CACHE_MAGIC, 1, CACHE_MAGIC_LEN, file);
+        fputc(model == kModel8254 ? 1 : 0, file);
+        fflush(file);
+      }
+      return true;
+    }
+
+    void close() {
+      if(file) {
+        fclose(file);
+        file = nullptr;
+      }
+    }
+
+    // Look up a canonical sequence. Returns true and fills 'results' on a hit.
+    bool lookup(const OpSequence &ops, OpResults &results) {
+      const PrefixRef *ref = find(ops);
+      if(ref) {
+        const OpResults &stored = entries[ref->entry].results;
+        results.assign(stored.begin(), stored.begin() + ref->len);
+        hits++;
+        return true;
+      }
+      misses++;
+      return false;
+    }
+
+    static const size_t kNoEntry = (size_t)-1;
+
+    // Look up a canonical sequence one op longer than, or differing only in its last op
+    // from, one an earlier call found in stored sequence 'entry' (kNoEntry at first).
+    // That sequence is checked first, so a sequence growing one op at a time costs O(1)
+    // per op for as long as it follows a stored one. On a hit, 'entry' is updated and
+    // 'result' is the last op's result.
+    bool lookupNext(const OpSequence &ops, size_t &entry, PitOpResult &result) {
+      size_t n = ops.size();
+      if(n == 0) {
+        misses++;
+        return false;
+      }
+      if(entry >= entries.size() || entries[entry].ops.size() < n || entries[entry].ops[n - 1] != ops[n - 1]) {
+        const PrefixRef *ref = find(ops);
+        if(!ref) {
+          misses++;
+          return false;
+        }
+        entry = ref->entry;
+      }
+      result = entries[entry].results[n - 1];
+      hits++;
+      return true;
+    }
+
+    // Store the results of a canonical sequence and append them to the log.
+    void insert(const OpSequence &ops, const OpResults &results) {
+      if(ops.empty() || find(ops)) {
+        return;
+      }
+
+      Entry entry;
+      entry.ops = ops;
+      entry.results = results;
+      for(PitOpResult &r : entry.results) {
+        r.undefined = 0;
+      }
+      entries.push_back(entry);
+      indexEntry(entries.size() - 1);
+
+      if(file) {
+        std::vector<u8> buf;
+        put_u32(buf, (uint32_t)ops.size());
+        for(const PitOp &op : ops) {
+          buf.push_back(op.op);
+          buf.push_back(op.chan);
+          put_u32(buf, op.arg);
+        }
+        for(const PitOpResult &r : entry.results) {
+          buf.push_back(r.byte);
+          buf.push_back(r.outputs);
+        }
+        fwrite(buf.data(), 1, buf.size(), file);
+        fflush(file);
+      }
+    }
+
+    PitType getModel() const {
+      return model;
+    }
+
+    size_t size() const {
+      return entries.size();
+    }
+
+    const OpSequence &entryOps(size_t e) const {
+      return entries[e].ops;
+    }
+
+    const OpResults &entryResults(size_t e) const {
+      return entries[e].results;
+    }
+
+    unsigned long getHits() const {
+      return hits;
+    }
+
+    unsigned long getMisses() const {
+      return misses;
+    }
+};
+
+// Oracle that answers from the cache where it can and forwards misses to a
+// backend (a hardware board or a stand-in), recording what the backend returns.
+// Sequences are canonicalized first and results are reported per canonical op,
+// so callers that need to line results up with ops should pass canonical input.
+// The cache keeps no undefined masks, so results mark unprogrammed channels
+// undefined whether they come from the cache or the backend, as hardware
+// results do (see mark_unprogrammed()).
+class CachedOracle : public PitOracle {
+
+  private:
+    PitResultCache &cache;
+    PitOracle &backend;
+    unsigned long backend_runs = 0;
+
+  public:
+    CachedOracle(PitResultCache &cache, PitOracle &backend) : cache(cache), backend(backend) {}
+
+    bool run(const OpSequence &ops, OpResults &results) override {
+      OpSequence canonical = canonicalize(ops);
+
+      if(cache.lookup(canonical, results)) {
+        mark_unprogrammed(canonical, results);
+        return true;
+      }
+
+      backend_runs++;
+      if(!backend.run(canonical, results)) {
+        return false;
+      }
+      cache.insert(canonical, results);
+      mark_unprogrammed(canonical, results);
+      return true;
+    }
+
+    unsigned long getBackendRuns() const {
+      return backend_runs;
+    }
+};
+
+#endif // _PIT_CACHE_H
@@ -0,0 +1,197 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Maintain a hardware result cache (see pit_cache.h).
+//
+//   pit_cache_tool populate <cache> <seed> <sequences> <ops> [8253|8254] [events]
+//       Run fuzzer-style sequences through the cache, using the emulator as a
+//       stand-in device for any misses. With 'events', ticks are placed around
+//       the next event as with FUZZ_EVENT_TICKS.
+//   pit_cache_tool check <cache> [8253|8254]
+//       Replay every cached sequence on the emulator and report divergences.
+//   pit_cache_tool stats <cache>
+//   pit_cache_tool selftest <scratch-file> [8253|8254]
+//       Check that 'check' ignores outputs of channels not yet programmed, using
+//       a hand-built cache in <scratch-file> (removed afterwards).
+//
+// A cache holds results for one model of chip. The model given to populate or
+// check must match the one the cache was created for.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_cache_tool.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o pit_cache_tool
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pit_cache.h"
+
+static PitType parse_type(int argc, char **argv, int i) {
+  if(i < argc && strcmp(argv[i], "8254") == 0) {
+    return kModel8254;
+  }
+  return kModel8253;
+}
+
+static int populate(PitResultCache &cache, uint32_t seed, unsigned long sequences, size_t count, PitType type,
+  bool events) {
+  PitEmuOracle stand_in(type, true);
+  CachedOracle oracle(cache, stand_in);
+  OpResults results;
+
+  for(unsigned long i = 0; i < sequences; i++) {
+    OpSequence ops = canonicalize(events ? fuzz_sequence_events(seed + i, count, type) : fuzz_sequence(seed + i, count));
+    if(!oracle.run(ops, results)) {
+      fprintf(stderr, "populate: sequence %lu failed\n", i);
+      return 1;
+    }
+  }
+
+  printf("populate: %lu sequences, %lu run on stand-in, %lu cached total\n",
+    sequences, oracle.getBackendRuns(), (unsigned long)cache.size());
+  return 0;
+}
+
+static int check(PitResultCache &cache, PitType type) {
+  PitEmuOracle emu(type);
+  OpResults results;
+  unsigned long failures = 0;
+
+  for(size_t e = 0; e < cache.size(); e++) {
+    const OpSequence &ops = cache.entryOps(e);
+    // Cached results are raw hardware results, so channels nothing has
+    // programmed yet must be marked undefined as a lookup would.
+    OpResults expected = cache.entryResults(e);
+    mark_unprogrammed(ops, expected);
+
+    emu.run(ops, results);
+    for(size_t i = 0; i < ops.size(); i++) {
+      if(!results_match(results[i], expected[i], ops[i])) {
+        char op_str[32];
+        format_op(ops[i], op_str, sizeof op_str);
+        printf("check: entry %lu diverges at op %lu (%s): emu byte %02X out %X, hw byte %02X out %X\n",
+          (unsigned long)e, (unsigned long)i, op_str, results[i].byte, results[i].outputs, expected[i].byte, expected[i].outputs);
+        failures++;
+        break;
+      }
+    }
+  }
+
+  printf("check: %lu of %lu cached sequences diverge\n", failures, (unsigned long)cache.size());
+  return failures ? 1 : 0;
+}
+
+// Check that check() itself ignores what it should: a hand-built cache whose
+// unprogrammed channel 0 disagrees with the emulator must pass, and the same
+// disagreement once channel 0 is programmed must not.
+static int selftest(const char *cache_path, PitType type) {
+  OpSequence ops;
+  ops.push_back(make_op(WriteCommand, 0, 0xB6));
+  ops.push_back(make_op(WriteChannel, 2, 0x0A));
+  ops.push_back(make_op(WriteChannel, 2, 0x00));
+  ops.push_back(make_op(Tick, 0, 5));
+  ops.push_back(make_op(WriteCommand, 0, 0x34));
+  ops.push_back(make_op(WriteChannel, 0, 0x0A));
+  ops.push_back(make_op(WriteChannel, 0, 0x00));
+  ops.push_back(make_op(Tick, 0, 3));
+
+  PitEmuOracle emu(type);
+  OpResults unprogrammed;
+  emu.run(ops, unprogrammed);
+  OpResults programmed = unprogrammed;
+  for(size_t i = 0; i < 4; i++) {
+    unprogrammed[i].outputs ^= 0x01;
+  }
+  programmed[7].outputs ^= 0x01;
+
+  int errors = 0;
+  for(int pass = 0; pass < 2; pass++) {
+    PitResultCache cache;
+    remove(cache_path);
+    if(!cache.open(cache_path, type)) {
+      return 1;
+    }
+    cache.insert(ops, pass ? programmed : unprogrammed);
+    bool diverged = check(cache, type) != 0;
+    if(diverged != (pass != 0)) {
+      fprintf(stderr, "selftest: OUT0 %s channel 0 %s\n", pass ? "programmed" : "unprogrammed",
+        diverged ? "reported as a divergence" : "not reported");
+      errors++;
+    }
+    cache.close();
+  }
+  remove(cache_path);
+
+  printf("selftest: %s\n", errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
+
+static int stats(PitResultCache &cache) {
+  unsigned long ops = 0;
+  for(size_t e = 0; e < cache.size(); e++) {
+    ops += cache.entryOps(e).size();
+  }
+  printf("stats: %s, %lu sequences, %lu ops\n", PitResultCache::model_name(cache.getModel()),
+    (unsigned long)cache.size(), ops);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if(argc < 3) {
+    fprintf(stderr, "usage: %s populate|check|stats|selftest <cache> ...\n", argv[0]);
+    return 2;
+  }
+
+  PitResultCache cache;
+  PitType type = kModel8253;
+
+  if(strcmp(argv[1], "populate") == 0 && argc >= 6) {
+    type = parse_type(argc, argv, 6);
+    if(!cache.open(argv[2], type)) {
+      return 1;
+    }
+    return populate(cache, strtoul(argv[3], NULL, 0), strtoul(argv[4], NULL, 0), strtoul(argv[5], NULL, 0),
+      type, argc >= 8 && strcmp(argv[7], "events") == 0);
+  }
+  if(strcmp(argv[1], "check") == 0) {
+    type = parse_type(argc, argv, 3);
+    if(!cache.open(argv[2], type)) {
+      return 1;
+    }
+    return check(cache, type);
+  }
+  if(strcmp(argv[1], "selftest") == 0) {
+    return selftest(argv[2], parse_type(argc, argv, 3));
+  }
+  if(strcmp(argv[1], "stats") == 0) {
+    if(!PitResultCache::fileModel(argv[2], type)) {
+      fprintf(stderr, "%s: not a result cache\n", argv[2]);
+      return 1;
+    }
+    if(!cache.open(argv[2], type)) {
+      return 1;
+    }
+    return stats(cache);
+  }
+
+  fprintf(stderr, "%s: bad command\n", argv[0]);
+  return 2;
+}
@@ -0,0 +1,127 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// C interface to the emulator. See pit_capi.h.
+
+#include <string.h>
+#include <new>
+
+#include "pit_capi.h"
+#include "pit_emulator.h"
+
+static_assert(sizeof(pit_op) == 8, "pit_op layout is part of the ABI");
+static_assert(sizeof(pit_result) == 4, "pit_result layout is part of the ABI");
+
+struct pit_handle {
+  PitType type;
+  Pit pit;
+
+  pit_handle(PitType type) : type(type), pit(type) {}
+};
+
+int pit_capi_version(void) {
+  return PIT_CAPI_VERSION;
+}
+
+pit_handle *pit_create(int model) {
+  if(model != PIT_MODEL_8253 && model != PIT_MODEL_8254) {
+    return NULL;
+  }
+  return new (std::nothrow) pit_handle(model == PIT_MODEL_8254 ? kModel8254 : kModel8253);
+}
+
+void pit_destroy(pit_handle *pit) {
+  delete pit;
+}
+
+void pit_reset(pit_handle *pit) {
+  pit->pit = Pit(pit->type);
+}
+
+size_t pit_run(pit_handle *pit, const pit_op *ops, size_t n_ops, pit_result *results) {
+  Pit &p = pit->pit;
+
+  for(size_t i = 0; i < n_ops; i++) {
+    const pit_op &op = ops[i];
+    u8 data = 0;
+
+    switch(op.op) {
+      case PIT_OP_NONE:
+        break;
+      case PIT_OP_WRITE:
+        if(op.port > PIT_COMMAND_PORT) {
+          return i;
+        }
+        p.ioWrite(op.port, (u8)op.arg);
+        break;
+      case PIT_OP_READ:
+        if(op.port >= PIT_COMMAND_PORT) {
+          return i;
+        }
+        data = p.ioRead(op.port);
+        break;
+      case PIT_OP_GATE:
+        if(op.port > 2) {
+          return i;
+        }
+        p.setGate(op.port, op.arg != 0);
+        break;
+      default:
+        return i;
+    }
+
+    if(op.cycles) {
+      p.run(op.cycles);
+    }
+
+    if(results) {
+      results[i].data = data;
+      results[i].outputs = p.getOutputs();
+      results[i].undefined = p.getUndefinedMask();
+      results[i].reserved = 0;
+    }
+  }
+  return n_ops;
+}
+
+uint8_t pit_get_outputs(pit_handle *pit) {
+  return pit->pit.getOutputs();
+}
+
+uint64_t pit_get_cycles(pit_handle *pit) {
+  return pit->pit.getCycles();
+}
+
+size_t pit_state_size(void) {
+  return sizeof(PitState);
+}
+
+void pit_save_state(pit_handle *pit, void *state) {
+  PitState s;
+  memset(&s, 0, sizeof s);
+  pit->pit.getState(s);
+  memcpy(state, &s, sizeof s);
+}
+
+void pit_load_state(pit_handle *pit, const void *state) {
+  PitState s;
+  memcpy(&s, state, sizeof s);
+  pit->pit.setState(s);
+}
@@ -0,0 +1,109 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// C interface to the emulator for frontends in other languages. A Pit is held
+// behind an opaque handle, and pit_run() executes a whole array of bus
+// operations in one call, so the cost of crossing the FFI boundary is paid once
+// per batch rather than once per port access or tick.
+//
+// The struct layouts below are fixed and padding-free, and the ABI only grows
+// by adding functions; check pit_capi_version() against PIT_CAPI_VERSION.
+//
+// Build as a shared library (from the repository root):
+//   g++ -std=c++17 -O2 -shared -fPIC -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_capi.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o libpit.so
+
+#ifndef _PIT_CAPI_H
+#define _PIT_CAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PIT_CAPI_VERSION 1
+
+#if defined(_WIN32)
+  #define PIT_CAPI __declspec(dllexport)
+#else
+  #define PIT_CAPI __attribute__((visibility("default")))
+#endif
+
+typedef struct pit_handle pit_handle;
+
+enum {
+  PIT_MODEL_8253 = 0,
+  PIT_MODEL_8254 = 1
+};
+
+enum {
+  PIT_OP_NONE = 0,    // Only run 'cycles'
+  PIT_OP_WRITE = 1,   // Write the low byte of 'arg' to 'port' (0-2 data, 3 control)
+  PIT_OP_READ = 2,    // Read a byte from 'port' (0-2) into the result
+  PIT_OP_GATE = 3     // Set the gate of channel 'port' to 'arg' (0 or 1)
+};
+
+// One operation. After the op is applied the PIT is clocked 'cycles' times.
+typedef struct pit_op {
+  uint8_t op;
+  uint8_t port;
+  uint16_t arg;
+  uint32_t cycles;
+} pit_op;
+
+// The state after one operation and its cycles.
+typedef struct pit_result {
+  uint8_t data;         // Byte read for PIT_OP_READ, 0 otherwise
+  uint8_t outputs;      // OUT0..OUT2 as a 3-bit mask
+  uint8_t undefined;    // Channels whose count the emulator considers undefined
+  uint8_t reserved;
+} pit_result;
+
+PIT_CAPI int pit_capi_version(void);
+
+// Create an emulated PIT in its reset state. Returns NULL for an unknown model
+// or if out of memory.
+PIT_CAPI pit_handle *pit_create(int model);
+PIT_CAPI void pit_destroy(pit_handle *pit);
+
+// Return the PIT to its reset state.
+PIT_CAPI void pit_reset(pit_handle *pit);
+
+// Execute 'n_ops' operations in order. 'results' receives one entry per op
+// executed, and may be NULL. Returns the number of ops executed, which is less
+// than 'n_ops' only if an op is invalid; that op is not applied.
+PIT_CAPI size_t pit_run(pit_handle *pit, const pit_op *ops, size_t n_ops, pit_result *results);
+
+PIT_CAPI uint8_t pit_get_outputs(pit_handle *pit);
+PIT_CAPI uint64_t pit_get_cycles(pit_handle *pit);
+
+// Save and restore the complete emulator state as an opaque blob of
+// pit_state_size() bytes, valid only for the same library build.
+PIT_CAPI size_t pit_state_size(void);
+PIT_CAPI void pit_save_state(pit_handle *pit, void *state);
+PIT_CAPI void pit_load_state(pit_handle *pit, const void *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PIT_CAPI_H
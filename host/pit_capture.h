@@ -0,0 +1,110 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Decoding of output captures sent by the sketch's logic analyzer mode
+// (capture.h), and comparison of a whole captured waveform against the
+// emulator in a single pass.
+
+#ifndef _PIT_CAPTURE_H
+#define _PIT_CAPTURE_H
+
+#include <string.h>
+#include <vector>
+
+#include "capture.h"
+#include "pit_emulator.h"
+
+struct OutputCapture {
+  unsigned long cycles;
+  u8 initial_state;
+  std::vector<u16> runs;
+};
+
+// Find and decode a capture transfer within 'data', which may be a raw serial
+// log with text before and after it. Returns false if no valid transfer is found.
+inline bool capture_decode(const u8 *data, size_t len, OutputCapture &capture) {
+
+  for(size_t start = 0; start + CAPTURE_HEADER_LEN + 1 <= len; start++) {
+    if(memcmp(data + start, CAPTURE_MAGIC, 4) != 0) {
+      continue;
+    }
+
+    const u8 *p = data + start + 4;
+    unsigned long cycles = (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+      ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+    u16 run_count = (u16)(p[4] | (p[5] << 8));
+    size_t total = CAPTURE_HEADER_LEN + run_count * 2 + 1;
+
+    if(run_count > CAPTURE_MAX_RUNS || start + total > len) {
+      continue;
+    }
+
+    u8 checksum = 0;
+    for(size_t i = 0; i < total - 5; i++) {
+      checksum += p[i];
+    }
+    if(checksum != p[total - 5]) {
+      continue;
+    }
+
+    capture.cycles = cycles;
+    capture.initial_state = p[6];
+    capture.runs.resize(run_count);
+    for(u16 i = 0; i < run_count; i++) {
+      capture.runs[i] = (u16)(p[7 + i * 2] | (p[8 + i * 2] << 8));
+    }
+    return true;
+  }
+  return false;
+}
+
+// Clock 'emu' through the captured cycles, comparing the outputs selected by
+// 'mask' after every clock. Channels the emulator reports as undefined are
+// ignored. Returns -1 if the waveforms match, otherwise the cycle of the first
+// mismatch (0 being the state before the first clock), with the two states in
+// 'emu_state' and 'pit_state'.
+inline long capture_compare(Pit &emu, const OutputCapture &capture, u8 mask, u8 &emu_state, u8 &pit_state) {
+
+  unsigned long cycle = 0;
+
+  emu_state = emu.getOutputs();
+  pit_state = capture.initial_state;
+  if((emu_state ^ pit_state) & mask & ~emu.getUndefinedMask()) {
+    return 0;
+  }
+
+  for(u16 run : capture.runs) {
+    u8 state = (u8)(run >> 13);
+    unsigned long len = (unsigned long)(run & (CAPTURE_MAX_RUN_LEN - 1)) + 1;
+
+    for(unsigned long i = 0; i < len; i++) {
+      emu.tick();
+      cycle++;
+      emu_state = emu.getOutputs();
+      if((emu_state ^ state) & mask & ~emu.getUndefinedMask()) {
+        pit_state = state;
+        return (long)cycle;
+      }
+    }
+  }
+  return -1;
+}
+
+#endif // _PIT_CAPTURE_H
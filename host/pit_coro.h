@@ -0,0 +1,451 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Coroutine-based orchestration of host-driven tests (C++20).
+//
+// A test is a coroutine returning PitTask. It drives one or more PitLanes, each
+// an independent PIT on a backend, and co_awaits every bus op:
+//
+//   PitTask test_mode0(PitLane lane) {
+//     co_await lane.command(0xB0);
+//     co_await lane.write(2, 0x80);
+//     PitOpResult r = co_await lane.tick(1);
+//     co_return r.outputs == 0;
+//   }
+//
+// Awaiting an op suspends the test. When every running test is waiting,
+// PitScheduler sends all pending ops to the backend as one batch, then resumes
+// each test with its result. A backend attached over a serial link then pays
+// one round trip per batch instead of one per op, and many tests keep it busy.
+
+#ifndef _PIT_CORO_H
+#define _PIT_CORO_H
+
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include "pit_cache.h"
+#include "pit_oracle.h"
+
+struct LaneOp {
+  unsigned lane;
+  PitOp op;
+  PitOpResult result;
+};
+
+// Executes batches of ops on independent PITs ("lanes"). Ops for the same lane
+// are executed in batch order.
+class PitBatchBackend {
+  public:
+    virtual ~PitBatchBackend() {}
+
+    // Add a PIT in its reset state, returning its lane number.
+    virtual unsigned addLane() = 0;
+
+    // Execute every op in 'batch', filling in its result. Returns false if the
+    // backend failed; the results are then undefined.
+    virtual bool submit(std::vector<LaneOp> &batch) = 0;
+};
+
+// One emulator per lane.
+class EmuBatchBackend : public PitBatchBackend {
+
+  private:
+    PitType type;
+    bool stand_in;
+    std::vector<Pit> lanes;
+
+  public:
+    EmuBatchBackend(PitType type, bool stand_in = false) : type(type), stand_in(stand_in) {}
+
+    unsigned addLane() override {
+      lanes.push_back(Pit(type));
+      return (unsigned)lanes.size() - 1;
+    }
+
+    bool submit(std::vector<LaneOp> &batch) override {
+      for(LaneOp &entry : batch) {
+        apply_op(lanes[entry.lane], entry.op, entry.result);
+        if(stand_in) {
+          entry.result.undefined = 0;
+        }
+      }
+      return true;
+    }
+};
+
+// Puts a result cache (pit_cache.h) in front of another backend, the device,
+// which is usually slow hardware. Each lane keeps its ops in canonical form and
+// follows the stored sequences one op at a time, for as long as one matches. At
+// its first op the cache has not seen, the lane moves to a fresh lane of the
+// device, replaying its ops once in the same batch, and stays there. flush()
+// records what the device returned, a lane's whole sequence at once. Ticks the
+// canonical form merges are also recorded as they were run, ending a sequence,
+// as the next run will look them up one at a time too.
+//
+// As in CachedOracle, channels no command has programmed yet are marked
+// undefined, whichever side answered.
+class CachedBatchBackend : public PitBatchBackend {
+
+  private:
+    static const size_t kNoSlot = (size_t)-1;
+
+    // A tick the device ran that a later tick was merged into.
+    struct PartialTick {
+      size_t index;
+      PitOp op;
+      PitOpResult result;
+    };
+
+    struct Lane {
+      OpSequence ops;         // Canonical ops so far
+      OpResults results;      // Result after each canonical op
+      std::vector<PartialTick> partials;
+      bool gates[3] = { false, false, false };
+      u8 programmed = 0;
+      size_t entry = PitResultCache::kNoEntry;
+      bool on_device = false;
+      unsigned device_lane = 0;
+    };
+
+    PitResultCache &cache;
+    PitBatchBackend &device;
+    std::vector<Lane> lanes;
+
+    std::vector<LaneOp> device_batch;
+    std::vector<size_t> device_slots;   // Per batch entry, its op in device_batch or kNoSlot
+
+    // Answer an op from the cache, extending the lane's canonical ops. On a miss the
+    // lane is left as it was.
+    bool fromCache(Lane &lane, const PitOp &op, PitOpResult &result) {
+      bool gates[3] = { lane.gates[0], lane.gates[1], lane.gates[2] };
+      PitOp last = lane.ops.empty() ? PitOp() : lane.ops.back();
+
+      switch(canonical_append(lane.ops, lane.gates, op)) {
+        case kCanonicalDropped:
+          if(lane.results.empty()) {
+            return false;
+          }
+          result = lane.results.back();
+          return true;
+        case kCanonicalMerged:
+          if(cache.lookupNext(lane.ops, lane.entry, result)) {
+            lane.results.back() = result;
+            return true;
+          }
+          lane.ops.back() = last;
+          break;
+        case kCanonicalAppended:
+          if(cache.lookupNext(lane.ops, lane.entry, result)) {
+            lane.results.push_back(result);
+            return true;
+          }
+          lane.ops.pop_back();
+          break;
+      }
+      std::copy(gates, gates + 3, lane.gates);
+      return false;
+    }
+
+    // Record the device's result for an op, extending the lane's canonical ops.
+    static void fromDevice(Lane &lane, const PitOp &op, const PitOpResult &result) {
+      PitOp last = lane.ops.empty() ? PitOp() : lane.ops.back();
+
+      switch(canonical_append(lane.ops, lane.gates, op)) {
+        case kCanonicalMerged:
+          lane.partials.push_back({ lane.ops.size() - 1, last, lane.results.back() });
+          lane.results.back() = result;
+          break;
+        case kCanonicalAppended:
+          lane.results.push_back(result);
+          break;
+        default:
+          break;
+      }
+    }
+
+  public:
+    CachedBatchBackend(PitResultCache &cache, PitBatchBackend &device) : cache(cache), device(device) {}
+
+    ~CachedBatchBackend() {
+      flush();
+    }
+
+    unsigned addLane() override {
+      lanes.push_back(Lane());
+      return (unsigned)lanes.size() - 1;
+    }
+
+    bool submit(std::vector<LaneOp> &batch) override {
+      device_batch.clear();
+      device_slots.assign(batch.size(), kNoSlot);
+
+      for(size_t i = 0; i < batch.size(); i++) {
+        Lane &lane = lanes[batch[i].lane];
+        if(!lane.on_device && fromCache(lane, batch[i].op, batch[i].result)) {
+          continue;
+        }
+        if(!lane.on_device) {
+          // Bring a device lane up to where the cache left off.
+          lane.on_device = true;
+          lane.device_lane = device.addLane();
+          for(const PitOp &op : lane.ops) {
+            device_batch.push_back({ lane.device_lane, op, PitOpResult() });
+          }
+        }
+        device_slots[i] = device_batch.size();
+        device_batch.push_back({ lane.device_lane, batch[i].op, PitOpResult() });
+      }
+
+      if(!device_batch.empty() && !device.submit(device_batch)) {
+        return false;
+      }
+
+      for(size_t i = 0; i < batch.size(); i++) {
+        LaneOp &entry = batch[i];
+        Lane &lane = lanes[entry.lane];
+        if(device_slots[i] != kNoSlot) {
+          entry.result = device_batch[device_slots[i]].result;
+          fromDevice(lane, entry.op, entry.result);
+        }
+        if(entry.op.op != ReadChannel) {
+          entry.result.byte = 0;
+        }
+        lane.programmed = programmed_by(lane.programmed, entry.op);
+        entry.result.undefined |= ~lane.programmed & 0x07;
+      }
+      return true;
+    }
+
+    // Store every lane the device answered in the cache. Called on destruction.
+    void flush() {
+      for(Lane &lane : lanes) {
+        if(!lane.on_device) {
+          continue;
+        }
+        cache.insert(lane.ops, lane.results);
+        for(const PartialTick &partial : lane.partials) {
+          OpSequence ops(lane.ops.begin(), lane.ops.begin() + partial.index);
+          OpResults results(lane.results.begin(), lane.results.begin() + partial.index);
+          ops.push_back(partial.op);
+          results.push_back(partial.result);
+          cache.insert(ops, results);
+        }
+        lane.partials.clear();
+      }
+    }
+};
+
+class PitTask {
+
+  public:
+    struct promise_type {
+      bool passed = false;
+
+      PitTask get_return_object() {
+        return PitTask(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+
+      // Tests start when the scheduler runs them, and stay alive until the task is destroyed.
+      std::suspend_always initial_suspend() noexcept {
+        return {};
+      }
+
+      std::suspend_always final_suspend() noexcept {
+        return {};
+      }
+
+      void return_value(bool result) {
+        passed = result;
+      }
+
+      void unhandled_exception() {
+        std::terminate();
+      }
+    };
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+
+  public:
+    explicit PitTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    PitTask(PitTask &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+    PitTask(const PitTask &) = delete;
+    PitTask &operator=(const PitTask &) = delete;
+
+    ~PitTask() {
+      if(handle) {
+        handle.destroy();
+      }
+    }
+
+    std::coroutine_handle<> getHandle() const {
+      return handle;
+    }
+
+    bool isDone() const {
+      return handle.done();
+    }
+
+    bool getPassed() const {
+      return handle.done() && handle.promise().passed;
+    }
+};
+
+class PitScheduler {
+
+  private:
+    PitBatchBackend &backend;
+
+    std::vector<LaneOp> pending;
+    std::vector<std::coroutine_handle<>> waiting;
+
+    // The batch whose results are being handed out.
+    std::vector<LaneOp> completed;
+    std::vector<std::coroutine_handle<>> resuming;
+
+    bool failed = false;
+    unsigned long batches = 0;
+    unsigned long ops = 0;
+    size_t largest_batch = 0;
+
+  public:
+    class OpAwaiter {
+
+      private:
+        PitScheduler &scheduler;
+        unsigned lane;
+        PitOp op;
+        size_t slot = 0;
+
+      public:
+        OpAwaiter(PitScheduler &scheduler, unsigned lane, const PitOp &op) : scheduler(scheduler), lane(lane), op(op) {}
+
+        bool await_ready() const noexcept {
+          return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+          slot = scheduler.enqueue(lane, op, handle);
+        }
+
+        PitOpResult await_resume() const {
+          return scheduler.completed[slot].result;
+        }
+    };
+
+    PitScheduler(PitBatchBackend &backend) : backend(backend) {}
+
+    unsigned addLane() {
+      return backend.addLane();
+    }
+
+    size_t enqueue(unsigned lane, const PitOp &op, std::coroutine_handle<> handle) {
+      pending.push_back({ lane, op, PitOpResult() });
+      waiting.push_back(handle);
+      return pending.size() - 1;
+    }
+
+    // Run every task to completion. Returns false if the backend failed, in which
+    // case the tasks still waiting are left suspended.
+    bool run(std::vector<PitTask> &tasks) {
+      for(PitTask &task : tasks) {
+        task.getHandle().resume();
+      }
+
+      while(!pending.empty()) {
+        if(!backend.submit(pending)) {
+          failed = true;
+          return false;
+        }
+        batches++;
+        ops += pending.size();
+        largest_batch = std::max(largest_batch, pending.size());
+
+        // Resumed tasks queue their next ops into 'pending' for the next batch.
+        completed.swap(pending);
+        resuming.swap(waiting);
+        pending.clear();
+        waiting.clear();
+        for(std::coroutine_handle<> handle : resuming) {
+          handle.resume();
+        }
+      }
+      return true;
+    }
+
+    bool isFailed() const {
+      return failed;
+    }
+
+    unsigned long getBatches() const {
+      return batches;
+    }
+
+    unsigned long getOps() const {
+      return ops;
+    }
+
+    size_t getLargestBatch() const {
+      return largest_batch;
+    }
+};
+
+// A test's handle on one PIT. Each op is awaited and yields the PIT's result.
+class PitLane {
+
+  private:
+    PitScheduler *scheduler;
+    unsigned lane;
+
+  public:
+    PitLane(PitScheduler &scheduler) : scheduler(&scheduler), lane(scheduler.addLane()) {}
+
+    PitScheduler::OpAwaiter op(const PitOp &op) {
+      return PitScheduler::OpAwaiter(*scheduler, lane, op);
+    }
+
+    PitScheduler::OpAwaiter command(u8 byte) {
+      return op(make_op(WriteCommand, 0, byte));
+    }
+
+    PitScheduler::OpAwaiter write(u8 c, u8 byte) {
+      return op(make_op(WriteChannel, c, byte));
+    }
+
+    PitScheduler::OpAwaiter read(u8 c) {
+      return op(make_op(ReadChannel, c, 0));
+    }
+
+    PitScheduler::OpAwaiter tick(uint32_t ticks) {
+      return op(make_op(Tick, 0, ticks));
+    }
+
+    PitScheduler::OpAwaiter gate(u8 c, bool level) {
+      return op(make_op(FlipGate, c, level));
+    }
+};
+
+#endif // _PIT_CORO_H
@@ -0,0 +1,160 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Single-producer/single-consumer queue carrying output edges from the thread 
+// clocking the emulator to another thread, such as an audio callback.
+//
+// The producer side is TimerChannel's output handler. Pushing never blocks or 
+// locks: if the consumer falls behind and the queue is full, the edge is dropped 
+// and counted, so the emulation thread is never stalled by audio. Each side only 
+// writes its own index, so head and tail are kept on separate cache lines.
+//
+//   EdgeQueue<1024> queue;
+//   queue.attach(pit.channel[2]);          // emulation thread clocks the Pit
+//   queue.drainUntil(frame_end, render);   // audio thread, once per buffer
+
+#ifndef _PIT_EDGE_QUEUE_H
+#define _PIT_EDGE_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "pit_emulator.h"
+
+struct QueuedEdge {
+  uint64_t ticks;
+  uint8_t channel;
+  bool level;
+};
+
+// 'Capacity' must be a power of two. One slot is kept free to tell full from empty.
+template <size_t Capacity>
+class EdgeQueue {
+
+  static_assert((Capacity & (Capacity - 1)) == 0, "EdgeQueue capacity must be a power of two");
+
+  private:
+    static const size_t kMask = Capacity - 1;
+
+    QueuedEdge slots[Capacity];
+
+    // Written by the producer only.
+    alignas(64) std::atomic<size_t> head{0};
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> dropped{0};
+    size_t high_water = 0;
+
+    // Written by the consumer only.
+    alignas(64) std::atomic<size_t> tail{0};
+
+    static void onOutput(void *context, int channel, bool level, unsigned long long ticks) {
+      static_cast<EdgeQueue *>(context)->push((uint8_t)channel, level, ticks);
+    }
+
+  public:
+
+    // Feed the queue from a channel's output transitions.
+    void attach(TimerChannel &channel) {
+      channel.setOutputHandler(&onOutput, this);
+    }
+
+    void detach(TimerChannel &channel) {
+      channel.setOutputHandler(0, 0);
+    }
+
+    // Producer. Returns false if the queue was full and the edge was dropped.
+    bool push(uint8_t channel, bool level, uint64_t ticks) {
+      size_t h = head.load(std::memory_order_relaxed);
+      size_t used = h - tail.load(std::memory_order_acquire);
+
+      if (used >= Capacity - 1) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+
+      QueuedEdge &slot = slots[h & kMask];
+      slot.ticks = ticks;
+      slot.channel = channel;
+      slot.level = level;
+      head.store(h + 1, std::memory_order_release);
+
+      pushed.fetch_add(1, std::memory_order_relaxed);
+      if (used + 1 > high_water) {
+        high_water = used + 1;
+      }
+      return true;
+    }
+
+    // Consumer. Copy up to 'max' queued edges into 'out' and return the number copied.
+    size_t drain(QueuedEdge *out, size_t max) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t available = head.load(std::memory_order_acquire) - t;
+      size_t n = (available < max) ? available : max;
+
+      for(size_t i = 0; i < n; i++) {
+        out[i] = slots[(t + i) & kMask];
+      }
+      tail.store(t + n, std::memory_order_release);
+      return n;
+    }
+
+    // Consumer. Pass each queued edge at or before tick 'limit' to fn(const QueuedEdge &), 
+    // in order, and return the number consumed. Later edges are left queued for the next 
+    // buffer.
+    template <typename F>
+    size_t drainUntil(uint64_t limit, F fn) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t h = head.load(std::memory_order_acquire);
+      size_t n = 0;
+
+      while ((t + n) != h) {
+        const QueuedEdge &edge = slots[(t + n) & kMask];
+        if (edge.ticks > limit) {
+          break;
+        }
+        fn(edge);
+        n++;
+      }
+      tail.store(t + n, std::memory_order_release);
+      return n;
+    }
+
+    // Number of edges waiting. Exact only from the consumer thread.
+    size_t size() {
+      return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Back-pressure accounting. getPushed() and getDropped() may be read from any thread;
+    // getHighWater() is the deepest the queue has been, read from the producer thread.
+    uint64_t getPushed() {
+      return pushed.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getDropped() {
+      return dropped.load(std::memory_order_relaxed);
+    }
+
+    size_t getHighWater() {
+      return high_water;
+    }
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Differential fuzzing of two emulator models over a tree of mutations.
+//
+//   pit_explore [options] [prefix-script]
+//     --emu <type>     emulator model under test (default 8253)
+//     --ref <type>     model to compare against, run as a stand-in (default 8254)
+//     --depth <n>      ops to explore past the prefix (default 6)
+//     --fanout <n>     random ops tried at each node (default 4)
+//     --seed <n>       random seed (default 1)
+//     --max <n>        stop after this many divergent paths (default 1)
+//
+// The prefix defaults to test_fuzzer()'s setup on channel 2. Each divergent 
+// path is written to stdout as an op script that pit_minimize accepts. The 
+// prefix is run once; every node below it costs a single op on a forked Pit,
+// and the reference model shares prefixes with its previous run.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_explore.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o pit_explore
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pit_explore.h"
+
+static PitType parse_type(const char *s) {
+  return strcmp(s, "8254") == 0 ? kModel8254 : kModel8253;
+}
+
+int main(int argc, char **argv) {
+  const char *prefix_path = NULL;
+  PitType emu_type = kModel8253;
+  PitType ref_type = kModel8254;
+  unsigned depth = 6;
+  unsigned fanout = 4;
+  uint32_t seed = 1;
+  unsigned long max_divergent = 1;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--emu") == 0 && i + 1 < argc) {
+      emu_type = parse_type(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--ref") == 0 && i + 1 < argc) {
+      ref_type = parse_type(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      depth = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--fanout") == 0 && i + 1 < argc) {
+      fanout = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--max") == 0 && i + 1 < argc) {
+      max_divergent = strtoul(argv[++i], NULL, 0);
+    }
+    else if(argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [--emu 8253|8254] [--ref 8253|8254] [--depth n] [--fanout n] [--seed n] "
+        "[--max n] [prefix-script]\n", argv[0]);
+      return 2;
+    }
+    else {
+      prefix_path = argv[i];
+    }
+  }
+
+  OpSequence prefix = fuzz_sequence(0, 0, FUZZ_CHAN);
+  if(prefix_path) {
+    FILE *in = fopen(prefix_path, "r");
+    if(!in) {
+      perror(prefix_path);
+      return 1;
+    }
+    bool ok = read_ops(in, prefix);
+    fclose(in);
+    if(!ok) {
+      return 1;
+    }
+  }
+
+  PitExplorer emu(emu_type);
+  PitExplorer ref(ref_type, true);
+  OpResults ref_results;
+  unsigned long nodes = 0;
+  unsigned long divergent = 0;
+
+  emu.explore(prefix, depth, fanout, seed, FUZZ_CHAN, [&](const OpSequence &path, const OpResults &results) {
+    nodes++;
+    if(divergent >= max_divergent) {
+      return false;
+    }
+
+    ref.run(path, ref_results);
+    for(size_t i = 0; i < path.size(); i++) {
+      if(!results_match(results[i], ref_results[i], path[i])) {
+        divergent++;
+        printf("# divergence %lu at op %lu\n", divergent, (unsigned long)i);
+        write_ops(stdout, path);
+        // Everything below this node diverges too.
+        return false;
+      }
+    }
+    return true;
+  });
+
+  fprintf(stderr, "%lu nodes, %lu divergent\n", nodes, divergent);
+  fprintf(stderr, "emu: %llu ops run for %llu requested; ref: %llu ops run for %llu requested\n",
+    emu.getOpsRun(), emu.getOpsRequested(), ref.getOpsRun(), ref.getOpsRequested());
+  return divergent ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Emulator oracle that executes shared prefixes once.
+//
+// As an oracle, it keeps checkpoints of the Pit along the last sequence run. 
+// A new sequence resumes from the checkpoint nearest to where it departs from
+// the last one, instead of from reset. Callers that run many sequences with a
+// common setup, or that walk candidates in order (as the minimizer does), only
+// pay for the ops after the shared prefix.
+//
+// explore() walks a tree of random mutations below a prefix, forking the Pit at
+// every node, so each path costs one op over its parent rather than a replay
+// of the whole path.
+
+#ifndef _PIT_EXPLORE_H
+#define _PIT_EXPLORE_H
+
+#include <random>
+#include <vector>
+
+#include "pit_oracle.h"
+
+// Ops between checkpoints. Resuming replays at most this many ops.
+#define EXPLORE_CHECKPOINT_INTERVAL 4
+
+class PitExplorer : public PitOracle {
+
+  private:
+    PitType type;
+    bool stand_in;
+
+    // checkpoints[i] is the state after the first i * EXPLORE_CHECKPOINT_INTERVAL ops of last_ops.
+    std::vector<Pit> checkpoints;
+    OpSequence last_ops;
+    OpResults last_results;
+
+    unsigned long long ops_requested = 0;
+    unsigned long long ops_run = 0;
+
+    void apply(Pit &pit, const PitOp &op, PitOpResult &result) {
+      apply_op(pit, op, result);
+      if(stand_in) {
+        result.undefined = 0;
+      }
+      ops_run++;
+    }
+
+    template <typename F>
+    void exploreNode(Pit &pit, OpSequence &path, OpResults &results, unsigned depth, unsigned fanout, 
+                     std::mt19937 &rng, u8 chan, F &visitor) {
+      if(depth == 0) {
+        return;
+      }
+
+      for(unsigned i = 0; i < fanout; i++) {
+        Pit child = pit.fork();
+        bool gate = child.channel[chan].getGate();
+        PitOp op = fuzz_op(rng, chan, gate);
+        PitOpResult result;
+
+        apply(child, op, result);
+        ops_requested += path.size() + 1;
+
+        path.push_back(op);
+        results.push_back(result);
+        if(visitor(path, results)) {
+          exploreNode(child, path, results, depth - 1, fanout, rng, chan, visitor);
+        }
+        path.pop_back();
+        results.pop_back();
+      }
+    }
+
+  public:
+    PitExplorer(PitType type, bool stand_in = false) : type(type), stand_in(stand_in) {
+      checkpoints.push_back(Pit(type));
+    }
+
+    bool run(const OpSequence &ops, OpResults &results) override {
+      size_t shared = 0;
+      while(shared < ops.size() && shared < last_ops.size() && ops[shared] == last_ops[shared]) {
+        shared++;
+      }
+
+      // Drop checkpoints past the shared prefix and resume from the last one left.
+      size_t keep = shared / EXPLORE_CHECKPOINT_INTERVAL + 1;
+      checkpoints.erase(checkpoints.begin() + keep, checkpoints.end());
+      last_ops.resize(shared);
+      last_results.resize(shared);
+
+      size_t i = (keep - 1) * EXPLORE_CHECKPOINT_INTERVAL;
+      Pit pit = checkpoints.back();
+      PitOpResult result;
+
+      for(; i < shared; i++) {
+        apply(pit, ops[i], result);
+      }
+      for(; i < ops.size(); i++) {
+        apply(pit, ops[i], result);
+        last_ops.push_back(ops[i]);
+        last_results.push_back(result);
+        if((i + 1) % EXPLORE_CHECKPOINT_INTERVAL == 0) {
+          checkpoints.push_back(pit);
+        }
+      }
+
+      ops_requested += ops.size();
+      results = last_results;
+      return true;
+    }
+
+    // Run 'prefix', then explore random ops on 'chan' below it: 'fanout' children per node,
+    // to 'depth' ops past the prefix. visitor(path, results) is called for each node; 
+    // returning false skips the node's subtree. The walk is depth-first, so consecutive 
+    // paths share all but their last few ops.
+    template <typename F>
+    void explore(const OpSequence &prefix, unsigned depth, unsigned fanout, uint32_t seed, u8 chan, F visitor) {
+      std::mt19937 rng(seed);
+      OpSequence path = prefix;
+      OpResults results;
+
+      run(prefix, results);
+      // The Pit after the prefix, from the checkpoints run() just made.
+      Pit pit = checkpoints.back();
+      for(size_t i = (checkpoints.size() - 1) * EXPLORE_CHECKPOINT_INTERVAL; i < prefix.size(); i++) {
+        PitOpResult result;
+        apply(pit, prefix[i], result);
+      }
+      exploreNode(pit, path, results, depth, fanout, rng, chan, visitor);
+    }
+
+    // Ops that callers asked for, counting each path in full, and ops actually executed.
+    unsigned long long getOpsRequested() {
+      return ops_requested;
+    }
+
+    unsigned long long getOpsRun() {
+      return ops_run;
+    }
+};
+
+#endif
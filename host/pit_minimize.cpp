@@ -0,0 +1,332 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Shrink a sequence on which the emulator and an oracle disagree to a minimal
+// reproducer, using ddmin over ops followed by a binary search over each tick
+// count, repeated until neither pass makes progress.
+//
+//   pit_minimize [options] <script-or-fuzzer-log>
+//     --cache <file>     persistent result cache to read and extend
+//     --port <dev>       query a validator board running serial_server() (see pit_serial.h)
+//     --stand-in <type>  without a board, use the emulator as a stand-in oracle of type 8253 or 8254
+//                        (default: the --emu model)
+//     --emu <type>       emulator model under test (default 8253)
+//
+// With a board, the minimizer reproduces divergences between the emulator and
+// the real chip, e.g. from a test_fuzzer() log; the cache must hold results for
+// the board's chip. A stand-in of another model minimizes differences between
+// the two emulator models instead.
+//
+// The input may be an op script (see pit_ops.h) or the serial log of a
+// test_fuzzer() run, in which case ops up to the reported divergence are used.
+// The minimal reproducer is written to stdout as an op script.
+//
+// Every candidate's verdict is memoized by its canonical form, and oracle
+// results go through the result cache, so no sub-sequence is run twice and a
+// candidate that is a prefix of something already run costs nothing.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_minimize.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o pit_minimize
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#include "pit_cache.h"
+#include "pit_explore.h"
+#include "pit_serial.h"
+
+// Attempts at a sequence before a board is given up on.
+#define BOARD_ATTEMPTS 3
+
+// A board behind the minimizer. A sequence that the board fails to answer is
+// retried after a reset; as a missing verdict would steer the search wrong, a
+// board that keeps failing ends the run.
+class BoardOracle : public PitOracle {
+
+  private:
+    PitSerialBoard &board;
+
+  public:
+    BoardOracle(PitSerialBoard &board) : board(board) {}
+
+    bool run(const OpSequence &ops, OpResults &results) override {
+      for(int attempt = 0; attempt < BOARD_ATTEMPTS; attempt++) {
+        if(board.run(ops, results)) {
+          return true;
+        }
+        fprintf(stderr, "%s: no reply, resetting\n", board.getPath().c_str());
+        board.reset();
+      }
+      fprintf(stderr, "%s: board stopped answering\n", board.getPath().c_str());
+      exit(1);
+    }
+};
+
+class Minimizer {
+
+  private:
+    PitOracle &emu;
+    PitOracle &oracle;
+    std::unordered_map<std::string, bool> verdicts;
+
+    unsigned long tests = 0;
+    unsigned long memo_hits = 0;
+
+    static std::string key(const OpSequence &ops) {
+      std::string k;
+      char buf[32];
+      for(const PitOp &op : ops) {
+        format_op(op, buf, sizeof buf);
+        k += buf;
+        k += '\n';
+      }
+      return k;
+    }
+
+  public:
+    Minimizer(PitOracle &emu, PitOracle &oracle) : emu(emu), oracle(oracle) {}
+
+    // Return the index of the first op whose results differ, or -1.
+    long divergence(const OpSequence &ops) {
+      OpResults emu_results;
+      OpResults oracle_results;
+
+      if(!emu.run(ops, emu_results) || !oracle.run(ops, oracle_results)) {
+        return -1;
+      }
+      for(size_t i = 0; i < ops.size(); i++) {
+        if(!results_match(emu_results[i], oracle_results[i], ops[i])) {
+          return (long)i;
+        }
+      }
+      return -1;
+    }
+
+    bool fails(const OpSequence &candidate) {
+      OpSequence ops = canonicalize(candidate);
+      std::string k = key(ops);
+
+      auto it = verdicts.find(k);
+      if(it != verdicts.end()) {
+        memo_hits++;
+        return it->second;
+      }
+
+      tests++;
+      bool result = divergence(ops) >= 0;
+      verdicts[k] = result;
+      return result;
+    }
+
+    // Classic ddmin: try each chunk, then each complement, refining the
+    // granularity when neither reproduces the failure.
+    OpSequence ddmin(OpSequence ops) {
+      size_t n = 2;
+
+      while(ops.size() >= 2) {
+        size_t chunk = (ops.size() + n - 1) / n;
+        bool reduced = false;
+
+        for(size_t start = 0; start < ops.size() && !reduced; start += chunk) {
+          size_t end = std::min(start + chunk, ops.size());
+          OpSequence subset(ops.begin() + start, ops.begin() + end);
+          if(fails(subset)) {
+            ops = subset;
+            n = 2;
+            reduced = true;
+          }
+        }
+
+        for(size_t start = 0; start < ops.size() && !reduced && n > 2; start += chunk) {
+          size_t end = std::min(start + chunk, ops.size());
+          OpSequence complement(ops.begin(), ops.begin() + start);
+          complement.insert(complement.end(), ops.begin() + end, ops.end());
+          if(fails(complement)) {
+            ops = complement;
+            n = std::max(n - 1, (size_t)2);
+            reduced = true;
+          }
+        }
+
+        if(!reduced) {
+          if(n >= ops.size()) {
+            break;
+          }
+          n = std::min(n * 2, ops.size());
+        }
+      }
+      return ops;
+    }
+
+    // Binary search each tick count down to the smallest value that still
+    // fails. Only values that were seen to fail are ever kept.
+    bool shrinkTicks(OpSequence &ops) {
+      bool changed = false;
+
+      for(size_t i = 0; i < ops.size(); i++) {
+        if(ops[i].op != Tick) {
+          continue;
+        }
+        uint32_t lo = 0;
+        uint32_t hi = ops[i].arg;
+        OpSequence trial = ops;
+
+        while(lo < hi) {
+          uint32_t mid = lo + (hi - lo) / 2;
+          trial[i].arg = mid;
+          if(fails(trial)) {
+            hi = mid;
+          }
+          else {
+            lo = mid + 1;
+          }
+        }
+        if(hi != ops[i].arg) {
+          ops[i].arg = hi;
+          changed = true;
+        }
+      }
+      ops = canonicalize(ops);
+      return changed;
+    }
+
+    OpSequence minimize(const OpSequence &input) {
+      OpSequence ops = canonicalize(input);
+
+      // Nothing after the first divergence matters.
+      long first = divergence(ops);
+      if(first < 0) {
+        return ops;
+      }
+      ops.resize(first + 1);
+
+      for(;;) {
+        size_t before = ops.size();
+        ops = canonicalize(ddmin(ops));
+        bool ticks_changed = shrinkTicks(ops);
+        if(ops.size() == before && !ticks_changed) {
+          break;
+        }
+      }
+      return ops;
+    }
+
+    unsigned long getTests() const {
+      return tests;
+    }
+
+    unsigned long getMemoHits() const {
+      return memo_hits;
+    }
+};
+
+static PitType parse_type(const char *s) {
+  return strcmp(s, "8254") == 0 ? kModel8254 : kModel8253;
+}
+
+int main(int argc, char **argv) {
+  const char *cache_path = NULL;
+  const char *input_path = NULL;
+  const char *port = NULL;
+  PitType stand_in_type = kModel8253;
+  bool stand_in_set = false;
+  PitType emu_type = kModel8253;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+      cache_path = argv[++i];
+    }
+    else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+      port = argv[++i];
+    }
+    else if(strcmp(argv[i], "--stand-in") == 0 && i + 1 < argc) {
+      stand_in_type = parse_type(argv[++i]);
+      stand_in_set = true;
+    }
+    else if(strcmp(argv[i], "--emu") == 0 && i + 1 < argc) {
+      emu_type = parse_type(argv[++i]);
+    }
+    else {
+      input_path = argv[i];
+    }
+  }
+
+  if(!input_path) {
+    fprintf(stderr, "usage: %s [--cache file] [--port dev] [--stand-in 8253|8254] [--emu 8253|8254] <input>\n",
+      argv[0]);
+    return 2;
+  }
+
+  FILE *in = fopen(input_path, "r");
+  if(!in) {
+    perror(input_path);
+    return 1;
+  }
+  OpSequence ops;
+  bool ok = read_ops(in, ops);
+  fclose(in);
+  if(!ok) {
+    return 1;
+  }
+
+  if(!stand_in_set) {
+    stand_in_type = emu_type;
+  }
+
+  PitSerialBoard board(port ? port : "");
+  PitType oracle_type = stand_in_type;
+  if(port) {
+    if(!board.open()) {
+      fprintf(stderr, "%s: no board\n", port);
+      return 1;
+    }
+    oracle_type = board.getModel();
+    fprintf(stderr, "%s: %s board\n", port, PitResultCache::model_name(oracle_type));
+  }
+
+  PitResultCache cache;
+  if(cache_path && !cache.open(cache_path, oracle_type)) {
+    return 1;
+  }
+
+  // Candidates tend to share long prefixes with the one before them.
+  PitExplorer emu(emu_type);
+  PitExplorer stand_in(stand_in_type, true);
+  BoardOracle board_oracle(board);
+  CachedOracle oracle(cache, port ? (PitOracle &)board_oracle : (PitOracle &)stand_in);
+  Minimizer minimizer(emu, oracle);
+
+  if(minimizer.divergence(canonicalize(ops)) < 0) {
+    fprintf(stderr, "input does not diverge; nothing to minimize\n");
+    return 1;
+  }
+
+  OpSequence minimal = minimizer.minimize(ops);
+
+  printf("# minimized %lu ops to %lu\n", (unsigned long)ops.size(), (unsigned long)minimal.size());
+  printf("# %lu candidates tested, %lu memo hits, %lu oracle runs, %lu cache hits\n",
+    minimizer.getTests(), minimizer.getMemoHits(), oracle.getBackendRuns(), cache.getHits());
+  write_ops(stdout, minimal);
+  return 0;
+}
@@ -0,0 +1,503 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Explicit-state model checker over the TimerChannel state machine.
+//
+//   pit_model_check [options]
+//     --threads <n>     worker threads (default: all cores)
+//     --max-states <n>  size of the visited set (default 1M, rounded up to a power of two)
+//     --depth <n>       maximum ops from reset (default 12; 0 runs until no new states)
+//     --graph <file>    write the transition graph in Graphviz format
+//     --graph-depth <n> only draw states up to this many ops from reset (default 4)
+//     --max <n>         reproducers to print per kind of finding (default 10)
+//
+// A state is an 8253 and an 8254 emulator driven by the same ops on channel 2.
+// Each is abstracted to its channel's control state (timer, load and read
+// states, mode, access mode, gate, armed, output and so on) with every count
+// folded into one of the classes 0, 1, 2, 3, max, odd or even. From each
+// abstract state a breadth-first search applies every control word, a set of
+// data bytes, a read, a gate edge, one tick, and ticks up to and just before
+// the next event.
+//
+// It reports two kinds of findings, each as an op script from reset that
+// pit_minimize and the cache tools accept:
+//   engine   run() and single-stepping tick() leave a channel in different states
+//   model    the 8253 and 8254 give different reads or outputs; the search stops there
+//
+// The same fault is usually reached through many concrete ops (every control word,
+// every data byte), so findings are counted once per abstract source state and op
+// kind, and one reproducer is kept for each. Ops from one state that lead to the
+// same state are likewise drawn as a single graph edge, labelled with the first op
+// and the number of others. Even so there are about 40 edges per state, so only
+// the first few levels are drawn: depth 4 is some 9K states and 190K lines.
+//
+// The abstraction keeps the search finite in principle, but the frontier still
+// grows by about a third per level at depth 12 and the default run stops there, in
+// a few seconds and 500K states. Deeper runs take minutes and need --max-states.
+//
+// Visited states are kept as 64-bit hashes in a lock-free open-addressed set
+// shared by all threads, which expand each BFS level in parallel.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_model_check.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o pit_model_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "pit_oracle.h"
+
+#define CHECK_CHAN 2
+
+// Ticks above this are too slow to single-step for the engine comparison.
+#define ENGINE_CHECK_MAX_TICKS 4096
+
+// Lock-free set of non-zero 64-bit hashes.
+class ConcurrentHashSet {
+
+  private:
+    std::vector<std::atomic<uint64_t>> slots;
+    size_t mask;
+    std::atomic<size_t> count{0};
+
+  public:
+    ConcurrentHashSet(size_t capacity) : slots(capacity), mask(capacity - 1) {
+      for(auto &slot : slots) {
+        slot.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    // Returns true if 'hash' was not already present. Sets 'full' if there was no room.
+    bool insert(uint64_t hash, bool &full) {
+      if(hash == 0) {
+        hash = 1;
+      }
+      if(count.load(std::memory_order_relaxed) >= mask) {
+        full = true;
+        return false;
+      }
+
+      for(size_t i = hash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+        uint64_t current = slots[i].load(std::memory_order_relaxed);
+        if(current == hash) {
+          return false;
+        }
+        if(current == 0) {
+          uint64_t expected = 0;
+          if(slots[i].compare_exchange_strong(expected, hash, std::memory_order_relaxed)) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+          }
+          if(expected == hash) {
+            return false;
+          }
+        }
+      }
+      full = true;
+      return false;
+    }
+
+    size_t size() {
+      return count.load(std::memory_order_relaxed);
+    }
+};
+
+struct ModelState {
+  Pit pit[2];       // 8253, 8254
+  uint64_t hash;
+  unsigned depth;
+};
+
+struct Transition {
+  uint64_t from;
+  uint64_t to;
+  PitOp op;
+  unsigned others;  // Further ops from 'from' to 'to', for the graph
+};
+
+struct Finding {
+  uint64_t from;
+  PitOp op;
+  const char *what;
+};
+
+enum CountClass {
+  kCount0,
+  kCount1,
+  kCount2,
+  kCount3,
+  kCountMax,
+  kCountOdd,
+  kCountEven
+};
+
+static const char *count_class_names[] = { "0", "1", "2", "3", "max", "odd", "even" };
+
+static CountClass count_class(u16 value, bool bcd) {
+  if(value <= 3) {
+    return (CountClass)value;
+  }
+  if(value == (bcd ? 0x9999 : 0xFFFF)) {
+    return kCountMax;
+  }
+  return (value & 1) ? kCountOdd : kCountEven;
+}
+
+// The abstraction of one channel, packed into bytes for hashing and labels.
+static void abstract_channel(TimerChannel &ch, u8 *out) {
+  TimerChannelState s;
+  ch.getState(s);
+
+  out[0] = (u8)s.mode;
+  out[1] = (u8)s.access_mode;
+  out[2] = (u8)s.timer_state;
+  out[3] = (u8)s.load_state;
+  out[4] = (u8)s.load_type;
+  out[5] = (u8)s.read_state;
+  out[6] = (u8)count_class(s.counting_element, s.bcd_mode);
+  out[7] = (u8)count_class(s.count_register, s.bcd_mode);
+  out[8] = (u8)count_class(s.count_latch, s.bcd_mode);
+  out[9] = (u8)((s.gate << 0) | (s.armed << 1) | (s.output << 2) | (s.output_on_reload << 3) |
+                (s.reload_on_trigger << 4) | (s.bcd_mode << 5) | (s.ce_undefined << 6) | (s.count_is_latched << 7));
+  out[10] = (u8)((s.cycles_in_state == 0) | ((s.load_mask == 0xFFFF) << 1));
+}
+
+#define ABSTRACT_BYTES 11
+
+static uint64_t abstract_hash(ModelState &state) {
+  u8 bytes[2 * ABSTRACT_BYTES];
+  abstract_channel(state.pit[0].channel[CHECK_CHAN], bytes);
+  abstract_channel(state.pit[1].channel[CHECK_CHAN], bytes + ABSTRACT_BYTES);
+
+  uint64_t hash = OPS_HASH_INIT;
+  for(size_t i = 0; i < sizeof bytes; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+// Findings are distinct by abstract source state, kind of finding and kind of op.
+static uint64_t finding_key(const Finding &f) {
+  uint64_t hash = f.from;
+  for(const char *p = f.what; *p; p++) {
+    hash ^= (u8)*p;
+    hash *= 0x100000001B3ULL;
+  }
+  hash ^= f.op.op;
+  hash *= 0x100000001B3ULL;
+  return hash;
+}
+
+static void abstract_label(ModelState &state, char *buf, size_t len) {
+  size_t n = 0;
+  for(int m = 0; m < 2; m++) {
+    u8 a[ABSTRACT_BYTES];
+    abstract_channel(state.pit[m].channel[CHECK_CHAN], a);
+    n += snprintf(buf + n, len - n, "%s m%u a%u ts%u ls%u rs%u ce:%s cr:%s cl:%s f:%02X%s",
+      m ? "8254" : "8253", a[0], a[1], a[2], a[3], a[5], count_class_names[a[6]], count_class_names[a[7]],
+      count_class_names[a[8]], a[9], m ? "" : "\\n");
+    if(n >= len) {
+      break;
+    }
+  }
+}
+
+// The ops tried from every state.
+static void successor_ops(ModelState &state, std::vector<PitOp> &ops) {
+  static const u8 data_bytes[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x10, 0x99, 0xFE, 0xFF };
+
+  ops.clear();
+
+  // Every control word for the channel. All latch commands are equivalent.
+  ops.push_back(make_op(WriteCommand, 0, CHECK_CHAN << 6));
+  for(u8 b = 0x10; b < 0x40; b++) {
+    ops.push_back(make_op(WriteCommand, 0, (CHECK_CHAN << 6) | b));
+  }
+  for(u8 b : data_bytes) {
+    ops.push_back(make_op(WriteChannel, CHECK_CHAN, b));
+  }
+  ops.push_back(make_op(ReadChannel, CHECK_CHAN, 0));
+  ops.push_back(make_op(FlipGate, CHECK_CHAN, !state.pit[0].channel[CHECK_CHAN].getGate()));
+  ops.push_back(make_op(Tick, 0, 1));
+
+  // Ticks to just before and onto each model's next event, which move counts between classes.
+  for(int m = 0; m < 2; m++) {
+    unsigned long next = state.pit[m].channel[CHECK_CHAN].ticksUntilEvent();
+    if(next > 1) {
+      ops.push_back(make_op(Tick, 0, next - 1));
+      ops.push_back(make_op(Tick, 0, next));
+    }
+  }
+}
+
+// Whether batched run() and tick() agree on 'op' from 'pit'.
+static bool engines_agree(const Pit &pit, const PitOp &op) {
+  Pit batched = pit;
+  Pit stepped = pit;
+  PitOpResult result;
+
+  apply_op(batched, op, result);
+  for(uint32_t i = 0; i < op.arg; i++) {
+    stepped.tick();
+  }
+
+  TimerChannelState a;
+  TimerChannelState b;
+  memset(&a, 0, sizeof a);
+  memset(&b, 0, sizeof b);
+  batched.channel[CHECK_CHAN].getState(a);
+  stepped.channel[CHECK_CHAN].getState(b);
+  return memcmp(&a, &b, sizeof a) == 0;
+}
+
+struct Worker {
+  std::vector<ModelState> next;
+  std::vector<Transition> transitions;
+  std::vector<Transition> parents;
+  std::vector<Finding> findings;
+  unsigned long edges = 0;
+  bool full = false;
+};
+
+static void expand(std::vector<ModelState> &frontier, size_t begin, size_t end, ConcurrentHashSet &visited,
+  Worker &worker, bool keep_graph) {
+
+  std::vector<PitOp> ops;
+
+  for(size_t i = begin; i < end; i++) {
+    ModelState &state = frontier[i];
+    successor_ops(state, ops);
+    size_t first_edge = worker.transitions.size();
+
+    for(const PitOp &op : ops) {
+      ModelState child = state;
+      PitOpResult results[2];
+      child.depth = state.depth + 1;
+
+      for(int m = 0; m < 2; m++) {
+        if(op.op == Tick && op.arg <= ENGINE_CHECK_MAX_TICKS && !engines_agree(state.pit[m], op)) {
+          worker.findings.push_back({ state.hash, op, m ? "engine 8254" : "engine 8253" });
+        }
+        apply_op(child.pit[m], op, results[m]);
+      }
+
+      if(!results_match(results[0], results[1], op)) {
+        worker.findings.push_back({ state.hash, op, "model" });
+        continue;
+      }
+
+      child.hash = abstract_hash(child);
+      worker.edges++;
+      if(keep_graph) {
+        // Fold ops that lead to a state already reached from this one into its edge.
+        bool folded = false;
+        for(size_t e = first_edge; e < worker.transitions.size(); e++) {
+          if(worker.transitions[e].to == child.hash) {
+            worker.transitions[e].others++;
+            folded = true;
+            break;
+          }
+        }
+        if(!folded) {
+          worker.transitions.push_back({ state.hash, child.hash, op, 0 });
+        }
+      }
+      if(visited.insert(child.hash, worker.full)) {
+        worker.next.push_back(child);
+        // Record how the state was first reached, for reproducers.
+        worker.parents.push_back({ state.hash, child.hash, op, 0 });
+      }
+    }
+  }
+}
+
+// Rebuild the ops from reset to a state, from the first transition that reached each state.
+static OpSequence path_to(std::unordered_map<uint64_t, Transition> &parents, uint64_t hash) {
+  OpSequence ops;
+  auto it = parents.find(hash);
+  while(it != parents.end()) {
+    ops.push_back(it->second.op);
+    it = parents.find(it->second.from);
+  }
+  return OpSequence(ops.rbegin(), ops.rend());
+}
+
+int main(int argc, char **argv) {
+  unsigned threads = std::thread::hardware_concurrency();
+  size_t max_states = 1 << 20;
+  unsigned max_depth = 12;
+  const char *graph_path = NULL;
+  unsigned graph_depth = 4;
+  unsigned long max_report = 10;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--max-states") == 0 && i + 1 < argc) {
+      max_states = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      max_depth = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--graph") == 0 && i + 1 < argc) {
+      graph_path = argv[++i];
+    }
+    else if(strcmp(argv[i], "--graph-depth") == 0 && i + 1 < argc) {
+      graph_depth = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--max") == 0 && i + 1 < argc) {
+      max_report = strtoul(argv[++i], NULL, 0);
+    }
+    else {
+      fprintf(stderr, "usage: %s [--threads n] [--max-states n] [--depth n] [--graph file] [--graph-depth n]"
+        " [--max n]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if(threads == 0) {
+    threads = 1;
+  }
+  size_t capacity = 1;
+  while(capacity < max_states * 2) {
+    capacity <<= 1;
+  }
+
+  FILE *graph = NULL;
+  if(graph_path) {
+    graph = fopen(graph_path, "w");
+    if(!graph) {
+      perror(graph_path);
+      return 1;
+    }
+    fprintf(graph, "digraph pit {\n");
+  }
+
+  ConcurrentHashSet visited(capacity);
+  std::unordered_map<uint64_t, Transition> parents;
+  std::vector<Finding> findings;       // The first finding of each distinct kind
+  std::unordered_set<uint64_t> finding_keys;
+  unsigned long engine_total = 0;
+  unsigned long model_total = 0;
+  std::vector<ModelState> frontier;
+  unsigned long transitions = 0;
+  bool full = false;
+
+  ModelState reset = { { Pit(kModel8253), Pit(kModel8254) }, 0, 0 };
+  reset.hash = abstract_hash(reset);
+  visited.insert(reset.hash, full);
+  frontier.push_back(reset);
+
+  char label[256];
+  if(graph) {
+    abstract_label(reset, label, sizeof label);
+    fprintf(graph, "  \"%016llx\" [label=\"%s\"];\n", (unsigned long long)reset.hash, label);
+  }
+
+  unsigned depth = 0;
+  while(!frontier.empty() && !full && (max_depth == 0 || depth < max_depth)) {
+    std::vector<Worker> workers(threads);
+    std::vector<std::thread> pool;
+    size_t chunk = (frontier.size() + threads - 1) / threads;
+
+    for(unsigned t = 0; t < threads; t++) {
+      size_t begin = std::min(frontier.size(), t * chunk);
+      size_t end = std::min(frontier.size(), begin + chunk);
+      pool.emplace_back(expand, std::ref(frontier), begin, end, std::ref(visited), std::ref(workers[t]),
+        graph != NULL && depth < graph_depth);
+    }
+    for(std::thread &t : pool) {
+      t.join();
+    }
+
+    frontier.clear();
+    for(Worker &w : workers) {
+      full |= w.full;
+      transitions += w.edges;
+      for(Transition &tr : w.parents) {
+        parents[tr.to] = tr;
+      }
+      for(Transition &tr : w.transitions) {
+        char op_text[32];
+        format_op(tr.op, op_text, sizeof op_text);
+        if(tr.others) {
+          fprintf(graph, "  \"%016llx\" -> \"%016llx\" [label=\"%s (+%u)\"];\n", (unsigned long long)tr.from,
+            (unsigned long long)tr.to, op_text, tr.others);
+        }
+        else {
+          fprintf(graph, "  \"%016llx\" -> \"%016llx\" [label=\"%s\"];\n", (unsigned long long)tr.from,
+            (unsigned long long)tr.to, op_text);
+        }
+      }
+      for(ModelState &s : w.next) {
+        if(graph && depth < graph_depth) {
+          abstract_label(s, label, sizeof label);
+          fprintf(graph, "  \"%016llx\" [label=\"%s\"];\n", (unsigned long long)s.hash, label);
+        }
+        frontier.push_back(s);
+      }
+      for(Finding &f : w.findings) {
+        unsigned long &total = (strcmp(f.what, "model") == 0) ? model_total : engine_total;
+        total++;
+        if(finding_keys.insert(finding_key(f)).second) {
+          findings.push_back(f);
+        }
+      }
+    }
+
+    depth++;
+    fprintf(stderr, "depth %u: %lu states, %lu in frontier\n", depth, (unsigned long)visited.size(),
+      (unsigned long)frontier.size());
+  }
+
+  if(graph) {
+    fprintf(graph, "}\n");
+    fclose(graph);
+  }
+
+  unsigned long engine_count = 0;
+  unsigned long model_count = 0;
+  for(const Finding &f : findings) {
+    bool model = strcmp(f.what, "model") == 0;
+    unsigned long &n = model ? model_count : engine_count;
+    if(n++ >= max_report) {
+      continue;
+    }
+    OpSequence ops = path_to(parents, f.from);
+    ops.push_back(f.op);
+    printf("# %s\n", f.what);
+    write_ops(stdout, ops);
+  }
+
+  fprintf(stderr, "%lu states, %lu transitions, depth %u%s\n", (unsigned long)visited.size(),
+    transitions, depth, full ? " (state limit reached)" : (frontier.empty() ? " (complete)" : " (depth limit reached)"));
+  fprintf(stderr, "%lu engine disagreements (%lu distinct), %lu 8253/8254 divergences (%lu distinct)\n",
+    engine_total, engine_count, model_total, model_count);
+  return engine_count ? 1 : 0;
+}
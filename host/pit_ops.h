@@ -0,0 +1,388 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Host-side representation of a sequence of bus operations against the PIT,
+// using the same vocabulary as the validator's fuzzer (FuzzerOp). Sequences are
+// always applied from a freshly reset PIT with all gates LOW.
+
+#ifndef _PIT_OPS_H
+#define _PIT_OPS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "validate.h"
+
+struct PitOp {
+  u8 op;          // FuzzerOp
+  u8 chan;        // Target channel for ReadChannel, WriteChannel and FlipGate
+  uint32_t arg;   // Command/data byte, tick count, or new gate level for FlipGate
+};
+
+struct PitOpResult {
+  u8 byte;        // Byte read for ReadChannel, 0 otherwise
+  u8 outputs;     // OUT0..OUT2 after the op, as a 3-bit mask
+  u8 undefined;   // Channels the emulator reports as undefined (0 for hardware)
+};
+
+typedef std::vector<PitOp> OpSequence;
+typedef std::vector<PitOpResult> OpResults;
+
+inline PitOp make_op(FuzzerOp op, u8 chan, uint32_t arg) {
+  PitOp o;
+  o.op = (u8)op;
+  o.chan = chan;
+  o.arg = arg;
+  return o;
+}
+
+inline bool operator==(const PitOp &a, const PitOp &b) {
+  return a.op == b.op && a.chan == b.chan && a.arg == b.arg;
+}
+
+inline bool operator!=(const PitOp &a, const PitOp &b) {
+  return !(a == b);
+}
+
+// Compare two results, ignoring any channel the emulator considers undefined.
+inline bool results_match(const PitOpResult &a, const PitOpResult &b, const PitOp &op) {
+  u8 undefined = a.undefined | b.undefined;
+  if((a.outputs & ~undefined & 0x07) != (b.outputs & ~undefined & 0x07)) {
+    return false;
+  }
+  if(op.op == ReadChannel && !(undefined & (1 << op.chan))) {
+    return a.byte == b.byte;
+  }
+  return true;
+}
+
+// A real chip powers up with its outputs undefined, and a board's gates 0 and 1
+// are strapped rather than reset, so nothing is known about a channel's output
+// until a command programs it. programmed_by() tracks the channels programmed so
+// far, for marking results one op at a time.
+inline u8 programmed_by(u8 programmed, const PitOp &op) {
+  u8 cmd = (u8)op.arg;
+  if(op.op == WriteCommand && (cmd >> 6) < 3 && ((cmd >> 4) & 0x03) != 0) {
+    programmed |= 1 << (cmd >> 6);
+  }
+  return programmed;
+}
+
+// Mark channels no command has programmed yet undefined in hardware results.
+inline void mark_unprogrammed(const OpSequence &ops, OpResults &results) {
+  u8 programmed = 0;
+  for(size_t i = 0; i < ops.size() && i < results.size(); i++) {
+    programmed = programmed_by(programmed, ops[i]);
+    results[i].undefined |= ~programmed & 0x07;
+  }
+}
+
+enum CanonicalStep {
+  kCanonicalDropped,   // The op has no effect and was left out
+  kCanonicalMerged,    // The op was folded into the previous op
+  kCanonicalAppended
+};
+
+// Append one op to a canonical sequence, as canonicalize() does. 'gates' holds
+// the gate levels the sequence has set so far, and is updated.
+inline CanonicalStep canonical_append(OpSequence &out, bool *gates, const PitOp &in) {
+  PitOp op = in;
+  op.chan &= 0x03;
+
+  switch(op.op) {
+    case WriteCommand:
+      op.chan = 0;
+      op.arg &= 0xFF;
+      break;
+    case ReadChannel:
+      op.arg = 0;
+      break;
+    case WriteChannel:
+      op.arg &= 0xFF;
+      break;
+    case Tick:
+      if(op.arg == 0) {
+        return kCanonicalDropped;
+      }
+      op.chan = 0;
+      if(!out.empty() && out.back().op == Tick) {
+        out.back().arg += op.arg;
+        return kCanonicalMerged;
+      }
+      break;
+    case FlipGate:
+      op.arg = op.arg ? 1 : 0;
+      if(op.chan > 2 || gates[op.chan] == (bool)op.arg) {
+        return kCanonicalDropped;
+      }
+      gates[op.chan] = (bool)op.arg;
+      break;
+    default:
+      return kCanonicalDropped;
+  }
+  out.push_back(op);
+  return kCanonicalAppended;
+}
+
+// Reduce a sequence to its canonical form, so that sequences which drive the
+// chip identically hash identically:
+//  - Adjacent ticks are merged and zero-length ticks dropped.
+//  - Gate changes that do not change the gate level are dropped.
+//  - Command bytes have no channel field to normalize, data ops are masked to a byte.
+inline OpSequence canonicalize(const OpSequence &ops) {
+  OpSequence out;
+  bool gates[3] = {false, false, false};
+
+  out.reserve(ops.size());
+  for(const PitOp &op : ops) {
+    canonical_append(out, gates, op);
+  }
+  return out;
+}
+
+// FNV-1a over the canonical encoding of each op. The hash of every prefix is
+// available by stopping early, which the result cache uses for prefix lookups.
+#define OPS_HASH_INIT 0xCBF29CE484222325ULL
+
+inline uint64_t hash_op(uint64_t hash, const PitOp &op) {
+  u8 bytes[6] = {
+    op.op,
+    op.chan,
+    (u8)(op.arg & 0xFF),
+    (u8)((op.arg >> 8) & 0xFF),
+    (u8)((op.arg >> 16) & 0xFF),
+    (u8)((op.arg >> 24) & 0xFF),
+  };
+  for(int i = 0; i < 6; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+inline uint64_t hash_ops(const OpSequence &ops, size_t len) {
+  uint64_t hash = OPS_HASH_INIT;
+  for(size_t i = 0; i < len && i < ops.size(); i++) {
+    hash = hash_op(hash, ops[i]);
+  }
+  return hash;
+}
+
+inline uint64_t hash_ops(const OpSequence &ops) {
+  return hash_ops(ops, ops.size());
+}
+
+// Generate one random op as test_fuzzer() does. 'gate' is the channel's current 
+// gate level, and is updated if the op flips it.
+inline PitOp fuzz_op(std::mt19937 &rng, u8 chan, bool &gate) {
+  switch(rng() % NUM_FUZZER_OPS) {
+    case WriteCommand:
+      return make_op(WriteCommand, 0, (rng() & 0x3F) | (chan << 6));
+    case ReadChannel:
+      return make_op(ReadChannel, chan, 0);
+    case WriteChannel:
+      return make_op(WriteChannel, chan, rng() & 0xFF);
+    case Tick:
+      return make_op(Tick, 0, (rng() % 0xFFFF) * 2);
+    default:
+      gate = !gate;
+      return make_op(FlipGate, chan, gate);
+  }
+}
+
+// Generate a sequence the way test_fuzzer() does: the same setup on 'chan',
+// followed by 'count' random ops restricted to that channel.
+inline OpSequence fuzz_sequence(uint32_t seed, size_t count, u8 chan = FUZZ_CHAN) {
+  std::mt19937 rng(seed);
+  OpSequence ops;
+  bool gate = false;
+
+  // Initial mode and counter, as test_fuzzer().
+  ops.push_back(make_op(WriteCommand, 0, (chan << 6) | (LSBMSB << 4) | (InterruptOnTerminalCount << 1)));
+  ops.push_back(make_op(WriteChannel, chan, 0xFF));
+  ops.push_back(make_op(WriteChannel, chan, 0xFF));
+
+  for(size_t i = 0; i < count; i++) {
+    ops.push_back(fuzz_op(rng, chan, gate));
+  }
+  return ops;
+}
+
+// Op scripts are plain text, one op per line:
+//   cmd <hex byte>          write a command byte to port 3
+//   read <c>                read a byte from channel c
+//   write <c> <hex byte>    write a byte to channel c
+//   tick <n>                clock the PIT n times (decimal)
+//   gate <c> <0|1>          set the gate of channel c
+// Blank lines and lines starting with '#' are ignored.
+inline void format_op(const PitOp &op, char *buf, size_t len) {
+  switch(op.op) {
+    case WriteCommand:
+      snprintf(buf, len, "cmd %02X", (unsigned)op.arg);
+      break;
+    case ReadChannel:
+      snprintf(buf, len, "read %d", op.chan);
+      break;
+    case WriteChannel:
+      snprintf(buf, len, "write %d %02X", op.chan, (unsigned)op.arg);
+      break;
+    case Tick:
+      snprintf(buf, len, "tick %u", (unsigned)op.arg);
+      break;
+    case FlipGate:
+      snprintf(buf, len, "gate %d %u", op.chan, (unsigned)op.arg);
+      break;
+    default:
+      snprintf(buf, len, "# bad op %d", op.op);
+      break;
+  }
+}
+
+inline void write_ops(FILE *out, const OpSequence &ops) {
+  char buf[32];
+  for(const PitOp &op : ops) {
+    format_op(op, buf, sizeof buf);
+    fprintf(out, "%s\n", buf);
+  }
+}
+
+inline bool parse_op(const char *line, PitOp &op) {
+  unsigned a = 0;
+  unsigned b = 0;
+
+  if(sscanf(line, " cmd %x", &a) == 1) {
+    op = make_op(WriteCommand, 0, a & 0xFF);
+  }
+  else if(sscanf(line, " read %u", &a) == 1) {
+    op = make_op(ReadChannel, a & 0x03, 0);
+  }
+  else if(sscanf(line, " write %u %x", &a, &b) == 2) {
+    op = make_op(WriteChannel, a & 0x03, b & 0xFF);
+  }
+  else if(sscanf(line, " tick %u", &a) == 1) {
+    op = make_op(Tick, 0, a);
+  }
+  else if(sscanf(line, " gate %u %u", &a, &b) == 2) {
+    op = make_op(FlipGate, a & 0x03, b ? 1 : 0);
+  }
+  else {
+    return false;
+  }
+  return op.op == Tick || op.chan < 3;
+}
+
+// Read either an op script or the serial log of a test_fuzzer() or
+// test_fuzzer_lockstep() run. For a log, the fuzzer's setup is prepended and
+// ops are read up to the first reported divergence.
+inline bool read_ops(FILE *in, OpSequence &ops, u8 chan = FUZZ_CHAN) {
+  std::vector<std::string> lines;
+  char line[256];
+  bool is_log = false;
+
+  while(fgets(line, sizeof line, in)) {
+    lines.push_back(line);
+    if(strstr(line, "FUZZER: Beginning ")) {
+      is_log = true;
+    }
+  }
+
+  if(is_log) {
+    bool started = false;
+    unsigned a = 0;
+    unsigned c = 0;
+
+    for(const std::string &l : lines) {
+      const char *p = l.c_str();
+      if(strstr(p, "FUZZER: Beginning fuzzer!")) {
+        started = true;
+        ops = fuzz_sequence(0, 0, chan);
+      }
+      else if(strstr(p, "FUZZER: Beginning lockstep fuzzer!")) {
+        // test_fuzzer_lockstep() sets up all three channels. Gates 0 and 1 are strapped HIGH.
+        started = true;
+        ops.clear();
+        ops.push_back(make_op(FlipGate, 0, 1));
+        ops.push_back(make_op(FlipGate, 1, 1));
+        for(u8 i = 0; i < 3; i++) {
+          OpSequence setup = fuzz_sequence(0, 0, i);
+          ops.insert(ops.end(), setup.begin(), setup.end());
+        }
+      }
+      else if(!started) {
+        continue;
+      }
+      else if(strstr(p, "outputs differ after tick")) {
+        // The outputs differed partway through the last tick burst. Cut it there, so
+        // the replay compares at the tick that diverged rather than the burst's end.
+        const char *n = strstr(p, "after tick ");
+        if(n && sscanf(n, "after tick %u", &a) == 1 && !ops.empty() && ops.back().op == Tick) {
+          ops.back().arg = a;
+        }
+        break;
+      }
+      else if(strstr(p, " differ!")) {
+        break;
+      }
+      else if(strstr(p, "to command port") && sscanf(p, "FUZZER: Writing %X", &a) == 1) {
+        ops.push_back(make_op(WriteCommand, 0, a & 0xFF));
+      }
+      else if(strstr(p, "FUZZER: Reading from data channel")) {
+        c = chan;
+        sscanf(p, "FUZZER: Reading from data channel %u", &c);
+        ops.push_back(make_op(ReadChannel, c & 0x03, 0));
+      }
+      else if(strstr(p, "to data channel") && sscanf(p, "FUZZER: Writing %X", &a) == 1) {
+        c = chan;
+        sscanf(p, "FUZZER: Writing %*X to data channel %u", &c);
+        ops.push_back(make_op(WriteChannel, c & 0x03, a & 0xFF));
+      }
+      else if(sscanf(p, "FUZZER: Ticking %X", &a) == 1) {
+        ops.push_back(make_op(Tick, 0, a));
+      }
+      else if(sscanf(p, "FUZZER: Setting gate %u", &a) == 1) {
+        ops.push_back(make_op(FlipGate, chan, a ? 1 : 0));
+      }
+    }
+    return true;
+  }
+
+  PitOp op;
+  for(size_t i = 0; i < lines.size(); i++) {
+    const char *p = lines[i].c_str();
+    while(*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if(*p == '#' || *p == '\n' || *p == '\r' || *p == 0) {
+      continue;
+    }
+    if(!parse_op(p, op)) {
+      fprintf(stderr, "line %lu: bad op: %s", (unsigned long)i + 1, lines[i].c_str());
+      return false;
+    }
+    ops.push_back(op);
+  }
+  return true;
+}
+
+#endif // _PIT_OPS_H
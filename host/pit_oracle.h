@@ -0,0 +1,131 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// An oracle executes an op sequence from reset and reports per-op results. The
+// hardware validator, the emulator and the result cache all present this
+// interface to host tools.
+
+#ifndef _PIT_ORACLE_H
+#define _PIT_ORACLE_H
+
+#include "pit_ops.h"
+#include "pit_emulator.h"
+
+class PitOracle {
+  public:
+    virtual ~PitOracle() {}
+
+    // Run 'ops' from a reset PIT. 'results' receives one entry per op.
+    // Returns false if the oracle could not execute the sequence.
+    virtual bool run(const OpSequence &ops, OpResults &results) = 0;
+};
+
+// Apply a single op to an emulated PIT.
+inline void apply_op(Pit &pit, const PitOp &op, PitOpResult &result) {
+
+  result.byte = 0;
+
+  switch(op.op) {
+    case WriteCommand:
+      pit.ioWrite(PIT_COMMAND_PORT, (u8)op.arg);
+      break;
+    case ReadChannel:
+      result.byte = pit.ioRead(op.chan);
+      break;
+    case WriteChannel:
+      pit.ioWrite(op.chan, (u8)op.arg);
+      break;
+    case Tick:
+      pit.run(op.arg);
+      break;
+    case FlipGate:
+      pit.setGate(op.chan, op.arg != 0);
+      break;
+    default:
+      break;
+  }
+
+  result.outputs = pit.getOutputs();
+  result.undefined = pit.getUndefinedMask();
+}
+
+// Raise all three gates and program each channel with a mode and a 16-bit count.
+inline void setup_pit(Pit &pit, const u16 counts[3], const TimerMode modes[3]) {
+  for(u8 c = 0; c < 3; c++) {
+    pit.setGate(c, true);
+    pit.ioWrite(PIT_COMMAND_PORT, (c << 6) | (kLsbMsb << 4) | (modes[c] << 1));
+    pit.ioWrite(c, counts[c] & 0xFF);
+    pit.ioWrite(c, counts[c] >> 8);
+  }
+}
+
+// Runs sequences on the emulator. Constructed with the model of the chip it
+// stands in for, this also serves as a local stand-in device where no
+// hardware is attached, e.g. to populate a result cache for tests. A stand-in
+// reports no undefined channels, just as real hardware would not.
+class PitEmuOracle : public PitOracle {
+
+  private:
+    PitType type;
+    bool stand_in;
+
+  public:
+    PitEmuOracle(PitType type, bool stand_in = false) : type(type), stand_in(stand_in) {}
+
+    bool run(const OpSequence &ops, OpResults &results) override {
+      Pit pit(type);
+
+      results.resize(ops.size());
+      for(size_t i = 0; i < ops.size(); i++) {
+        apply_op(pit, ops[i], results[i]);
+        if(stand_in) {
+          results[i].undefined = 0;
+        }
+      }
+      return true;
+    }
+};
+
+// As fuzz_sequence(), but with FUZZ_EVENT_TICKS behavior: a shadow emulator
+// tracks the sequence so each Tick lands just before, on or after the next
+// event on 'chan'.
+inline OpSequence fuzz_sequence_events(uint32_t seed, size_t count, PitType type, u8 chan = FUZZ_CHAN) {
+  std::mt19937 rng(seed);
+  OpSequence ops = fuzz_sequence(seed, count, chan);
+  Pit pit(type);
+  PitOpResult result;
+
+  for(PitOp &op : ops) {
+    if(op.op == Tick) {
+      unsigned long ticks = pit.channel[chan].ticksUntilEvent();
+      if(ticks != 0 && (rng() % 4) != 0) {
+        ticks = ticks + (rng() % 3) - 1;
+        op.arg = (uint32_t)std::max(1ul, std::min(ticks, 0xFFFFul));
+      }
+      else {
+        op.arg = rng() % 0xFFFF;
+      }
+    }
+    apply_op(pit, op, result);
+  }
+  return ops;
+}
+
+#endif // _PIT_ORACLE_H
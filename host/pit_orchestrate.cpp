@@ -0,0 +1,470 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Run validation work across many boards at once.
+//
+//   pit_orchestrate [options] [port...]
+//     --seeds <first> <count>   fuzz sequences to run, one per seed (default 0 16)
+//     --ops <n>                 random ops per sequence (default 64)
+//     --events                  place ticks around events, as FUZZ_EVENT_TICKS
+//     --tests <list>            comma-separated scripted tests, or 'all'
+//                               (mode0 mode1 mode2 mode3 mode4 mode5 bcd rw reload_lsb)
+//     --program <file>          a test program (test_program.h) to upload and run, as
+//                               test_runner --program takes; may be repeated
+//     --model <8253|8254>       only use boards with this chip (default: the first board's)
+//     --timeout <ms>            reply timeout, on top of the time ticks take (default 2000)
+//     --test-timeout <ms>       time a scripted test may take (default 120000)
+//     --boot <ms>               time a reset board has to answer (default 5000)
+//     --attempts <n>            tries per job before it is reported as an error (default 3)
+//     --out <dir>               write each divergent sequence to <dir>/seed_<n>.ops
+//
+// Ports may be glob patterns. With none given, /dev/ttyACM* and /dev/ttyUSB* are
+// scanned. Every port that answers serial_server()'s hello joins the pool.
+//
+// Each fuzz seed, test and program is a job. Sequences are generated here, from the
+// seed, as fuzz_sequence() does, and run on whichever board is free; the board's
+// results are checked against the emulator for the board's chip. Only the
+// channel under test's output is compared, as the other channels are left
+// unprogrammed. A board that times out or garbles a reply is reset and its job
+// handed to the next free board; a board that does not come back is dropped.
+// Results are printed in job order, so the output does not depend on how many
+// boards there were or which board ran what. Board activity goes to stderr.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_orchestrate.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o pit_orchestrate -pthread
+
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pit_serial.h"
+
+static const char *const test_names[kNumServerTests] = {
+  "mode0", "mode1", "mode2", "mode3", "mode4", "mode5", "bcd", "rw", "reload_lsb",
+};
+
+enum JobStatus {
+  kJobNotRun,
+  kJobPass,
+  kJobDiverged,
+  kJobFailed,
+  kJobError,
+};
+
+enum JobKind {
+  kFuzzJob,
+  kTestJob,
+  kProgramJob,
+};
+
+struct Job {
+  JobKind kind;
+  uint32_t seed;     // Fuzz seed, ServerTest, or index into Options::programs
+  unsigned attempts;
+};
+
+struct JobResult {
+  JobStatus status = kJobNotRun;
+  size_t op = 0;     // First divergent op
+  OpSequence ops;    // Ops up to and including it
+};
+
+struct Options {
+  size_t ops = 64;
+  bool events = false;
+  PitType model = kModel8253;
+  unsigned long test_timeout = 120000;
+  unsigned attempts = 3;
+  std::vector<std::string> program_paths;
+  std::vector<std::vector<u8>> programs;
+};
+
+// Jobs waiting for a board, shared by the board threads.
+class JobQueue {
+
+  private:
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<size_t> waiting;
+    size_t outstanding;
+
+  public:
+    JobQueue(size_t jobs) : outstanding(jobs) {
+      for(size_t i = 0; i < jobs; i++) {
+        waiting.push_back(i);
+      }
+    }
+
+    // The next job to run, or false once every job is finished.
+    bool take(size_t &job) {
+      std::unique_lock<std::mutex> hold(lock);
+      changed.wait(hold, [this] { return !waiting.empty() || outstanding == 0; });
+      if(waiting.empty()) {
+        return false;
+      }
+      job = waiting.front();
+      waiting.pop_front();
+      return true;
+    }
+
+    void finish() {
+      std::lock_guard<std::mutex> hold(lock);
+      outstanding--;
+      changed.notify_all();
+    }
+
+    // Requeue a job behind the others, so another board is likely to get it.
+    void retry(size_t job) {
+      std::lock_guard<std::mutex> hold(lock);
+      waiting.push_back(job);
+      changed.notify_all();
+    }
+
+    // A board dropped out holding no job. If none are left, no one will run the rest.
+    void abandon(size_t boards_left) {
+      std::lock_guard<std::mutex> hold(lock);
+      if(boards_left == 0) {
+        outstanding = 0;
+        waiting.clear();
+        changed.notify_all();
+      }
+    }
+};
+
+// Run one job on a board. Returns false if the board failed, rather than the chip.
+static bool run_job(PitSerialBoard &board, const Job &job, const Options &opt, JobResult &result) {
+  if(job.kind != kFuzzJob) {
+    bool passed = false;
+    bool ran = (job.kind == kTestJob) ? board.runTest((u8)job.seed, passed, opt.test_timeout)
+                                      : board.runProgram(opt.programs[job.seed], passed, opt.test_timeout);
+    if(!ran) {
+      return false;
+    }
+    result.status = passed ? kJobPass : kJobFailed;
+    return true;
+  }
+
+  OpSequence ops = opt.events ? fuzz_sequence_events(job.seed, opt.ops, opt.model)
+                              : fuzz_sequence(job.seed, opt.ops);
+  OpResults actual;
+  OpResults expected;
+  if(!board.run(ops, actual)) {
+    return false;
+  }
+
+  PitEmuOracle emulator(opt.model);
+  emulator.run(ops, expected);
+
+  result.status = kJobPass;
+  for(size_t i = 0; i < ops.size(); i++) {
+    PitOpResult a = actual[i];
+    PitOpResult e = expected[i];
+    a.outputs &= 1 << FUZZ_CHAN;
+    e.outputs &= 1 << FUZZ_CHAN;
+    if(!results_match(e, a, ops[i])) {
+      result.status = kJobDiverged;
+      result.op = i;
+      result.ops.assign(ops.begin(), ops.begin() + i + 1);
+      break;
+    }
+  }
+  return true;
+}
+
+static bool parse_tests(const char *list, std::vector<u8> &tests) {
+  std::string s = list;
+  size_t start = 0;
+  while(start <= s.size()) {
+    size_t end = s.find(',', start);
+    std::string name = s.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    bool found = false;
+    for(u8 t = 0; t < kNumServerTests; t++) {
+      if(name == "all" || name == test_names[t]) {
+        tests.push_back(t);
+        found = true;
+      }
+    }
+    if(!found) {
+      fprintf(stderr, "unknown test: %s\n", name.c_str());
+      return false;
+    }
+    if(end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+static bool read_program(const char *path, std::vector<u8> &program) {
+  FILE *f = fopen(path, "rb");
+  if(!f) {
+    perror(path);
+    return false;
+  }
+  int c;
+  while((c = fgetc(f)) != EOF) {
+    program.push_back((u8)c);
+  }
+  fclose(f);
+  if(program.empty() || program.size() > TEST_PROGRAM_MAX) {
+    fprintf(stderr, "%s: a program must be 1 to %u bytes\n", path, TEST_PROGRAM_MAX);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  uint32_t first_seed = 0;
+  unsigned long seed_count = 16;
+  std::vector<u8> tests;
+  bool model_set = false;
+  unsigned long timeout = 2000;
+  unsigned long boot = 5000;
+  const char *out_dir = NULL;
+  std::vector<std::string> patterns;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--seeds") == 0 && i + 2 < argc) {
+      first_seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+      seed_count = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+      opt.ops = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--events") == 0) {
+      opt.events = true;
+    }
+    else if(strcmp(argv[i], "--tests") == 0 && i + 1 < argc) {
+      if(!parse_tests(argv[++i], tests)) {
+        return 2;
+      }
+    }
+    else if(strcmp(argv[i], "--program") == 0 && i + 1 < argc) {
+      opt.program_paths.push_back(argv[++i]);
+      opt.programs.emplace_back();
+      if(!read_program(argv[i], opt.programs.back())) {
+        return 2;
+      }
+    }
+    else if(strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+      opt.model = strcmp(argv[++i], "8254") == 0 ? kModel8254 : kModel8253;
+      model_set = true;
+    }
+    else if(strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      timeout = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--test-timeout") == 0 && i + 1 < argc) {
+      opt.test_timeout = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--boot") == 0 && i + 1 < argc) {
+      boot = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--attempts") == 0 && i + 1 < argc) {
+      opt.attempts = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_dir = argv[++i];
+    }
+    else if(argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [--seeds first count] [--ops n] [--events] [--tests list] [--program file] "
+        "[--model 8253|8254] [--timeout ms] [--test-timeout ms] [--boot ms] [--attempts n] [--out dir] [port...]\n",
+        argv[0]);
+      return 2;
+    }
+    else {
+      patterns.push_back(argv[i]);
+    }
+  }
+  if(patterns.empty()) {
+    patterns.push_back("/dev/ttyACM*");
+    patterns.push_back("/dev/ttyUSB*");
+  }
+
+  // Discover boards, opening them all at once as each may take seconds to boot.
+  std::vector<std::string> paths;
+  for(const std::string &pattern : patterns) {
+    glob_t g;
+    if(glob(pattern.c_str(), 0, NULL, &g) == 0) {
+      for(size_t i = 0; i < g.gl_pathc; i++) {
+        paths.push_back(g.gl_pathv[i]);
+      }
+    }
+    globfree(&g);
+  }
+
+  std::vector<std::unique_ptr<PitSerialBoard>> found(paths.size());
+  std::vector<std::thread> openers;
+  for(size_t i = 0; i < paths.size(); i++) {
+    openers.emplace_back([&, i] {
+      std::unique_ptr<PitSerialBoard> board(new PitSerialBoard(paths[i]));
+      board->setTimeouts(timeout, boot);
+      if(board->open()) {
+        found[i] = std::move(board);
+      }
+    });
+  }
+  for(std::thread &t : openers) {
+    t.join();
+  }
+
+  std::vector<std::unique_ptr<PitSerialBoard>> boards;
+  for(size_t i = 0; i < paths.size(); i++) {
+    if(!found[i]) {
+      fprintf(stderr, "%s: no board\n", paths[i].c_str());
+      continue;
+    }
+    if(!model_set) {
+      opt.model = found[i]->getModel();
+      model_set = true;
+    }
+    if(found[i]->getModel() != opt.model) {
+      fprintf(stderr, "%s: skipped, not an %s\n", paths[i].c_str(), opt.model == kModel8254 ? "8254" : "8253");
+      continue;
+    }
+    boards.push_back(std::move(found[i]));
+  }
+  if(boards.empty()) {
+    fprintf(stderr, "no boards\n");
+    return 1;
+  }
+  fprintf(stderr, "%lu %s board%s\n", (unsigned long)boards.size(), opt.model == kModel8254 ? "8254" : "8253",
+    boards.size() == 1 ? "" : "s");
+
+  std::vector<Job> jobs;
+  for(unsigned long s = 0; s < seed_count; s++) {
+    jobs.push_back({ kFuzzJob, first_seed + (uint32_t)s, 0 });
+  }
+  for(u8 t : tests) {
+    jobs.push_back({ kTestJob, t, 0 });
+  }
+  for(size_t p = 0; p < opt.programs.size(); p++) {
+    jobs.push_back({ kProgramJob, (uint32_t)p, 0 });
+  }
+
+  std::vector<JobResult> results(jobs.size());
+  JobQueue queue(jobs.size());
+  std::mutex log_lock;
+  size_t boards_left = boards.size();
+
+  std::vector<std::thread> workers;
+  for(std::unique_ptr<PitSerialBoard> &b : boards) {
+    PitSerialBoard *board = b.get();
+    workers.emplace_back([&, board] {
+      size_t j;
+      while(queue.take(j)) {
+        JobResult result;
+        if(run_job(*board, jobs[j], opt, result)) {
+          results[j] = result;
+          queue.finish();
+          continue;
+        }
+
+        bool alive = board->reset();
+        {
+          std::lock_guard<std::mutex> hold(log_lock);
+          fprintf(stderr, "%s: no reply on job %lu, %s\n", board->getPath().c_str(), (unsigned long)j,
+            alive ? "reset" : "dropped");
+          jobs[j].attempts++;
+          if(jobs[j].attempts >= opt.attempts) {
+            results[j].status = kJobError;
+          }
+        }
+        if(results[j].status == kJobError) {
+          queue.finish();
+        }
+        else {
+          queue.retry(j);
+        }
+        if(!alive) {
+          std::lock_guard<std::mutex> hold(log_lock);
+          queue.abandon(--boards_left);
+          return;
+        }
+      }
+    });
+  }
+  for(std::thread &t : workers) {
+    t.join();
+  }
+
+  unsigned long counts[kJobError + 1] = {0};
+  for(size_t j = 0; j < jobs.size(); j++) {
+    const Job &job = jobs[j];
+    const JobResult &r = results[j];
+    char name[256];
+    if(job.kind == kTestJob) {
+      snprintf(name, sizeof name, "test %s", test_names[job.seed]);
+    }
+    else if(job.kind == kProgramJob) {
+      snprintf(name, sizeof name, "program %s", opt.program_paths[job.seed].c_str());
+    }
+    else {
+      snprintf(name, sizeof name, "seed %lu", (unsigned long)job.seed);
+    }
+    counts[r.status]++;
+
+    switch(r.status) {
+      case kJobPass:
+        printf("%s pass\n", name);
+        break;
+      case kJobDiverged:
+        printf("%s diverged at op %lu\n", name, (unsigned long)r.op);
+        if(out_dir) {
+          std::string path = std::string(out_dir) + "/seed_" + std::to_string(job.seed) + ".ops";
+          FILE *f = fopen(path.c_str(), "w");
+          if(f) {
+            fprintf(f, "# seed %lu, %lu ops, diverged at op %lu\n", (unsigned long)job.seed,
+              (unsigned long)opt.ops, (unsigned long)r.op);
+            write_ops(f, r.ops);
+            fclose(f);
+          }
+          else {
+            perror(path.c_str());
+          }
+        }
+        break;
+      case kJobFailed:
+        printf("%s FAIL\n", name);
+        break;
+      case kJobError:
+        printf("%s error: no result after %u attempts\n", name, opt.attempts);
+        break;
+      default:
+        printf("%s not run\n", name);
+        break;
+    }
+  }
+
+  printf("%lu jobs: %lu pass, %lu diverged, %lu failed, %lu error, %lu not run\n", (unsigned long)jobs.size(),
+    counts[kJobPass], counts[kJobDiverged], counts[kJobFailed], counts[kJobError], counts[kJobNotRun]);
+  return counts[kJobPass] == jobs.size() ? 0 : 1;
+}
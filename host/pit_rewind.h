@@ -0,0 +1,283 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Rewind buffer of per-frame Pit states, for frontends with rewind or run-ahead.
+//
+// Every 'key_interval' frames a full state (a keyframe) is stored. Frames in 
+// between store their state XORed with their group's keyframe, with the runs
+// of zero bytes (fields that didn't change) squeezed out:
+//   delta:  { u8 zero_run, u8 literal_len, literal_len * u8 } ...
+// Deltas are taken against the keyframe rather than the previous frame, so any
+// frame is restored by decoding at most one keyframe and one delta.
+//
+// Records live in a fixed byte arena used as a ring, with a fixed ring of 
+// record descriptors. Nothing is allocated after construction. When either is 
+// full, the oldest keyframe and its deltas are dropped together.
+
+#ifndef _PIT_REWIND_H
+#define _PIT_REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pit_emulator.h"
+
+template <size_t ArenaBytes, size_t MaxFrames>
+class PitRewindBuffer {
+
+  private:
+    static const size_t kStateBytes = sizeof(PitState);
+    // Worst case delta: a two byte header for every state byte, plus the byte itself.
+    static const size_t kMaxDeltaBytes = 3 * kStateBytes;
+
+    static_assert(ArenaBytes >= 2 * kStateBytes, "Rewind arena is too small for a keyframe");
+
+    struct Record {
+      uint64_t frame;
+      uint32_t offset;
+      uint16_t length;
+      bool key;
+    };
+
+    uint8_t arena[ArenaBytes];
+    Record records[MaxFrames];
+    size_t first = 0;     // Oldest record
+    size_t count = 0;
+    size_t write_pos = 0; // Arena offset following the newest record
+
+    unsigned int key_interval;
+    unsigned int since_key = 0;
+    uint64_t next_frame = 0;
+
+    // Raw state of the newest group's keyframe, which new deltas are encoded against.
+    uint8_t key_state[kStateBytes];
+    uint8_t scratch[kMaxDeltaBytes];
+
+    Record &recordAt(size_t i) {
+      return records[(first + i) % MaxFrames];
+    }
+
+    static void saveState(Pit &pit, uint8_t *raw) {
+      PitState state;
+      // Clear padding so that identical states have identical bytes.
+      memset(&state, 0, sizeof(state));
+      pit.getState(state);
+      memcpy(raw, &state, kStateBytes);
+    }
+
+    static size_t encodeDelta(const uint8_t *raw, const uint8_t *key, uint8_t *out) {
+      size_t n = 0;
+      size_t i = 0;
+
+      while (i < kStateBytes) {
+        size_t zeros = 0;
+        while (i < kStateBytes && zeros < 255 && raw[i] == key[i]) {
+          zeros++;
+          i++;
+        }
+        size_t literal = 0;
+        while ((i + literal) < kStateBytes && literal < 255 && raw[i + literal] != key[i + literal]) {
+          literal++;
+        }
+        out[n++] = (uint8_t)zeros;
+        out[n++] = (uint8_t)literal;
+        for (size_t j = 0; j < literal; j++) {
+          out[n++] = raw[i + j] ^ key[i + j];
+        }
+        i += literal;
+      }
+      return n;
+    }
+
+    static void applyDelta(const uint8_t *delta, size_t length, uint8_t *raw) {
+      size_t pos = 0;
+      size_t n = 0;
+
+      while (n + 1 < length) {
+        pos += delta[n++];
+        size_t literal = delta[n++];
+        for (size_t j = 0; j < literal; j++) {
+          raw[pos++] ^= delta[n++];
+        }
+      }
+    }
+
+    // Drop the oldest keyframe and its deltas.
+    void dropOldestGroup() {
+      do {
+        first = (first + 1) % MaxFrames;
+        count--;
+      } while (count > 0 && !recordAt(0).key);
+
+      if (count == 0) {
+        write_pos = 0;
+      }
+    }
+
+    // Find 'length' contiguous arena bytes after the newest record, or return false.
+    bool reserve(size_t length, size_t &offset) {
+      if (count == MaxFrames) {
+        return false;
+      }
+      if (count == 0) {
+        offset = 0;
+        return true;
+      }
+
+      size_t tail = recordAt(0).offset;
+      if (write_pos > tail) {
+        if (ArenaBytes - write_pos >= length) {
+          offset = write_pos;
+          return true;
+        }
+        if (length <= tail) {
+          // Wrap to the start of the arena.
+          offset = 0;
+          return true;
+        }
+        return false;
+      }
+      if (tail - write_pos >= length) {
+        offset = write_pos;
+        return true;
+      }
+      return false;
+    }
+
+  public:
+
+    PitRewindBuffer(unsigned int key_interval) : key_interval(key_interval ? key_interval : 1) {
+    }
+
+    // Store the Pit's state as the next frame and return its frame number.
+    uint64_t push(Pit &pit) {
+      uint8_t raw[kStateBytes];
+      saveState(pit, raw);
+
+      bool key = (since_key == 0) || (count == 0);
+      size_t length = key ? kStateBytes : encodeDelta(raw, key_state, scratch);
+      if (length >= kStateBytes) {
+        // The delta saves nothing. Start a new group.
+        key = true;
+        length = kStateBytes;
+      }
+
+      size_t offset = 0;
+      while (!reserve(length, offset)) {
+        if (!key && recordAt(0).frame == next_frame - since_key) {
+          // Only the current group is left. Start a new group rather than drop its keyframe.
+          key = true;
+          length = kStateBytes;
+          continue;
+        }
+        dropOldestGroup();
+      }
+
+      if (key) {
+        memcpy(&arena[offset], raw, kStateBytes);
+        memcpy(key_state, raw, kStateBytes);
+        since_key = 0;
+      }
+      else {
+        memcpy(&arena[offset], scratch, length);
+      }
+
+      Record &r = records[(first + count) % MaxFrames];
+      r.frame = next_frame;
+      r.offset = (uint32_t)offset;
+      r.length = (uint16_t)length;
+      r.key = key;
+      count++;
+      write_pos = offset + length;
+
+      since_key = (since_key + 1) % key_interval;
+      return next_frame++;
+    }
+
+    // Load a stored frame into 'pit'. Returns false if the frame is no longer held.
+    bool restore(uint64_t frame, Pit &pit) {
+      if (count == 0 || frame < recordAt(0).frame || frame >= next_frame) {
+        return false;
+      }
+
+      size_t index = (size_t)(frame - recordAt(0).frame);
+      size_t key_index = index;
+      while (!recordAt(key_index).key) {
+        key_index--;
+      }
+
+      uint8_t raw[kStateBytes];
+      Record &key = recordAt(key_index);
+      memcpy(raw, &arena[key.offset], kStateBytes);
+      if (key_index != index) {
+        Record &r = recordAt(index);
+        applyDelta(&arena[r.offset], r.length, raw);
+      }
+
+      PitState state;
+      memcpy(&state, raw, kStateBytes);
+      pit.setState(state);
+      return true;
+    }
+
+    // Restore a frame and discard all newer frames, so that the next push() continues the 
+    // timeline from there.
+    bool rewindTo(uint64_t frame, Pit &pit) {
+      if (!restore(frame, pit)) {
+        return false;
+      }
+
+      size_t index = (size_t)(frame - recordAt(0).frame);
+      count = index + 1;
+      next_frame = frame + 1;
+
+      Record &newest = recordAt(index);
+      write_pos = newest.offset + newest.length;
+
+      size_t key_index = index;
+      while (!recordAt(key_index).key) {
+        key_index--;
+      }
+      memcpy(key_state, &arena[recordAt(key_index).offset], kStateBytes);
+      since_key = (unsigned int)((index - key_index + 1) % key_interval);
+      return true;
+    }
+
+    // Range of frames that can be restored. Empty if getOldestFrame() == getNextFrame().
+    uint64_t getOldestFrame() {
+      return count ? recordAt(0).frame : next_frame;
+    }
+
+    uint64_t getNextFrame() {
+      return next_frame;
+    }
+
+    // Arena bytes held by stored frames, for tuning the arena size and key interval.
+    size_t getStoredBytes() {
+      size_t n = 0;
+      for (size_t i = 0; i < count; i++) {
+        n += recordAt(i).length;
+      }
+      return n;
+    }
+};
+
+#endif
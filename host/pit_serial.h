@@ -0,0 +1,381 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Oracle backed by a validator board running serial_server() (see
+// serial_server.h). Each sequence is run on the real chip from a reset, with up
+// to SRV_WINDOW ops in flight so the serial round trip overlaps execution. The
+// board's results are returned as they are, except that channels no command has
+// programmed yet are marked undefined (see mark_unprogrammed()). Comparing them
+// with the emulator is up to the caller.
+//
+// Failures are reported, not retried: run() returns false on a timeout or a
+// protocol error, after which the caller should reset() the board before using
+// it again. reset() pulses DTR, which reboots an Uno, and waits for the board to
+// answer a hello. Linux only.
+
+#ifndef _PIT_SERIAL_H
+#define _PIT_SERIAL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "pit_oracle.h"
+#include "serial_server.h"
+#include "test_program.h"
+
+// The slowest the board clocks the PIT, for reply timeouts on long ticks.
+#define SERIAL_TICKS_PER_MS 50
+
+class PitSerialBoard : public PitOracle {
+
+  private:
+    std::string path;
+    int fd = -1;
+    PitType model = kModel8253;
+
+    unsigned long timeout_ms = 2000;
+    unsigned long boot_ms = 5000;
+
+    u8 buf[256];
+    size_t buf_len = 0;
+    size_t buf_pos = 0;
+
+    static unsigned long long nowMs() {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // Next byte from the board, or -1 at the deadline.
+    int readByte(unsigned long long deadline) {
+      while(buf_pos == buf_len) {
+        unsigned long long now = nowMs();
+        if(now >= deadline) {
+          return -1;
+        }
+        struct pollfd p = { fd, POLLIN, 0 };
+        if(poll(&p, 1, (int)(deadline - now)) <= 0) {
+          continue;
+        }
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if(n < 0 && errno != EAGAIN && errno != EINTR) {
+          return -1;
+        }
+        if(n > 0) {
+          buf_len = (size_t)n;
+          buf_pos = 0;
+        }
+        else if(n == 0 || (p.revents & (POLLHUP | POLLERR))) {
+          // Closed, or a pseudo-terminal with no device behind it. Wait out the deadline.
+          usleep(10000);
+        }
+      }
+      return buf[buf_pos++];
+    }
+
+    bool send(u8 cmd, const u8 *payload, u8 len) {
+      u8 frame[4 + SRV_MAX_PAYLOAD];
+      u8 sum = cmd + len;
+
+      frame[0] = SRV_SYNC;
+      frame[1] = cmd;
+      frame[2] = len;
+      for(u8 i = 0; i < len; i++) {
+        frame[3 + i] = payload[i];
+        sum += payload[i];
+      }
+      frame[3 + len] = sum;
+      return ::write(fd, frame, 4 + len) == 4 + len;
+    }
+
+    // Read the next response frame, skipping any text and damaged frames.
+    bool receive(u8 &cmd, u8 *payload, u8 &len, unsigned long long deadline) {
+      int b = 0;
+      while(true) {
+        if((b = readByte(deadline)) < 0) {
+          return false;
+        }
+        if(b != SRV_SYNC) {
+          continue;
+        }
+        if((b = readByte(deadline)) != SRV_SYNC2) {
+          if(b < 0) {
+            return false;
+          }
+          continue;
+        }
+
+        int c = readByte(deadline);
+        int l = readByte(deadline);
+        if(c < 0 || l < 0) {
+          return false;
+        }
+        if(l > SRV_MAX_PAYLOAD) {
+          continue;
+        }
+        u8 sum = (u8)(c + l);
+        for(int i = 0; i < l; i++) {
+          if((b = readByte(deadline)) < 0) {
+            return false;
+          }
+          payload[i] = (u8)b;
+          sum += (u8)b;
+        }
+        if((b = readByte(deadline)) < 0) {
+          return false;
+        }
+        if((u8)b == sum) {
+          cmd = (u8)c;
+          len = (u8)l;
+          return true;
+        }
+      }
+    }
+
+    // Read responses until one for 'cmd', discarding any left over from earlier requests.
+    bool receiveFor(u8 cmd, u8 *payload, u8 &len, unsigned long long deadline) {
+      u8 got;
+      while(receive(got, payload, len, deadline)) {
+        if(got == cmd) {
+          return true;
+        }
+        if(got == kSrvError) {
+          return false;
+        }
+      }
+      return false;
+    }
+
+    bool hello(unsigned long long deadline) {
+      u8 payload[SRV_MAX_PAYLOAD];
+      u8 len = 0;
+      if(!send(kSrvHello, NULL, 0)) {
+        return false;
+      }
+      if(!receiveFor(kSrvHello, payload, len, deadline)) {
+        return false;
+      }
+      if(len < 5 || payload[0] != 'P' || payload[1] != 'I' || payload[2] != 'T' || payload[3] != SRV_VERSION) {
+        return false;
+      }
+      model = payload[4] ? kModel8254 : kModel8253;
+      return true;
+    }
+
+  public:
+    PitSerialBoard(const std::string &path) : path(path) {}
+
+    ~PitSerialBoard() {
+      close();
+    }
+
+    // Replies must start within 'timeout' ms, plus the time any ticks take. A
+    // rebooting board must answer within 'boot' ms.
+    void setTimeouts(unsigned long timeout, unsigned long boot) {
+      timeout_ms = timeout;
+      boot_ms = boot;
+    }
+
+    // Open the port and wait for the board to answer. Returns false if nothing
+    // answering the protocol is there.
+    bool open() {
+      fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+      if(fd < 0) {
+        return false;
+      }
+
+      struct termios tio;
+      if(tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, B115200);
+        cfsetospeed(&tio, B115200);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(fd, TCSANOW, &tio);
+      }
+      return reset();
+    }
+
+    void close() {
+      if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+
+    // Reboot the board and wait until it answers. Hellos are repeated, as the
+    // board ignores anything sent while it boots.
+    bool reset() {
+      int dtr = TIOCM_DTR;
+      if(ioctl(fd, TIOCMBIC, &dtr) == 0) {
+        usleep(100000);
+        ioctl(fd, TIOCMBIS, &dtr);
+      }
+      tcflush(fd, TCIOFLUSH);
+      buf_pos = buf_len = 0;
+
+      unsigned long long deadline = nowMs() + boot_ms;
+      while(nowMs() < deadline) {
+        unsigned long long attempt = nowMs() + 250;
+        if(hello(attempt < deadline ? attempt : deadline)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Start the chip over: gate 2 LOW, then a PIT reset. run() does this before
+    // each sequence.
+    bool resetChip() {
+      u8 payload[SRV_MAX_PAYLOAD];
+      u8 len = 0;
+      return send(kSrvReset, NULL, 0) && receiveFor(kSrvReset, payload, len, nowMs() + timeout_ms + 1000);
+    }
+
+    // Send one op without waiting for its reply. Replies come back in order, and
+    // at most SRV_WINDOW ops may be awaiting one.
+    bool sendOp(const PitOp &op) {
+      u8 req[6] = {
+        op.op,
+        op.chan,
+        (u8)(op.arg & 0xFF),
+        (u8)((op.arg >> 8) & 0xFF),
+        (u8)((op.arg >> 16) & 0xFF),
+        (u8)((op.arg >> 24) & 0xFF),
+      };
+      return send(kSrvOp, req, sizeof req);
+    }
+
+    // Receive the reply to the oldest op sent. 'in_flight_ticks' is the number of
+    // ticks in the ops awaiting a reply, which the board may still be clocking.
+    bool receiveOp(PitOpResult &result, unsigned long in_flight_ticks) {
+      u8 payload[SRV_MAX_PAYLOAD];
+      u8 len = 0;
+      u8 cmd = 0;
+
+      unsigned long long deadline = nowMs() + timeout_ms + in_flight_ticks / SERIAL_TICKS_PER_MS;
+      if(!receive(cmd, payload, len, deadline) || cmd != kSrvOp || len != 2) {
+        return false;
+      }
+      result.byte = payload[0];
+      result.outputs = payload[1] & 0x07;
+      result.undefined = 0;
+      return true;
+    }
+
+    bool run(const OpSequence &ops, OpResults &results) override {
+      if(!resetChip()) {
+        return false;
+      }
+
+      results.resize(ops.size());
+      size_t sent = 0;
+      unsigned long in_flight_ticks = 0;
+
+      for(size_t i = 0; i < ops.size(); i++) {
+        while(sent < ops.size() && sent < i + SRV_WINDOW) {
+          if(!sendOp(ops[sent])) {
+            return false;
+          }
+          if(ops[sent].op == Tick) {
+            in_flight_ticks += ops[sent].arg;
+          }
+          sent++;
+        }
+
+        if(!receiveOp(results[i], in_flight_ticks)) {
+          return false;
+        }
+        if(ops[i].op == Tick) {
+          in_flight_ticks -= ops[i].arg;
+        }
+      }
+      mark_unprogrammed(ops, results);
+      return true;
+    }
+
+    // Run one of the sketch's scripted tests on the board. Returns false if the
+    // board did not report a result; 'passed' is the result.
+    bool runTest(u8 test, bool &passed, unsigned long test_timeout_ms) {
+      u8 payload[SRV_MAX_PAYLOAD];
+      u8 len = 0;
+
+      if(!send(kSrvTest, &test, 1) || !receiveFor(kSrvTest, payload, len, nowMs() + test_timeout_ms)) {
+        return false;
+      }
+      if(len != 1) {
+        return false;
+      }
+      passed = payload[0] != 0;
+      return true;
+    }
+
+    // Load a test program (test_program.h) into the board and run it. Returns false
+    // if the board did not report a result; 'passed' is the result.
+    bool runProgram(const std::vector<u8> &program, bool &passed, unsigned long test_timeout_ms) {
+      u8 payload[SRV_MAX_PAYLOAD];
+      u8 len = 0;
+
+      if(program.empty() || program.size() > TEST_PROGRAM_MAX) {
+        return false;
+      }
+      for(size_t offset = 0; offset < program.size(); offset += SRV_MAX_PAYLOAD - 2) {
+        size_t n = program.size() - offset;
+        if(n > SRV_MAX_PAYLOAD - 2) {
+          n = SRV_MAX_PAYLOAD - 2;
+        }
+        u8 req[SRV_MAX_PAYLOAD];
+        req[0] = (u8)(offset & 0xFF);
+        req[1] = (u8)(offset >> 8);
+        memcpy(req + 2, &program[offset], n);
+        if(!send(kSrvLoad, req, (u8)(n + 2)) || !receiveFor(kSrvLoad, payload, len, nowMs() + timeout_ms)) {
+          return false;
+        }
+      }
+
+      u8 req[2] = { (u8)(program.size() & 0xFF), (u8)(program.size() >> 8) };
+      if(!send(kSrvProgram, req, 2) || !receiveFor(kSrvProgram, payload, len, nowMs() + test_timeout_ms)) {
+        return false;
+      }
+      if(len != 1) {
+        return false;
+      }
+      passed = payload[0] != 0;
+      return true;
+    }
+
+    PitType getModel() const {
+      return model;
+    }
+
+    const std::string &getPath() const {
+      return path;
+    }
+};
+
+#endif // _PIT_SERIAL_H
@@ -0,0 +1,241 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Batch backend on validator boards running serial_server() (C++20, Linux).
+//
+// A board holds one PIT, so each lane runs on a board of its own for as long as
+// it can. A board keeps the state of the lane it last ran, and a batch only sends
+// that lane's new ops. The ops of a batch are sent to every board before any
+// reply is awaited, up to SRV_WINDOW per board, so boards work in parallel and a
+// batch costs about one round trip.
+//
+// With more lanes than boards, a lane that finds no board free takes over the
+// one used least recently: the board is reset and the lane's ops so far are
+// replayed on it before its new ops. That costs a replay per switch, so give
+// each concurrent test its own board where possible; getReplayedOps() tells how
+// much replaying was done.
+
+#ifndef _PIT_SERIAL_BATCH_H
+#define _PIT_SERIAL_BATCH_H
+
+#include <vector>
+
+#include "pit_coro.h"
+#include "pit_serial.h"
+
+class SerialBatchBackend : public PitBatchBackend {
+
+  private:
+    static const int kNoLane = -1;
+    static const int kNoBoard = -1;
+
+    struct Lane {
+      OpSequence ops;         // Every op run so far, for replays
+      u8 programmed = 0;
+      int board = kNoBoard;
+    };
+
+    struct Board {
+      PitSerialBoard *board;
+      int lane = kNoLane;               // Lane whose state the board holds
+      unsigned long last_used = 0;
+
+      // The current exchange.
+      std::vector<PitOp> ops;
+      std::vector<size_t> slots;        // Per op, its batch entry, or kReplay
+      size_t sent = 0;
+      size_t received = 0;
+      unsigned long in_flight_ticks = 0;
+    };
+
+    static const size_t kReplay = (size_t)-1;
+
+    std::vector<Lane> lanes;
+    std::vector<Board> boards;
+    unsigned long rounds = 0;
+    unsigned long switches = 0;
+    unsigned long replayed = 0;
+
+    // Pick a board for a lane that holds none, from those not yet used this round.
+    int takeBoard(unsigned lane, const std::vector<bool> &busy) {
+      int best = kNoBoard;
+      for(size_t b = 0; b < boards.size(); b++) {
+        if(busy[b]) {
+          continue;
+        }
+        if(best == kNoBoard || (boards[b].lane == kNoLane && boards[best].lane != kNoLane) ||
+           ((boards[b].lane == kNoLane) == (boards[best].lane == kNoLane) &&
+            boards[b].last_used < boards[best].last_used)) {
+          best = (int)b;
+        }
+      }
+      if(best == kNoBoard) {
+        return kNoBoard;
+      }
+
+      Board &board = boards[best];
+      if(board.lane != kNoLane) {
+        lanes[board.lane].board = kNoBoard;
+      }
+      board.lane = (int)lane;
+      lanes[lane].board = best;
+      return best;
+    }
+
+    // Run every board's exchange, keeping up to SRV_WINDOW ops in flight on each.
+    bool exchange(std::vector<LaneOp> &batch) {
+      bool pending = true;
+      while(pending) {
+        pending = false;
+        for(Board &board : boards) {
+          while(board.sent < board.ops.size() && board.sent < board.received + SRV_WINDOW) {
+            const PitOp &op = board.ops[board.sent];
+            if(!board.board->sendOp(op)) {
+              return false;
+            }
+            if(op.op == Tick) {
+              board.in_flight_ticks += op.arg;
+            }
+            board.sent++;
+          }
+        }
+        for(Board &board : boards) {
+          if(board.received == board.sent) {
+            continue;
+          }
+          PitOpResult result;
+          if(!board.board->receiveOp(result, board.in_flight_ticks)) {
+            return false;
+          }
+          const PitOp &op = board.ops[board.received];
+          if(op.op == Tick) {
+            board.in_flight_ticks -= op.arg;
+          }
+          size_t slot = board.slots[board.received];
+          if(slot != kReplay) {
+            batch[slot].result = result;
+          }
+          board.received++;
+          pending |= board.received < board.ops.size();
+        }
+      }
+      return true;
+    }
+
+  public:
+    // The boards must be open, and all carry the same model of chip.
+    SerialBatchBackend(const std::vector<PitSerialBoard *> &serial_boards) {
+      for(PitSerialBoard *b : serial_boards) {
+        Board board;
+        board.board = b;
+        boards.push_back(board);
+      }
+    }
+
+    unsigned addLane() override {
+      lanes.push_back(Lane());
+      return (unsigned)lanes.size() - 1;
+    }
+
+    bool submit(std::vector<LaneOp> &batch) override {
+      std::vector<bool> done(batch.size(), false);
+      size_t remaining = batch.size();
+
+      // Each round gives every board to at most one lane. Rounds after the first only
+      // happen with more lanes in the batch than boards.
+      while(remaining) {
+        std::vector<bool> busy(boards.size(), false);
+        std::vector<int> round_board(lanes.size(), kNoBoard);
+        rounds++;
+
+        for(Board &board : boards) {
+          board.ops.clear();
+          board.slots.clear();
+          board.sent = board.received = 0;
+          board.in_flight_ticks = 0;
+        }
+
+        for(size_t i = 0; i < batch.size(); i++) {
+          if(done[i]) {
+            continue;
+          }
+          unsigned l = batch[i].lane;
+          Lane &lane = lanes[l];
+          if(round_board[l] == kNoBoard) {
+            if(lane.board != kNoBoard && !busy[lane.board]) {
+              round_board[l] = lane.board;
+            }
+            else {
+              int b = takeBoard(l, busy);
+              if(b == kNoBoard) {
+                continue;
+              }
+              // The board holds another lane's state, or none. Start this lane over on it.
+              switches++;
+              replayed += lane.ops.size();
+              if(!boards[b].board->resetChip()) {
+                return false;
+              }
+              for(const PitOp &op : lane.ops) {
+                boards[b].ops.push_back(op);
+                boards[b].slots.push_back(kReplay);
+              }
+              round_board[l] = b;
+            }
+            busy[round_board[l]] = true;
+            boards[round_board[l]].last_used = rounds;
+          }
+          Board &board = boards[round_board[l]];
+          board.ops.push_back(batch[i].op);
+          board.slots.push_back(i);
+          done[i] = true;
+          remaining--;
+        }
+
+        if(!exchange(batch)) {
+          return false;
+        }
+      }
+
+      for(LaneOp &entry : batch) {
+        Lane &lane = lanes[entry.lane];
+        lane.ops.push_back(entry.op);
+        lane.programmed = programmed_by(lane.programmed, entry.op);
+        entry.result.undefined |= ~lane.programmed & 0x07;
+      }
+      return true;
+    }
+
+    // Rounds of exchanges, lanes moved onto a board, and ops replayed to do so.
+    unsigned long getExchanges() const {
+      return rounds;
+    }
+
+    unsigned long getSwitches() const {
+      return switches;
+    }
+
+    unsigned long getReplayedOps() const {
+      return replayed;
+    }
+};
+
+#endif // _PIT_SERIAL_BATCH_H
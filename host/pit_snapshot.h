@@ -0,0 +1,112 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Lock-free publication of Pit state to reader threads, such as a debugger 
+// overlay, using a sequence lock.
+//
+// The emulation thread calls publish() as often as the readers need fresh data
+// (e.g. once per video frame). It never waits on readers. A reader copies the
+// snapshot and retries if a publish overlapped the copy, so any number of 
+// readers get a consistent view of all three channels without locks. The 
+// snapshot is held as relaxed atomic words, so a torn copy that is about to be
+// discarded is not a data race.
+
+#ifndef _PIT_SNAPSHOT_H
+#define _PIT_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+#include "pit_emulator.h"
+
+struct PitSnapshot {
+  uint64_t cycles;
+  TimerChannelState channel[3];
+};
+
+class PitSnapshotPublisher {
+
+  static_assert(std::is_trivially_copyable<PitSnapshot>::value, "PitSnapshot must be trivially copyable");
+
+  private:
+    static const size_t kWords = (sizeof(PitSnapshot) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    // Odd while a publish is in progress.
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> words[kWords] = {};
+
+  public:
+
+    // Writer. Must only be called from the thread clocking 'pit'.
+    void publish(Pit &pit) {
+      PitSnapshot snap;
+      memset(&snap, 0, sizeof(snap));
+      snap.cycles = pit.getCycles();
+      for(int i = 0; i < 3; i++) {
+        pit.channel[i].getState(snap.channel[i]);
+      }
+
+      uint32_t buf[kWords] = {};
+      memcpy(buf, &snap, sizeof(snap));
+
+      uint32_t seq = sequence.load(std::memory_order_relaxed);
+      sequence.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      for(size_t i = 0; i < kWords; i++) {
+        words[i].store(buf[i], std::memory_order_relaxed);
+      }
+      sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Reader. Copy the latest snapshot into 'out'. Returns false if nothing has been
+    // published yet.
+    bool read(PitSnapshot &out) {
+      uint32_t buf[kWords];
+      uint32_t before, after;
+
+      do {
+        before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+          continue;
+        }
+        for(size_t i = 0; i < kWords; i++) {
+          buf[i] = words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_relaxed);
+      } while ((before & 1) || (before != after));
+
+      if (before == 0) {
+        return false;
+      }
+      memcpy(&out, buf, sizeof(out));
+      return true;
+    }
+
+    // Number of snapshots published so far.
+    uint32_t getGeneration() {
+      return sequence.load(std::memory_order_acquire) / 2;
+    }
+};
+
+#endif
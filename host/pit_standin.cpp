@@ -0,0 +1,218 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Stand-in validator boards on pseudo-terminals, for exercising pit_orchestrate
+// and anything else that talks to serial_server() without hardware.
+//
+//   pit_standin [options] [-- command...]
+//     --boards <n>       virtual boards to create (default 4)
+//     --dir <path>       directory for the board links ttyPIT0..ttyPIT<n-1> (default /tmp/pit_standin)
+//     --8254             boards carry an 8254 instead of an 8253
+//     --fault-rate <p>   chance, after each request, that a board goes silent (default 0)
+//     --fault-ms <ms>    how long a silent board stays down (default 3000)
+//     --seed <n>         seed for the fault rolls (default 1)
+//     --quiet            boards send only responses, without the sketch's text
+//
+// Each board is a child process running the sketch's own serial_server() on the
+// master side of a pseudo-terminal, with the mock chip (mock_8253.h) in place of
+// the PIT, so it speaks exactly the protocol the sketch does and answers as the
+// emulator would. A board that goes silent drops everything sent to it while it
+// is down and comes back as a freshly powered board, as an Uno does after a
+// reset. With a command, it is run once the boards are up and the boards are
+// shut down when it exits; otherwise they run until interrupted.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -fpermissive -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_standin.cpp
+//     host/mock_8253.cpp host/host_arduino.cpp sketches/validate/arduino_8253.cpp sketches/validate/capture.cpp
+//     sketches/validate/lib.cpp sketches/validate/tests.cpp sketches/validate/test_program.cpp
+//     sketches/validate/test_programs.cpp sketches/validate/validator.cpp sketches/validate/serial_server.cpp
+//     -o pit_standin
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mock_8253.h"
+#include "serial_server.h"
+
+// Globals the sketch file defines on the board.
+PitType pit_type = kModel8253;
+Pit emu = Pit(pit_type);
+unsigned long pit_cps = 0;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int) {
+  stopping = 1;
+}
+
+// The board's main loop, in the child process. Never returns.
+static void run_board(int master, uint32_t seed, double fault_rate, unsigned long fault_ms, bool quiet) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> roll(0.0, 1.0);
+
+  Serial.fd = master;
+  Serial.quiet = quiet;
+
+  while(true) {
+    Mock8253 board(pit_type);
+    board.attach();
+    emu = Pit(pit_type);
+    mprintf(F("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"));
+    mprintf(F("Serial server ready.\n"));
+
+    while(!(serial_server_poll() && fault_rate > 0 && roll(rng) < fault_rate)) {
+    }
+
+    // Go silent, then come back up with nothing received while down.
+    board.detach();
+    usleep(fault_ms * 1000);
+    tcflush(master, TCIFLUSH);
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned boards = 4;
+  std::string dir = "/tmp/pit_standin";
+  double fault_rate = 0.0;
+  unsigned long fault_ms = 3000;
+  uint32_t seed = 1;
+  bool quiet = false;
+  char **command = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--boards") == 0 && i + 1 < argc) {
+      boards = (unsigned)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+      dir = argv[++i];
+    }
+    else if(strcmp(argv[i], "--8254") == 0) {
+      pit_type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--fault-rate") == 0 && i + 1 < argc) {
+      fault_rate = atof(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--fault-ms") == 0 && i + 1 < argc) {
+      fault_ms = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--quiet") == 0) {
+      quiet = true;
+    }
+    else if(strcmp(argv[i], "--") == 0 && i + 1 < argc) {
+      command = &argv[i + 1];
+      break;
+    }
+    else {
+      fprintf(stderr, "usage: %s [--boards n] [--dir path] [--8254] [--fault-rate p] [--fault-ms ms] [--seed n] "
+        "[--quiet] [-- command...]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  mkdir(dir.c_str(), 0755);
+
+  std::vector<pid_t> children;
+  std::vector<std::string> links;
+  std::vector<int> slaves;
+
+  for(unsigned b = 0; b < boards; b++) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+      perror("posix_openpt");
+      return 1;
+    }
+
+    // Hold the slave open in raw mode, so settings survive between users and the
+    // master never sees a hangup.
+    const char *slave_name = ptsname(master);
+    int slave = open(slave_name, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if(slave < 0 || tcgetattr(slave, &tio) != 0) {
+      perror(slave_name);
+      return 1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    slaves.push_back(slave);
+
+    std::string link = dir + "/ttyPIT" + std::to_string(b);
+    unlink(link.c_str());
+    if(symlink(slave_name, link.c_str()) != 0) {
+      perror(link.c_str());
+      return 1;
+    }
+    links.push_back(link);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+      run_board(master, seed + b, fault_rate, fault_ms, quiet);
+    }
+    close(master);
+    children.push_back(pid);
+  }
+
+  fprintf(stderr, "%u %s board%s in %s\n", boards, pit_type == kModel8254 ? "8254" : "8253", boards == 1 ? "" : "s",
+    dir.c_str());
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  int status = 0;
+  if(command) {
+    pid_t pid = fork();
+    if(pid == 0) {
+      execvp(command[0], command);
+      perror(command[0]);
+      _exit(127);
+    }
+    int wstatus = 0;
+    while(waitpid(pid, &wstatus, 0) < 0 && !stopping) {
+    }
+    status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 1;
+  }
+  else {
+    while(!stopping) {
+      pause();
+    }
+  }
+
+  for(pid_t pid : children) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+  for(const std::string &link : links) {
+    unlink(link.c_str());
+  }
+  return status;
+}
@@ -0,0 +1,111 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Export an emulator run of an op script as a VCD waveform.
+//
+//   pit_vcd [--8254] [--interval <ticks>] [--ns <ns per tick>] <script> <out.vcd>
+//
+// The script is in the format read by pit_minimize; '-' reads it from stdin.
+// Output edges are exact; the counting element and timer state are sampled
+// after each op and every --interval ticks (default 65536, 1 for every tick).
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/pit_vcd.cpp host/host_arduino.cpp
+//     sketches/validate/lib.cpp -o pit_vcd
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pit_oracle.h"
+#include "pit_vcd.h"
+
+int main(int argc, char **argv) {
+  PitType type = kModel8253;
+  unsigned long interval = VCD_SAMPLE_INTERVAL;
+  unsigned long ns = VCD_NS_PER_TICK;
+  const char *paths[2] = { NULL, NULL };
+  int n_paths = 0;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--8254") == 0) {
+      type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+      interval = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--ns") == 0 && i + 1 < argc) {
+      ns = strtoul(argv[++i], NULL, 0);
+    }
+    else if(n_paths < 2 && (argv[i][0] != '-' || argv[i][1] == 0)) {
+      paths[n_paths++] = argv[i];
+    }
+    else {
+      n_paths = 0;
+      break;
+    }
+  }
+  if(n_paths != 2) {
+    fprintf(stderr, "usage: %s [--8254] [--interval ticks] [--ns ns_per_tick] <script> <out.vcd>\n", argv[0]);
+    return 2;
+  }
+
+  FILE *in = strcmp(paths[0], "-") == 0 ? stdin : fopen(paths[0], "r");
+  if(!in) {
+    perror(paths[0]);
+    return 1;
+  }
+  OpSequence ops;
+  bool ok = read_ops(in, ops);
+  if(in != stdin) {
+    fclose(in);
+  }
+  if(!ok) {
+    return 1;
+  }
+
+  FILE *out = fopen(paths[1], "wb");
+  if(!out) {
+    perror(paths[1]);
+    return 1;
+  }
+
+  Pit pit(type);
+  PitOpResult result;
+  PitVcdWriter vcd(out);
+  vcd.setSampleInterval(interval);
+  vcd.setNsPerTick(ns);
+  vcd.begin(pit);
+
+  for(const PitOp &op : ops) {
+    if(op.op == Tick) {
+      vcd.run(op.arg);
+    }
+    else {
+      apply_op(pit, op, result);
+      vcd.sample();
+    }
+  }
+  vcd.finish();
+  fclose(out);
+
+  fprintf(stderr, "%lu ops, %llu ticks\n", (unsigned long)ops.size(), pit.getCycles());
+  return 0;
+}
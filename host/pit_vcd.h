@@ -0,0 +1,288 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Streaming VCD export of an emulated PIT, for viewing runs in a waveform viewer
+// such as GTKWave. Only value changes are written:
+//
+//   outN    channel output, at the exact tick of every edge (from the output handler)
+//   gateN   gate input, sampled at each sample() call
+//   ceN     counting element, a 16-bit vector
+//   stateN  TimerState, a 3-bit vector; the values are listed in the header
+//
+// The counting element and timer state change on nearly every tick, so writing
+// them per tick would cost as much as the emulation. Instead they are sampled
+// at each sample() and every 'interval' ticks within run(), which clocks the PIT
+// in batches between samples. An interval of 1 gives an exact trace at per-tick
+// cost. Output is collected in a large buffer and written out in blocks.
+//
+//   PitVcdWriter vcd(file);
+//   vcd.begin(pit);
+//   pit.ioWrite(...); vcd.sample();    // after each bus op or gate change
+//   vcd.run(1000000);                  // instead of pit.run()
+//   vcd.finish();
+
+#ifndef _PIT_VCD_H
+#define _PIT_VCD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "pit_emulator.h"
+
+#define VCD_BUFFER_BYTES (4 << 20)
+#define VCD_SAMPLE_INTERVAL 65536
+#define VCD_NS_PER_TICK 838
+
+class PitVcdWriter {
+
+  private:
+    struct PendingEdge {
+      unsigned long long ticks;
+      u8 channel;
+      bool level;
+
+      bool operator<(const PendingEdge &other) const {
+        return ticks < other.ticks || (ticks == other.ticks && channel < other.channel);
+      }
+    };
+
+    enum Signal {
+      kOut,
+      kGate,
+      kCe,
+      kState,
+      kNumSignals
+    };
+
+    FILE *out;
+    Pit *pit;
+    std::vector<char> buffer;
+    size_t used;
+    std::vector<PendingEdge> pending;
+    unsigned long interval;
+    unsigned long ns_per_tick;
+    unsigned long long last_time;
+    bool have_time;
+
+    // Last written value of each signal, or -1 if none yet.
+    long last[3][kNumSignals];
+
+    static void onOutput(void *context, int channel, bool level, unsigned long long ticks) {
+      PitVcdWriter *self = static_cast<PitVcdWriter *>(context);
+      self->pending.push_back({ ticks, (u8)channel, level });
+    }
+
+    static char idCode(int c, Signal signal) {
+      return (char)('!' + c * kNumSignals + signal);
+    }
+
+    void flush() {
+      if(used) {
+        fwrite(buffer.data(), 1, used, out);
+        used = 0;
+      }
+    }
+
+    // Make room for one record. No record is longer than this.
+    void reserve() {
+      if(buffer.size() - used < 64) {
+        flush();
+      }
+    }
+
+    void putChar(char ch) {
+      buffer[used++] = ch;
+    }
+
+    void putDecimal(unsigned long long value) {
+      char digits[20];
+      int n = 0;
+      do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+      } while(value);
+      while(n) {
+        buffer[used++] = digits[--n];
+      }
+    }
+
+    void putTime(unsigned long long ticks) {
+      if(have_time && ticks == last_time) {
+        return;
+      }
+      reserve();
+      putChar('#');
+      putDecimal(ticks * ns_per_tick);
+      putChar('\n');
+      last_time = ticks;
+      have_time = true;
+    }
+
+    void putScalar(int c, Signal signal, bool value) {
+      reserve();
+      putChar(value ? '1' : '0');
+      putChar(idCode(c, signal));
+      putChar('\n');
+      last[c][signal] = value;
+    }
+
+    void putVector(int c, Signal signal, unsigned long value, int bits) {
+      reserve();
+      putChar('b');
+      // Leading zeros may be left out of a vector value.
+      int top = bits - 1;
+      while(top > 0 && !(value & (1ul << top))) {
+        top--;
+      }
+      for(int i = top; i >= 0; i--) {
+        putChar((value >> i) & 1 ? '1' : '0');
+      }
+      putChar(' ');
+      putChar(idCode(c, signal));
+      putChar('\n');
+      last[c][signal] = (long)value;
+    }
+
+    // Write the edges gathered from the output handlers in time order. Each channel
+    // runs a whole batch in turn, so their edges arrive grouped by channel.
+    void writeEdges() {
+      std::sort(pending.begin(), pending.end());
+      for(const PendingEdge &edge : pending) {
+        if(last[edge.channel][kOut] != edge.level) {
+          putTime(edge.ticks);
+          putScalar(edge.channel, kOut, edge.level);
+        }
+      }
+      pending.clear();
+    }
+
+    void writeChanges(unsigned long long time) {
+      for(int c = 0; c < 3; c++) {
+        TimerChannel &ch = pit->channel[c];
+
+        if(last[c][kOut] != ch.getOutput()) {
+          putTime(time);
+          putScalar(c, kOut, ch.getOutput());
+        }
+        if(last[c][kGate] != ch.getGate()) {
+          putTime(time);
+          putScalar(c, kGate, ch.getGate());
+        }
+        if(last[c][kCe] != ch.getCountingElement()) {
+          putTime(time);
+          putVector(c, kCe, ch.getCountingElement(), 16);
+        }
+        if(last[c][kState] != ch.getTimerState()) {
+          putTime(time);
+          putVector(c, kState, ch.getTimerState(), 3);
+        }
+      }
+    }
+
+  public:
+    PitVcdWriter(FILE *out, size_t buffer_bytes = VCD_BUFFER_BYTES) :
+      out(out), pit(0), buffer(std::max(buffer_bytes, (size_t)256)), used(0), interval(VCD_SAMPLE_INTERVAL),
+      ns_per_tick(VCD_NS_PER_TICK), last_time(0), have_time(false) {}
+
+    ~PitVcdWriter() {
+      if(pit) {
+        finish();
+      }
+    }
+
+    // Ticks between samples of the counting element and timer state within run().
+    void setSampleInterval(unsigned long ticks) {
+      interval = ticks ? ticks : 1;
+    }
+
+    // Time units are nanoseconds. The default is one 1.193182 MHz PC clock per tick.
+    void setNsPerTick(unsigned long ns) {
+      ns_per_tick = ns ? ns : 1;
+    }
+
+    // Write the header and initial values, and start collecting output edges.
+    void begin(Pit &p) {
+      static const char *signal_names[] = { "out", "gate", "ce", "state" };
+      static const int signal_bits[] = { 1, 1, 16, 3 };
+
+      pit = &p;
+      memset(last, 0xFF, sizeof last);
+      have_time = false;
+
+      fprintf(out, "$comment arduino_8253 emulator $end\n");
+      fprintf(out, "$comment state: 0 WaitingForReload 1 WaitingForGate 2 WaitingForLoadCycle "
+        "3 WaitingForLoadTrigger 4 ReloadNextCycle 5 GateTriggeredReload 6 Counting 7 CountingTriggered $end\n");
+      fprintf(out, "$timescale 1ns $end\n");
+      fprintf(out, "$scope module pit $end\n");
+      for(int c = 0; c < 3; c++) {
+        for(int s = 0; s < kNumSignals; s++) {
+          fprintf(out, "$var %s %d %c %s%d $end\n", s < kCe ? "wire" : "reg", signal_bits[s],
+            idCode(c, (Signal)s), signal_names[s], c);
+        }
+      }
+      fprintf(out, "$upscope $end\n");
+      fprintf(out, "$enddefinitions $end\n");
+
+      for(int c = 0; c < 3; c++) {
+        pit->channel[c].setOutputHandler(&onOutput, this);
+      }
+      pending.clear();
+      writeChanges(pit->getCycles());
+    }
+
+    // Write any changes since the last sample, e.g. after a bus op or gate change.
+    void sample() {
+      writeEdges();
+      writeChanges(pit->getCycles());
+    }
+
+    // Clock the PIT, sampling every 'interval' ticks. Returns the ticks run, which is
+    // less than 'ticks' only if a watchpoint stopped the PIT.
+    unsigned long run(unsigned long ticks) {
+      unsigned long done = 0;
+      while(done < ticks) {
+        unsigned long batch = std::min(ticks - done, interval);
+        unsigned long ran = pit->run(batch);
+        done += ran;
+        sample();
+        if(ran < batch) {
+          break;
+        }
+      }
+      return done;
+    }
+
+    // Write the final timestamp, flush and detach from the PIT.
+    void finish() {
+      sample();
+      putTime(pit->getCycles());
+      flush();
+      fflush(out);
+      for(int c = 0; c < 3; c++) {
+        pit->channel[c].setOutputHandler(0, 0);
+      }
+      pit = 0;
+    }
+};
+
+#endif // _PIT_VCD_H
@@ -0,0 +1,217 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Round-trip check of the rewind buffer (pit_rewind.h).
+//
+//   rewind_check [--8254] [--seed <n>] [--frames <n>]
+//
+// A Pit is driven by random fuzzer ops on all three channels and pushed as a
+// frame after every few ops, while a plain copy of the Pit is kept for every
+// frame. At random points a held frame is restored into another Pit and checked
+// against its copy, both by state and by running the same random ops on each
+// and comparing their reads and outputs. Frames older than the oldest held one,
+// or not yet pushed, must fail to restore. Now and then the timeline is rewound
+// to a random frame with rewindTo() and continued from there.
+//
+// It runs with a small arena, so that frames are dropped for space, and with a
+// small record ring, so that they are dropped for descriptors.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DDEBUG_EMU=0 -Ihost -Isketches/validate host/rewind_check.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o rewind_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "pit_oracle.h"
+#include "pit_rewind.h"
+
+// Ops run on both the restored Pit and its copy.
+#define CHECK_OPS 20
+
+static bool same_state(Pit &a, Pit &b) {
+  PitState sa, sb;
+  memset(&sa, 0, sizeof(sa));
+  memset(&sb, 0, sizeof(sb));
+  a.getState(sa);
+  b.getState(sb);
+  return memcmp(&sa, &sb, sizeof(sa)) == 0;
+}
+
+struct OpSource {
+  std::mt19937 rng;
+  bool gate[3] = { false, false, false };
+
+  OpSource(uint32_t seed) : rng(seed) {
+  }
+
+  // As the fuzzer, but with shorter tick bursts, so that frames differ by a few
+  // counts rather than by whole count cycles.
+  PitOp next() {
+    u8 chan = (u8)(rng() % 3);
+    PitOp op = fuzz_op(rng, chan, gate[chan]);
+    if(op.op == Tick) {
+      op.arg %= 1000;
+    }
+    return op;
+  }
+};
+
+// Restore 'frame' and check it against the copy kept when it was pushed.
+template <typename Buffer>
+static bool check_frame(Buffer &buffer, uint64_t frame, Pit &copy, PitType type, std::mt19937 &rng) {
+  Pit restored(type);
+  if(!buffer.restore(frame, restored)) {
+    fprintf(stderr, "frame %llu is held but did not restore. ", (unsigned long long)frame);
+    return false;
+  }
+  if(!same_state(restored, copy)) {
+    fprintf(stderr, "frame %llu restored to a different state. ", (unsigned long long)frame);
+    return false;
+  }
+
+  Pit expected = copy;
+  OpSource ops(rng());
+  for(int i = 0; i < CHECK_OPS; i++) {
+    PitOp op = ops.next();
+    PitOpResult a, b;
+    apply_op(restored, op, a);
+    apply_op(expected, op, b);
+    if(a.byte != b.byte || a.outputs != b.outputs) {
+      fprintf(stderr, "frame %llu diverges from its copy %d ops after restoring. ", (unsigned long long)frame, i);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <size_t ArenaBytes, size_t MaxFrames>
+static bool run_case(const char *name, PitType type, uint32_t seed, uint64_t frames, unsigned key_interval) {
+  std::unique_ptr<PitRewindBuffer<ArenaBytes, MaxFrames>> owner(
+    new PitRewindBuffer<ArenaBytes, MaxFrames>(key_interval));
+  PitRewindBuffer<ArenaBytes, MaxFrames> &buffer = *owner;
+
+  std::mt19937 rng(seed);
+  OpSource source(seed + 1);
+  Pit pit(type);
+  std::vector<Pit> history;   // history[frame] is the Pit as it was pushed
+  unsigned long restores = 0;
+  unsigned long rewinds = 0;
+  bool ok = true;
+
+  for(uint64_t n = 0; n < frames && ok; n++) {
+    unsigned steps = 1 + rng() % 4;
+    for(unsigned i = 0; i < steps; i++) {
+      PitOpResult result;
+      apply_op(pit, source.next(), result);
+    }
+
+    uint64_t frame = buffer.push(pit);
+    if(frame != history.size()) {
+      fprintf(stderr, "pushed frame %llu, expected %lu. ", (unsigned long long)frame, (unsigned long)history.size());
+      ok = false;
+      break;
+    }
+    history.push_back(pit);
+
+    uint64_t oldest = buffer.getOldestFrame();
+    uint64_t next = buffer.getNextFrame();
+    if(next != history.size() || oldest >= next || buffer.getStoredBytes() > ArenaBytes) {
+      fprintf(stderr, "frame range %llu..%llu is wrong after pushing frame %llu. ", (unsigned long long)oldest,
+              (unsigned long long)next, (unsigned long long)frame);
+      ok = false;
+      break;
+    }
+
+    if(rng() % 8 == 0) {
+      uint64_t pick = oldest + rng() % (next - oldest);
+      ok = check_frame(buffer, pick, history[pick], type, rng);
+      restores++;
+
+      Pit scratch(type);
+      if(ok && ((oldest > 0 && buffer.restore(oldest - 1, scratch)) || buffer.restore(next, scratch))) {
+        fprintf(stderr, "a frame outside %llu..%llu restored. ", (unsigned long long)oldest, 
+                (unsigned long long)next);
+        ok = false;
+      }
+    }
+
+    if(ok && rng() % 200 == 0) {
+      // Go back in time and continue from there.
+      uint64_t pick = oldest + rng() % (next - oldest);
+      if(!buffer.rewindTo(pick, pit) || !same_state(pit, history[pick])) {
+        fprintf(stderr, "rewinding to frame %llu failed. ", (unsigned long long)pick);
+        ok = false;
+      }
+      history.erase(history.begin() + (size_t)pick + 1, history.end());
+      if(buffer.getNextFrame() != pick + 1) {
+        fprintf(stderr, "next frame is %llu after rewinding to %llu. ", (unsigned long long)buffer.getNextFrame(), 
+                (unsigned long long)pick);
+        ok = false;
+      }
+      rewinds++;
+    }
+  }
+
+  // Every frame still held must restore.
+  for(uint64_t f = buffer.getOldestFrame(); ok && f < buffer.getNextFrame(); f++) {
+    ok = check_frame(buffer, f, history[f], type, rng);
+  }
+
+  fprintf(stderr, "%s: %lu restores, %lu rewinds, frames %llu..%llu held in %lu bytes: %s\n", name, restores, 
+          rewinds, (unsigned long long)buffer.getOldestFrame(), (unsigned long long)buffer.getNextFrame(), 
+          (unsigned long)buffer.getStoredBytes(), ok ? "pass" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  PitType type = kModel8253;
+  uint32_t seed = 1;
+  uint64_t frames = 20000;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--8254") == 0) {
+      type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = strtoull(argv[++i], NULL, 0);
+    }
+    else {
+      fprintf(stderr, "usage: %s [--8254] [--seed n] [--frames n]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  int failed = 0;
+  failed += !run_case<16384, 4096>("small arena", type, seed, frames, 8);
+  failed += !run_case<1 << 20, 100>("small ring", type, seed, frames, 16);
+  failed += !run_case<65536, 1024>("keyframes only", type, seed, frames, 1);
+
+  fprintf(stderr, "%d of 3 failed\n", failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+
+// Threaded check of the snapshot publisher (pit_snapshot.h).
+//
+//   snapshot_check [--8254] [--seed <n>] [--publishes <n>] [--readers <n>]
+//
+// A writer thread clocks a Pit with all three channels counting, in random 
+// bursts, and publishes a snapshot after each. Reader threads read snapshots as 
+// fast as they can. The writer only clocks the Pit, so its state is a function
+// of the cycle count alone: each reader keeps its own Pit, advances it to the
+// snapshot's cycle count, and checks that all three channels match it exactly.
+// A snapshot torn between two publishes fails that comparison. Readers also
+// check that snapshots never go back in time.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -DDEBUG_EMU=0 -Ihost -Isketches/validate host/snapshot_check.cpp
+//     host/host_arduino.cpp sketches/validate/lib.cpp -o snapshot_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "pit_snapshot.h"
+#include "pit_oracle.h"
+
+static const u16 channel_count[3] = { 7, 1000, 4 };
+static const TimerMode channel_mode[3] = { kRateGenerator, kSquareWaveGenerator, kInterruptOnTerminalCount };
+
+struct ReaderStats {
+  uint64_t reads = 0;
+  uint64_t distinct = 0;
+  uint64_t torn = 0;
+  uint64_t backwards = 0;
+};
+
+static void reader(PitType type, PitSnapshotPublisher &publisher, std::atomic<bool> &done, ReaderStats &stats) {
+  Pit ref(type);
+  setup_pit(ref, channel_count, channel_mode);
+  uint64_t last = 0;
+  bool any = false;
+
+  while(!done.load(std::memory_order_acquire)) {
+    PitSnapshot snap;
+    if(!publisher.read(snap)) {
+      continue;
+    }
+    stats.reads++;
+
+    if(any && snap.cycles < last) {
+      stats.backwards++;
+      continue;
+    }
+    if(any && snap.cycles == last) {
+      continue;
+    }
+    any = true;
+    last = snap.cycles;
+    stats.distinct++;
+
+    ref.run((unsigned long)(snap.cycles - ref.getCycles()));
+    for(int i = 0; i < 3; i++) {
+      TimerChannelState expected;
+      memset(&expected, 0, sizeof(expected));
+      ref.channel[i].getState(expected);
+      if(memcmp(&expected, &snap.channel[i], sizeof(expected)) != 0) {
+        stats.torn++;
+        break;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  PitType type = kModel8253;
+  uint32_t seed = 1;
+  unsigned long publishes = 200000;
+  unsigned readers = 3;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--8254") == 0) {
+      type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--publishes") == 0 && i + 1 < argc) {
+      publishes = strtoul(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+      readers = (unsigned)atoi(argv[++i]);
+    }
+    else {
+      fprintf(stderr, "usage: %s [--8254] [--seed n] [--publishes n] [--readers n]\n", argv[0]);
+      return 2;
+    }
+  }
+  if(readers == 0) {
+    readers = 1;
+  }
+
+  PitSnapshotPublisher publisher;
+  std::atomic<bool> done{false};
+  std::vector<ReaderStats> stats(readers);
+  std::vector<std::thread> pool;
+
+  for(unsigned r = 0; r < readers; r++) {
+    pool.emplace_back(reader, type, std::ref(publisher), std::ref(done), std::ref(stats[r]));
+  }
+
+  Pit pit(type);
+  setup_pit(pit, channel_count, channel_mode);
+  std::mt19937 rng(seed);
+  for(unsigned long p = 0; p < publishes; p++) {
+    pit.run(1 + rng() % 500);
+    publisher.publish(pit);
+  }
+  done.store(true, std::memory_order_release);
+
+  for(std::thread &t : pool) {
+    t.join();
+  }
+
+  int failed = 0;
+  for(unsigned r = 0; r < readers; r++) {
+    const ReaderStats &s = stats[r];
+    bool ok = !s.torn && !s.backwards;
+    fprintf(stderr, "reader %u: %llu reads, %llu distinct snapshots", r, (unsigned long long)s.reads, 
+            (unsigned long long)s.distinct);
+    if(s.torn) {
+      fprintf(stderr, ", %llu inconsistent", (unsigned long long)s.torn);
+    }
+    if(s.backwards) {
+      fprintf(stderr, ", %llu older than one already read", (unsigned long long)s.backwards);
+    }
+    fprintf(stderr, ": %s\n", ok ? "pass" : "FAIL");
+    failed += !ok;
+  }
+
+  if(publisher.getGeneration() != publishes) {
+    fprintf(stderr, "generation %u after %lu publishes: FAIL\n", (unsigned)publisher.getGeneration(), publishes);
+    failed++;
+  }
+
+  fprintf(stderr, "%d of %u readers failed\n", failed, readers);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Run the sketch's scripted tests natively, against the mock chip.
+//
+//   test_runner [--8254] [--mock 8253|8254] [--quiet] [--program <file>] [test...]
+//
+// The sketch's test code, validator and bus code run unmodified, with the mock
+// chip (mock_8253.h) standing in for the real PIT. --8254 selects the emulator
+// model under test; the mock chip is the same model unless --mock says otherwise.
+// With no tests named, all are run: mode0 mode1 mode2 mode3 mode4 mode5 bcd rw
+// reload_lsb. --program runs a test program from a binary file instead, as
+// test_program_serial() would receive it without the length prefix.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -fpermissive -DDEBUG_EMU=0 -Ihost -Isketches/validate host/test_runner.cpp
+//     host/mock_8253.cpp host/host_arduino.cpp sketches/validate/arduino_8253.cpp sketches/validate/capture.cpp
+//     sketches/validate/lib.cpp sketches/validate/tests.cpp sketches/validate/test_program.cpp
+//     sketches/validate/test_programs.cpp sketches/validate/validator.cpp -o test_runner
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "mock_8253.h"
+#include "test_program.h"
+#include "validate.h"
+
+// Globals the sketch file defines on the board.
+PitType pit_type = kModel8253;
+Pit emu = Pit(pit_type);
+unsigned long pit_cps = 0;
+
+struct NamedTest {
+  const char *name;
+  bool (*run)();
+};
+
+static const NamedTest tests[] = {
+  { "mode0", test_mode0 },
+  { "mode1", test_mode1 },
+  { "mode2", test_mode2 },
+  { "mode3", test_mode3 },
+  { "mode4", test_mode4 },
+  { "mode5", test_mode5 },
+  { "bcd", test_bcd },
+  { "rw", test_rw },
+  { "reload_lsb", test_reload_lsb },
+};
+
+#define NUM_TESTS (sizeof tests / sizeof tests[0])
+
+static bool run_program_file(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if(!f) {
+    perror(path);
+    return false;
+  }
+  std::vector<u8> program;
+  int c;
+  while((c = fgetc(f)) != EOF) {
+    program.push_back((u8)c);
+  }
+  fclose(f);
+
+  if(program.empty()) {
+    fprintf(stderr, "%s: empty program\n", path);
+    return false;
+  }
+  return run_test_program(program.data(), false, (unsigned int)program.size());
+}
+
+int main(int argc, char **argv) {
+  PitType mock_type = kModel8253;
+  bool mock_set = false;
+  bool quiet = false;
+  const char *program_path = NULL;
+  std::vector<const NamedTest *> selected;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--8254") == 0) {
+      pit_type = kModel8254;
+    }
+    else if(strcmp(argv[i], "--mock") == 0 && i + 1 < argc) {
+      mock_type = strcmp(argv[++i], "8254") == 0 ? kModel8254 : kModel8253;
+      mock_set = true;
+    }
+    else if(strcmp(argv[i], "--quiet") == 0) {
+      quiet = true;
+    }
+    else if(strcmp(argv[i], "--program") == 0 && i + 1 < argc) {
+      program_path = argv[++i];
+    }
+    else {
+      const NamedTest *found = NULL;
+      for(size_t t = 0; t < NUM_TESTS; t++) {
+        if(strcmp(argv[i], tests[t].name) == 0) {
+          found = &tests[t];
+        }
+      }
+      if(!found) {
+        fprintf(stderr, "usage: %s [--8254] [--mock 8253|8254] [--quiet] [--program file] [test...]\n", argv[0]);
+        return 2;
+      }
+      selected.push_back(found);
+    }
+  }
+
+  if(!mock_set) {
+    mock_type = pit_type;
+  }
+  if(selected.empty() && !program_path) {
+    for(size_t t = 0; t < NUM_TESTS; t++) {
+      selected.push_back(&tests[t]);
+    }
+  }
+
+  Mock8253 board(mock_type);
+  board.attach();
+  emu = Pit(pit_type);
+  Serial.quiet = quiet;
+
+  int failed = 0;
+  if(program_path) {
+    bool ok = run_program_file(program_path);
+    fprintf(stderr, "%-12s %s\n", program_path, ok ? "pass" : "FAIL");
+    failed += !ok;
+  }
+  for(const NamedTest *test : selected) {
+    bool ok = test->run();
+    fprintf(stderr, "%-12s %s\n", test->name, ok ? "pass" : "FAIL");
+    failed += !ok;
+  }
+
+  board.detach();
+  fprintf(stderr, "%d of %d failed\n", failed, (int)selected.size() + (program_path ? 1 : 0));
+  return failed ? 1 : 0;
+}
@@ -21,6 +21,8 @@
 
 unsigned long ticks = 0;
 
+bus_timing_t bus_timing = { PIN_CHANGE_DELAY, BUS_READ_DELAY, BUS_WRITE_DELAY };
+
 // Tick the PIT.
 void pit_clock_tick() {
   //Serial.println(" ** tick **");
@@ -152,20 +154,21 @@ u16 pit_read_counter(u8 channel, pit_access access) {
 }
 
 // Set the status of the gate input for the specified timer channel.
+// Returns false if the channel's gate is not connected.
 bool pit_set_gate(u8 channel, bool state) {
 
   switch (channel) {
     case 0:
       //SET_G0(state);
-      break;
+      return false;
     case 1:
       //SET_G1(state);
-      break;
+      return false;
     case 2:
       SET_G2(state);
-      break;
+      return true;
     default:
-      break;
+      return false;
   }
 }
 
@@ -186,6 +189,11 @@ bool pit_get_output(u8 channel) {
   }
 }
 
+// Read all three outputs at once, with OUT0 in bit 0.
+u8 pit_get_outputs() {
+  return READ_OUTPUTS;
+}
+
 // Read a byte value from the specified port enum.
 u8 pit_read_port(pit_port port) {
   pit_set_address(port);
@@ -212,7 +220,7 @@ u8 pit_read_data_bus() {
   PORTD |= ~0x03; // Leave RX/TX alone
   PORTB |= 0x03; // Set LO 2 bits.  
 
-  delayMicroseconds(BUS_READ_DELAY);
+  delayMicroseconds(bus_timing.bus_read);
 
   // Read HO 6 bits from PIND and LO 2 bits from PINB
   byte = (PIND & ~0x03) | (PINB & 0x03);
@@ -248,7 +256,7 @@ void pit_write_data_bus(u8 byte) {
   PORTB = (byte & 0x03) | (PORTB & 0xFC);
 
   // A delay of 4us seems important for the validator to work.
-  delayMicroseconds(BUS_WRITE_DELAY);
+  delayMicroseconds(bus_timing.bus_write);
   pit_set_pasv();
 
   // Reset the bus
@@ -291,5 +299,5 @@ void pit_set_address(pit_port port) {
 
   assert(((PORTB >> 2) & 0x03) == (u8)port);
 
-  delayMicroseconds(PIN_CHANGE_DELAY);
+  delayMicroseconds(bus_timing.pin_change);
 }
@@ -30,9 +30,6 @@
 #define DEBUG_READ 1
 #define DEBUG_WRITE 1
 
-typedef unsigned char u8;
-typedef short unsigned int u16;
-
 typedef enum {
   DATA0 = 0,
   DATA1 = 1,
@@ -72,6 +69,17 @@ typedef enum {
 #define BUS_READ_DELAY 4
 #define BUS_WRITE_DELAY 4
 
+// The bus delays in use, in microseconds. They start at the defaults above, and
+// bus_timing_load() replaces them with a board's calibrated values if any are
+// stored (see calibrate.h).
+typedef struct {
+  u8 pin_change;
+  u8 bus_read;
+  u8 bus_write;
+} bus_timing_t;
+
+extern bus_timing_t bus_timing;
+
 // ----------------------------- GPIO PINS ----------------------------------//
 #define BIT7 0x80
 #define BIT6 0x40
@@ -118,6 +126,8 @@ const int WR_PIN = 18;
 #define READ_OUT0 ((PINC & BIT0) != 0)
 #define READ_OUT1 ((PINC & BIT1) != 0)
 #define READ_OUT2 ((PINC & BIT2) != 0)
+// All three outputs in one port read, as a mask with OUT0 in bit 0
+#define READ_OUTPUTS (PINC & (BIT0 | BIT1 | BIT2))
 
 // The three gate input pins for each timer channel (Only Gate #2 currently connected...)
 //#define SET_G0_LOW (PORTB &= ~BIT2)
@@ -134,6 +144,10 @@ const int WR_PIN = 18;
 
 //#define SET_GATES(x) (PORTB = ((PORTB & ~0x1C) | ((x<<2) & 0x1C)))
 
+// Gates 0 and 1 are not driven by the Arduino. This is the level they are strapped to
+// on the board, so the emulator can be set to match.
+#define GATE01_STRAP true
+
 // All initial output pins, used to set pin direction on setup
 const int OUTPUT_PINS[] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,17,18,19};
 
@@ -153,6 +167,7 @@ void pit_set_latch(int counter);
 void pit_write_counter(u8 channel, pit_access access, u16 value);
 bool pit_set_gate(u8 channel, bool state);
 bool pit_get_output(u8 channel);
+u8 pit_get_outputs();
 u8 pit_read_port(pit_port port);
 void pit_write_port(pit_port port, u8 byte);
 u8 pit_read_data_bus();
@@ -0,0 +1,198 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "validate.h"
+#include "calibrate.h"
+#include "pit_emulator.h"
+#include "lib.h"
+
+extern Pit emu;
+extern PitType pit_type;
+
+// Counts loaded by the known-answer sequence. Alternating and split bit patterns,
+// so a data line that has not settled shows up in either byte.
+static const u16 calibrate_patterns[] = { 0x5AA5, 0xA55A, 0xFF00, 0x00FF, 0x1234 };
+
+#define NUM_CALIBRATE_PATTERNS (sizeof calibrate_patterns / sizeof calibrate_patterns[0])
+
+// Clocks between loading a count and latching it.
+#define CALIBRATE_TICKS 3
+
+static u8 bus_timing_checksum(const bus_timing_record_t &rec) {
+  return rec.version + rec.timing.pin_change + rec.timing.bus_read + rec.timing.bus_write;
+}
+
+static void bus_timing_print(const __FlashStringHelper *label, const bus_timing_t &t) {
+  mprintf(label);
+  mprintf(F(" pin change: %u us, read: %u us, write: %u us\n"), t.pin_change, t.bus_read, t.bus_write);
+}
+
+// Replace the bus delays with the values stored in EEPROM, if a valid record is there.
+bool bus_timing_load() {
+  bus_timing_record_t rec;
+  EEPROM.get(BUS_TIMING_EEPROM_ADDR, rec);
+
+  if(rec.magic != BUS_TIMING_MAGIC || rec.version != BUS_TIMING_VERSION || rec.checksum != bus_timing_checksum(rec)) {
+    return false;
+  }
+  bus_timing = rec.timing;
+  bus_timing_print(F("Loaded calibrated bus timing."), bus_timing);
+  return true;
+}
+
+// Store the bus delays in use.
+void bus_timing_save() {
+  bus_timing_record_t rec;
+  rec.magic = BUS_TIMING_MAGIC;
+  rec.version = BUS_TIMING_VERSION;
+  rec.timing = bus_timing;
+  rec.checksum = bus_timing_checksum(rec);
+  EEPROM.put(BUS_TIMING_EEPROM_ADDR, rec);
+}
+
+// Invalidate the stored record, so the defaults are used from the next start.
+void bus_timing_clear() {
+  EEPROM.write(BUS_TIMING_EEPROM_ADDR, 0);
+  EEPROM.write(BUS_TIMING_EEPROM_ADDR + 1, 0);
+}
+
+// Program each channel with each pattern, clock it, then latch and read it back,
+// comparing every byte and the outputs to the emulator. Every access moves the
+// address between the command port and a channel, so all three delays are
+// exercised. Returns false at the first mismatch. The sketch's emulator is reset
+// and used as the reference, as there is no stack to spare for a second Pit.
+static bool calibrate_trial() {
+  emu = Pit(pit_type);
+  emu.setGate(0, GATE01_STRAP);
+  emu.setGate(1, GATE01_STRAP);
+  emu.setGate(2, true);
+  SET_G2_HIGH;
+  pit_reset();
+
+  for(u8 c = 0; c < 3; c++) {
+    u8 mode_byte = build_command_byte(c, LSBMSB, InterruptOnTerminalCount, false);
+    u8 latch_byte = build_command_byte(c, LATCH, InterruptOnTerminalCount, false);
+
+    for(u8 i = 0; i < NUM_CALIBRATE_PATTERNS; i++) {
+      u16 value = calibrate_patterns[i];
+
+      pit_write_port(COMMAND, mode_byte);
+      emu.ioWrite(PIT_COMMAND_PORT, mode_byte);
+      pit_write_port((pit_port)c, (u8)(value & 0xFF));
+      emu.ioWrite(c, (u8)(value & 0xFF));
+      pit_write_port((pit_port)c, (u8)(value >> 8));
+      emu.ioWrite(c, (u8)(value >> 8));
+
+      for(u8 t = 0; t < CALIBRATE_TICKS; t++) {
+        pit_clock_tick();
+        emu.tick();
+      }
+
+      pit_write_port(COMMAND, latch_byte);
+      emu.ioWrite(PIT_COMMAND_PORT, latch_byte);
+
+      for(u8 b = 0; b < 2; b++) {
+        u8 byte = pit_read_port((pit_port)c);
+        u8 expected = emu.ioRead(c);
+        if(byte != expected) {
+          mprintf(F("CALIBRATE: Channel %d read %02X, expected %02X\n"), c, byte, expected);
+          return false;
+        }
+      }
+
+      if(pit_get_outputs() != emu.getOutputs()) {
+        mprintf(F("CALIBRATE: Outputs %X, expected %X\n"), pit_get_outputs(), emu.getOutputs());
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Run the known-answer sequence 'trials' times with the bus delays in use.
+bool calibrate_check(u8 trials) {
+  for(u8 i = 0; i < trials; i++) {
+    if(!calibrate_trial()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static u8 &bus_timing_field(bus_timing_t &t, u8 f) {
+  switch(f) {
+    case 0:
+      return t.pin_change;
+    case 1:
+      return t.bus_read;
+    default:
+      return t.bus_write;
+  }
+}
+
+// Find the lowest reliable value of each bus delay, sweeping one at a time with
+// the others at their defaults. Each is set to that value plus 'margin' us, but
+// never above its default. The combination is checked again before it is stored
+// in EEPROM. Returns false, leaving the defaults in use, if the defaults or the
+// combination fail.
+bool calibrate_bus_timing(u8 margin) {
+  bus_timing_t defaults = { PIN_CHANGE_DELAY, BUS_READ_DELAY, BUS_WRITE_DELAY };
+  bus_timing_t found = defaults;
+
+  mprintf(F("Starting bus timing calibration...\n"));
+  bus_timing = defaults;
+  if(!calibrate_check(CALIBRATE_TRIALS)) {
+    mprintf(F(">>> Known-answer sequence fails at the default timing. %s\n"), FAIL);
+    return false;
+  }
+
+  for(u8 f = 0; f < 3; f++) {
+    u8 &field = bus_timing_field(bus_timing, f);
+    u8 lowest = field;
+
+    while(lowest > 0) {
+      field = lowest - 1;
+      if(!calibrate_check(CALIBRATE_TRIALS)) {
+        break;
+      }
+      lowest = field;
+    }
+    field = bus_timing_field(defaults, f);
+
+    u8 &result = bus_timing_field(found, f);
+    if(lowest + margin < result) {
+      result = lowest + margin;
+    }
+  }
+
+  bus_timing = found;
+  bus_timing_print(F("Calibrated bus timing."), bus_timing);
+  if(!calibrate_check(CALIBRATE_TRIALS)) {
+    mprintf(F(">>> Calibrated timing fails. Keeping defaults. %s\n"), FAIL);
+    bus_timing = defaults;
+    return false;
+  }
+
+  bus_timing_save();
+  mprintf(F(">>> Saved to EEPROM. %s\n"), PASS);
+  return true;
+}
@@ -0,0 +1,61 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Bus timing calibration. The delays the bus code waits after setting the
+// address, after asserting RD and while holding WR (see arduino_8253.h) are set
+// for the slowest board seen. calibrate_bus_timing() sweeps each one down from
+// its default on the attached board, running a known-answer sequence against
+// the emulator at every step, and keeps the lowest value that passed every
+// trial plus a margin. The result is stored in EEPROM, where bus_timing_load()
+// picks it up at the next start.
+
+#ifndef _CALIBRATE_H
+#define _CALIBRATE_H
+
+#include "arduino_8253.h"
+
+// Times the known-answer sequence is run at each step of the sweep.
+#define CALIBRATE_TRIALS 4
+// Microseconds added to the lowest passing delay.
+#define CALIBRATE_MARGIN 1
+
+// EEPROM record, at BUS_TIMING_EEPROM_ADDR:
+//   u16          magic
+//   u8           version
+//   bus_timing_t timing
+//   u8           checksum: sum of the version and timing bytes
+#define BUS_TIMING_EEPROM_ADDR 0
+#define BUS_TIMING_MAGIC 0x8253
+#define BUS_TIMING_VERSION 1
+
+typedef struct {
+  u16 magic;
+  u8 version;
+  bus_timing_t timing;
+  u8 checksum;
+} bus_timing_record_t;
+
+bool bus_timing_load();
+void bus_timing_save();
+void bus_timing_clear();
+bool calibrate_check(u8 trials);
+bool calibrate_bus_timing(u8 margin);
+
+#endif
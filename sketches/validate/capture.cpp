@@ -0,0 +1,101 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "capture.h"
+
+u16 capture_runs[CAPTURE_MAX_RUNS];
+u16 capture_run_count = 0;
+u8 capture_initial_state = 0;
+unsigned long capture_cycles = 0;
+
+// Clock the PIT for up to 'cycles' cycles, recording the output state after each clock.
+// Capture stops early if the run buffer fills. Returns the number of cycles clocked, all 
+// of which are recorded.
+unsigned long capture_outputs(unsigned long cycles) {
+
+  u8 state = READ_OUTPUTS;
+  u8 run_state = state;
+  u16 run_len = 0;
+
+  capture_initial_state = state;
+  capture_run_count = 0;
+  capture_cycles = 0;
+
+  while (capture_cycles < cycles) {
+    pit_clock_tick();
+    state = READ_OUTPUTS;
+    capture_cycles++;
+
+    if (state == run_state && run_len < CAPTURE_MAX_RUN_LEN) {
+      run_len++;
+      continue;
+    }
+
+    if (run_len > 0) {
+      capture_runs[capture_run_count++] = ((u16)run_state << 13) | (run_len - 1);
+    }
+    run_state = state;
+    run_len = 1;
+
+    if (capture_run_count == CAPTURE_MAX_RUNS - 1) {
+      // Only the slot for the current run is left.
+      break;
+    }
+  }
+
+  if (run_len > 0) {
+    capture_runs[capture_run_count++] = ((u16)run_state << 13) | (run_len - 1);
+  }
+
+  return capture_cycles;
+}
+
+u16 capture_get_run_count() {
+  return capture_run_count;
+}
+
+// Send the capture buffer to the host.
+void capture_send() {
+
+  u8 header[CAPTURE_HEADER_LEN - 4];
+  u8 checksum = 0;
+
+  header[0] = (u8)(capture_cycles & 0xFF);
+  header[1] = (u8)((capture_cycles >> 8) & 0xFF);
+  header[2] = (u8)((capture_cycles >> 16) & 0xFF);
+  header[3] = (u8)((capture_cycles >> 24) & 0xFF);
+  header[4] = (u8)(capture_run_count & 0xFF);
+  header[5] = (u8)(capture_run_count >> 8);
+  header[6] = capture_initial_state;
+
+  for (u8 i = 0; i < sizeof header; i++) {
+    checksum += header[i];
+  }
+  for (u16 i = 0; i < capture_run_count; i++) {
+    checksum += (u8)(capture_runs[i] & 0xFF);
+    checksum += (u8)(capture_runs[i] >> 8);
+  }
+
+  Serial.write((const u8 *)CAPTURE_MAGIC, 4);
+  Serial.write(header, sizeof header);
+  // AVR is little-endian, so the run buffer can be sent as is.
+  Serial.write((const u8 *)capture_runs, capture_run_count * sizeof capture_runs[0]);
+  Serial.write(checksum);
+  Serial.flush();
+}
@@ -0,0 +1,53 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include "arduino_8253.h"
+
+// Logic analyzer mode. The PIT is clocked for a number of cycles while the state of all 
+// three outputs is sampled after every clock and run-length encoded into a buffer in SRAM.
+// The buffer is then sent to the host in one binary transfer, instead of printing a line 
+// per check.
+//
+// Each run is a u16: bits 15-13 are the OUT2..OUT0 state, bits 12-0 are the run length - 1.
+// The buffer is the largest block of RAM the sketch has, so it is also where uploaded test
+// programs are stored (test_program.h); the two are never in use at the same time.
+#define CAPTURE_MAX_RUNS 256
+#define CAPTURE_MAX_RUN_LEN 8192
+
+#define CAPTURE_MAGIC "CAP1"
+
+// Transfer format, all integers little-endian:
+//   char[4] magic "CAP1"
+//   u32     cycles captured
+//   u16     run count
+//   u8      output state before the first clock
+//   u16     runs[run count]
+//   u8      checksum: sum of all bytes after the magic
+#define CAPTURE_HEADER_LEN 11
+
+extern u16 capture_runs[CAPTURE_MAX_RUNS];
+
+unsigned long capture_outputs(unsigned long cycles);
+void capture_send();
+u16 capture_get_run_count();
+
+#endif
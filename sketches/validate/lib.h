@@ -21,6 +21,9 @@
 
 #include <Arduino.h>
 
+typedef unsigned char u8;
+typedef short unsigned int u16;
+
 #define MPRINTF_FMT_LEN 128
 #define MPRINTF_BUF_LEN 256
 
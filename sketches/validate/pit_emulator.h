@@ -22,7 +22,33 @@
 
 #include "lib.h"
 
+#ifndef DEBUG_EMU
 #define DEBUG_EMU 1
+#endif
+
+// Per-channel usage counters. Off by default; they cost RAM the sketch can't spare on an Uno.
+#ifndef PIT_TELEMETRY
+#define PIT_TELEMETRY 0
+#endif
+
+#if PIT_TELEMETRY
+  #define TELEMETRY_COUNT(field) (telemetry.field++)
+#else
+  #define TELEMETRY_COUNT(field)
+#endif
+
+// Rolling digest of channel state and output history, for checking two runs for equivalence
+// at checkpoints. Off by default; each output edge costs a few 64-bit multiplies on AVR.
+#ifndef PIT_DIGEST
+#define PIT_DIGEST 0
+#endif
+
+// FNV-1a, as used for op sequence hashes on the host.
+#define PIT_DIGEST_INIT 0xcbf29ce484222325ull
+#define PIT_DIGEST_PRIME 0x100000001b3ull
+
+// Port 3 (A1:A0 = 11) is the mode/command port. Ports 0-2 are the channel data ports.
+#define PIT_COMMAND_PORT 3
 
 enum PitType {
   kModel8253,
@@ -74,6 +100,57 @@ enum LoadType {
   kSubsequentLoad
 };
 
+// An output transition. 'ticks' is the tick, counted from the time of the query, after which 
+// the output has the new level.
+struct OutputEdge {
+  unsigned long long ticks;
+  bool level;
+};
+
+// A copy of a channel's internal state, for debuggers and state save/restore.
+struct TimerChannelState {
+  TimerMode mode;
+  AccessMode access_mode;
+  TimerState timer_state;
+  LoadState load_state;
+  LoadType load_type;
+  ReadState read_state;
+  u16 load_mask;
+  u16 count_register;
+  u16 counting_element;
+  u16 count_latch;
+  unsigned long cycles_in_state;
+  unsigned long long ticks;
+  bool ce_undefined;
+  bool count_is_latched;
+  bool reload_on_trigger;
+  bool bcd_mode;
+  bool gate;
+  bool armed;
+  bool gate_triggered;
+  bool output;
+  bool output_on_reload;
+  bool reload_next_cycle;
+};
+
+#if PIT_TELEMETRY
+struct ChannelTelemetry {
+  unsigned long reloads;
+  unsigned long terminal_counts;
+  unsigned long output_edges;
+  unsigned long latches;
+  unsigned long reads;
+  unsigned long mode_writes;
+  unsigned long gate_edges;
+  unsigned long undefined_reads;
+  unsigned long long state_ticks[kCountingTriggered + 1]; // Ticks spent in each TimerState
+};
+#endif
+
+// Called on each change of a channel's output level. 'ticks' is the channel's tick count 
+// (see TimerChannel::getTicks()) at the time of the change.
+typedef void (*OutputHandler)(void *context, int channel, bool level, unsigned long long ticks);
+
 class TimerChannel {
 
   private:
@@ -104,6 +181,19 @@ class TimerChannel {
     bool output_on_reload;
     bool reload_next_cycle;
 
+    unsigned long long channel_ticks;
+    OutputHandler output_handler;
+    void *output_context;
+
+    #if PIT_TELEMETRY
+      ChannelTelemetry telemetry;
+      unsigned long long state_entered;
+    #endif
+
+    #if PIT_DIGEST
+      unsigned long long edge_digest;
+    #endif
+
   public:
     TimerChannel(PitType type, int channel_number) : type(type), c(channel_number) {
 
@@ -132,6 +222,18 @@ class TimerChannel {
       output = false;
       output_on_reload = false;
       reload_next_cycle = false;
+
+      channel_ticks = 0;
+      output_handler = 0;
+      output_context = 0;
+
+      #if PIT_TELEMETRY
+        resetTelemetry();
+      #endif
+
+      #if PIT_DIGEST
+        edge_digest = PIT_DIGEST_INIT;
+      #endif
     }
   
     void setType(PitType pit_type) {
@@ -141,6 +243,91 @@ class TimerChannel {
     bool getOutput() {
       return output;
     }
+
+    bool getGate() {
+      return gate;
+    }
+
+    TimerState getTimerState() {
+      return timer_state;
+    }
+
+    u16 getCountingElement() {
+      return counting_element;
+    }
+
+    // Whether the next tick will load an undefined value into the counting element, as
+    // happens on the first tick after a hardware-triggered mode is loaded.
+    bool isLoadTriggerPending() {
+      return (timer_state == kWaitingForLoadTrigger) && (cycles_in_state == 0) && armed;
+    }
+
+    // Return the number of ticks this channel has been clocked.
+    unsigned long long getTicks() {
+      return channel_ticks;
+    }
+
+    void getState(TimerChannelState &state) {
+      state.mode = mode;
+      state.access_mode = access_mode;
+      state.timer_state = timer_state;
+      state.load_state = load_state;
+      state.load_type = load_type;
+      state.read_state = read_state;
+      state.load_mask = load_mask;
+      state.count_register = count_register;
+      state.counting_element = counting_element;
+      state.count_latch = count_latch;
+      state.cycles_in_state = cycles_in_state;
+      state.ticks = channel_ticks;
+      state.ce_undefined = ce_undefined;
+      state.count_is_latched = count_is_latched;
+      state.reload_on_trigger = reload_on_trigger;
+      state.bcd_mode = bcd_mode;
+      state.gate = gate;
+      state.armed = armed;
+      state.gate_triggered = gate_triggered;
+      state.output = output;
+      state.output_on_reload = output_on_reload;
+      state.reload_next_cycle = reload_next_cycle;
+    }
+
+    // Restore state saved by getState(). The output handler is not called.
+    void setState(const TimerChannelState &state) {
+      mode = state.mode;
+      access_mode = state.access_mode;
+      timer_state = state.timer_state;
+      load_state = state.load_state;
+      load_type = state.load_type;
+      read_state = state.read_state;
+      load_mask = state.load_mask;
+      count_register = state.count_register;
+      counting_element = state.counting_element;
+      count_latch = state.count_latch;
+      cycles_in_state = state.cycles_in_state;
+      channel_ticks = state.ticks;
+      ce_undefined = state.ce_undefined;
+      count_is_latched = state.count_is_latched;
+      reload_on_trigger = state.reload_on_trigger;
+      bcd_mode = state.bcd_mode;
+      gate = state.gate;
+      armed = state.armed;
+      gate_triggered = state.gate_triggered;
+      output = state.output;
+      output_on_reload = state.output_on_reload;
+      reload_next_cycle = state.reload_next_cycle;
+
+      #if PIT_TELEMETRY
+        state_entered = channel_ticks;
+      #endif
+    }
+
+    // Set a function to be called on each output transition, or 0 for none. The handler is
+    // called from whichever thread is clocking the channel.
+    void setOutputHandler(OutputHandler handler, void *context) {
+      output_handler = handler;
+      output_context = context;
+    }
     
     bool is_ce_undefined() {
       return ce_undefined;
@@ -151,7 +338,64 @@ class TimerChannel {
         mode, access_mode, timer_state, count_register, counting_element, count_latch, count_is_latched, gate, output, armed);
     }
 
+    #if PIT_TELEMETRY
+    // Copy the channel's counters, including ticks so far in the current state.
+    void getTelemetry(ChannelTelemetry &out) {
+      out = telemetry;
+      out.state_ticks[timer_state] += channel_ticks - state_entered;
+    }
+
+    void resetTelemetry() {
+      memset(&telemetry, 0, sizeof(telemetry));
+      state_entered = channel_ticks;
+    }
+    #endif
+
+    #if PIT_DIGEST
+    // Fold the low 'bytes' bytes of a value into a digest.
+    static unsigned long long digestValue(unsigned long long digest, unsigned long long value, int bytes) {
+      for (int i = 0; i < bytes; i++ ) {
+        digest ^= (u8)(value >> (i * 8));
+        digest *= PIT_DIGEST_PRIME;
+      }
+      return digest;
+    }
+
+    // Return a digest of the channel's output history (each edge's tick and level) and its
+    // current state. Equal digests mean two runs agree on every output edge so far and on 
+    // where they are now, however the channels were stepped.
+    unsigned long long digest() {
+      unsigned long long d = digestValue(PIT_DIGEST_INIT, edge_digest, 8);
+      d = digestValue(d, mode, 1);
+      d = digestValue(d, access_mode, 1);
+      d = digestValue(d, timer_state, 1);
+      d = digestValue(d, load_state, 1);
+      d = digestValue(d, load_type, 1);
+      d = digestValue(d, read_state, 1);
+      d = digestValue(d, load_mask, 2);
+      d = digestValue(d, count_register, 2);
+      d = digestValue(d, counting_element, 2);
+      d = digestValue(d, count_latch, 2);
+      d = digestValue(d, cycles_in_state, 4);
+      d = digestValue(d, channel_ticks, 8);
+      d = digestValue(d, (ce_undefined << 0) | (count_is_latched << 1) | (reload_on_trigger << 2) | 
+                         (bcd_mode << 3) | (gate << 4) | (armed << 5) | (gate_triggered << 6) | 
+                         (output << 7), 1);
+      d = digestValue(d, (output_on_reload << 0) | (reload_next_cycle << 1), 1);
+      return d;
+    }
+
+    // Restart the output history, e.g. after loading a saved state.
+    void resetDigest() {
+      edge_digest = PIT_DIGEST_INIT;
+    }
+    #endif
+
     void changeTimerState(TimerState new_state) {
+      #if PIT_TELEMETRY
+        telemetry.state_ticks[timer_state] += channel_ticks - state_entered;
+        state_entered = channel_ticks;
+      #endif
       cycles_in_state = 0;
       timer_state = new_state;
     }
@@ -159,11 +403,22 @@ class TimerChannel {
     void changeOutputState(bool new_state) {
       // In a full emulator, actions would be taken here on the rising or falling edge of output change, 
       // such triggering interrupts, dma, or speaker output.
+      if (new_state != output) {
+        TELEMETRY_COUNT(output_edges);
+        #if PIT_DIGEST
+          edge_digest = digestValue(digestValue(edge_digest, channel_ticks, 8), new_state, 1);
+        #endif
+        if (output_handler) {
+          output_handler(output_context, c, new_state, channel_ticks);
+        }
+      }
 
       output = new_state;
     }
 
     void setMode(AccessMode p_access_mode, TimerMode p_timer_mode, bool p_bcd) {
+      TELEMETRY_COUNT(mode_writes);
+
       access_mode = p_access_mode;
       mode = p_timer_mode;
       bcd_mode = p_bcd;
@@ -291,6 +546,10 @@ class TimerChannel {
 
     void setGate(bool gate_state) {
 
+      if (gate_state != gate) {
+        TELEMETRY_COUNT(gate_edges);
+      }
+
       if((gate_state == true) && (gate == false)) {
         // Rising edge of input gate. 
         // This is ignored if we are waiting for a reload value.
@@ -358,6 +617,7 @@ class TimerChannel {
     }
 
     void latch() {
+      TELEMETRY_COUNT(latches);
       count_latch = counting_element;
       count_is_latched = true;
     }
@@ -420,6 +680,11 @@ class TimerChannel {
 
       u8 byte = 0;
 
+      TELEMETRY_COUNT(reads);
+      if (ce_undefined) {
+        TELEMETRY_COUNT(undefined_reads);
+      }
+
       switch(read_state) {
 
         case kUnlatched:
@@ -480,10 +745,13 @@ class TimerChannel {
 
     void tick() {
 
+      channel_ticks++;
+
       if (timer_state == kWaitingForLoadCycle) {
 
         // Load the current reload value into the counting element.
         counting_element = count_register & load_mask;
+        TELEMETRY_COUNT(reloads);
         load_state = kLoaded;
 
         // Start counting.
@@ -525,6 +793,7 @@ class TimerChannel {
 
               if(counting_element == 0) {
                 // Terminal count. Set output high.
+                TELEMETRY_COUNT(terminal_counts);
                 changeOutputState(true);
               }
             }
@@ -534,6 +803,7 @@ class TimerChannel {
               count();
               if(counting_element == 0) {
                 // Terminal count. Set output high if timer is armed.
+                TELEMETRY_COUNT(terminal_counts);
                 if (armed) {
                   changeOutputState(true);
                 }
@@ -548,6 +818,7 @@ class TimerChannel {
               // Output goes low for one clock cycle when count reaches 1.
               // Counter is reloaded next cycle and output goes HIGH.
               if (counting_element == 1) {
+                TELEMETRY_COUNT(terminal_counts);
                 changeOutputState(false);
                 output_on_reload = true;
                 changeTimerState(kWaitingForLoadCycle);
@@ -563,8 +834,10 @@ class TimerChannel {
                 // Even reload value. Count decrements by two and reloads on terminal count.
                 count2();
                 if (counting_element == 0) {
+                  TELEMETRY_COUNT(terminal_counts);
                   changeOutputState(!output); // Toggle output state
                   counting_element = count_register; // Reload counting element
+                  TELEMETRY_COUNT(reloads);
                 }
               }
               else {
@@ -572,6 +845,7 @@ class TimerChannel {
                   // On the 8254, odd values are not allowed into the counting element.
                   count2();
                   if (counting_element == 0) {
+                    TELEMETRY_COUNT(terminal_counts);
                     if (output) {
                       // When output is high, reload is delayed one cycle.
                       output_on_reload = !output; // Toggle output state next cycle
@@ -581,6 +855,7 @@ class TimerChannel {
                       // Output is low. Reload and update output immediately.
                       changeOutputState(!output); // Toggle output state
                       counting_element = count_register; // Reload counting element
+                      TELEMETRY_COUNT(reloads);
                     }
                   }
                 }
@@ -603,8 +878,10 @@ class TimerChannel {
 
                   if (counting_element == 0) {
                     // Counting element is immediately reloaded and output toggled.
+                    TELEMETRY_COUNT(terminal_counts);
                     changeOutputState(!output);
                     counting_element = count_register;
+                    TELEMETRY_COUNT(reloads);
                   }
                 }
               }
@@ -616,6 +893,7 @@ class TimerChannel {
             if (gate) {
               count();
               if (counting_element == 0) {
+                TELEMETRY_COUNT(terminal_counts);
                 changeOutputState(false); // Output goes low for one cycle on terminal count.
               }
               else {
@@ -628,6 +906,7 @@ class TimerChannel {
             
             count();
             if (counting_element == 0) {
+              TELEMETRY_COUNT(terminal_counts);
               changeOutputState(false); // Output goes low for one cycle on terminal count.
             }
             else {
@@ -642,7 +921,153 @@ class TimerChannel {
 
       cycles_in_state++;
     }
-  
+
+    // Advance the channel by a number of ticks. Runs of ticks that only decrement the counting 
+    // element are applied in one step; only ticks where an event occurs are stepped with tick().
+    void advance(unsigned long ticks) {
+
+      while (ticks > 0) {
+        unsigned long next_event = ticksUntilEvent();
+
+        if (next_event == 0 || next_event > ticks) {
+          skip(ticks);
+          return;
+        }
+
+        skip(next_event - 1);
+        tick();
+        ticks -= next_event;
+      }
+    }
+
+    // Return the number of ticks until the next tick that does more than decrement the counting 
+    // element: a reload, terminal count, output change or load of an undefined value. 
+    // Returns 0 if no such tick will happen with the current gate and count.
+    unsigned long ticksUntilEvent() {
+
+      switch(timer_state) {
+        case kWaitingForLoadCycle:
+          return 1;
+        case kWaitingForLoadTrigger:
+          if (cycles_in_state == 0 && armed) {
+            return 1;
+          }
+          break;
+        case kCounting:
+        case kCountingTriggered:
+          break;
+        default:
+          // Counter is stopped.
+          return 0;
+      }
+
+      if (!isCountEnabled()) {
+        return 0;
+      }
+
+      if (bcd_mode && !isValidBcd(counting_element)) {
+        // Invalid BCD digits don't count down linearly. Step until they are flushed out.
+        return 1;
+      }
+
+      switch(mode) {
+        case kInterruptOnTerminalCount:
+        case kHardwareRetriggerableOneShot:
+          return countDistance(counting_element, 0);
+
+        case kRateGenerator:
+          return countDistance(counting_element, 1);
+
+        case kSquareWaveGenerator:
+          return squareWaveTicksToZero();
+
+        case kSoftwareTriggeredStrobe:
+        case kHardwareTriggeredStrobe:
+          if (counting_element == 0 || !output) {
+            // Output returns high on the tick after terminal count.
+            return 1;
+          }
+          return countDistance(counting_element, 0);
+
+        default:
+          return 1;
+      }
+    }
+
+    // Return the number of ticks until the counting element is next at or below 'value',
+    // either by counting down to it, stepping over it, or being reloaded at or below it.
+    // 'value' is in the channel's current count format (binary or BCD). This lets a host
+    // skip a guest loop polling the count for a threshold. Returns 0 if the count will not
+    // get there with the current gate and count, or if 'value' is not valid BCD in BCD mode.
+    // The channel is not modified.
+    unsigned long cyclesUntilCount(u16 value) {
+      if (bcd_mode && !isValidBcd(value)) {
+        return 0;
+      }
+      return ticksUntilCount(value, false);
+    }
+
+    // As cyclesUntilCount(), but for the next tick after which the counting element holds 
+    // exactly 'value'. A count that is stopped at 'value' does not reach it again.
+    unsigned long cyclesUntilCountIs(u16 value) {
+      if (bcd_mode && !isValidBcd(value)) {
+        return 0;
+      }
+      return ticksUntilCount(value, true);
+    }
+
+    // Return the output level 'ticks' ticks from now, with the gate held at its current level.
+    // Periodic counting is reduced modulo its period, so this takes a bounded number of steps
+    // however far ahead it looks. The channel is not modified.
+    bool outputAt(unsigned long long ticks) {
+      TimerChannel probe = makeProbe();
+      probe.seek(ticks);
+      return probe.output;
+    }
+
+    // Return the counting element 'ticks' ticks from now. See outputAt().
+    u16 countAt(unsigned long long ticks) {
+      TimerChannel probe = makeProbe();
+      probe.seek(ticks);
+      return probe.counting_element;
+    }
+
+    // Write the output transitions caused by ticks from+1 through 'to' (counted from now) into
+    // 'edges', up to 'capacity' entries, and return the number written. If the buffer fills, 
+    // the caller can continue from the last edge's tick. Stretches without events are not 
+    // stepped, and the channel is not modified.
+    unsigned int collectEdges(unsigned long long from, unsigned long long to, OutputEdge *edges, unsigned int capacity) {
+
+      unsigned int n = 0;
+      if (to <= from) {
+        return 0;
+      }
+
+      TimerChannel probe = makeProbe();
+      probe.seek(from);
+      unsigned long long now = from;
+
+      while (n < capacity) {
+        unsigned long next_event = probe.ticksUntilEvent();
+
+        if (next_event == 0 || next_event > to - now) {
+          break;
+        }
+
+        bool last_output = probe.output;
+        probe.skip(next_event - 1);
+        probe.tick();
+        now += next_event;
+
+        if (probe.output != last_output) {
+          edges[n].ticks = now;
+          edges[n].level = probe.output;
+          n++;
+        }
+      }
+      return n;
+    }
+
   private:
 
     void count() {
@@ -689,6 +1114,267 @@ class TimerChannel {
       count();
     }
 
+    // Apply ticks known not to contain an event (see ticksUntilEvent()). The only effect 
+    // of such ticks is to decrement the counting element.
+    void skip(unsigned long ticks) {
+
+      if (ticks == 0) {
+        return;
+      }
+
+      bool counting = (timer_state == kCounting || timer_state == kCountingTriggered || 
+                       timer_state == kWaitingForLoadTrigger);
+
+      if (counting && isCountEnabled()) {
+        unsigned long m = countModulus();
+        unsigned long decrement = ticks % m;
+
+        if (mode == kSquareWaveGenerator) {
+          decrement = (2 * (ticks % m)) % m;
+          if ((count_register & 1) && (type == kModel8253) && (counting_element & 1)) {
+            // First tick decrements an odd counting element by one or three, rather than two.
+            decrement = (decrement + m + (output ? -1 : 1)) % m;
+          }
+        }
+
+        counting_element = countFromValue((countValue(counting_element) + m - decrement) % m);
+      }
+
+      cycles_in_state += ticks;
+      channel_ticks += ticks;
+    }
+
+    // Return a copy of the channel for look-ahead queries, with no output handler attached.
+    TimerChannel makeProbe() {
+      TimerChannel probe = *this;
+      probe.output_handler = 0;
+      return probe;
+    }
+
+    // Move the channel's count and output forward by a number of ticks. Once the channel 
+    // returns to a state it was in after an earlier event, the remaining ticks are reduced 
+    // modulo the measured period. Unlike advance(), cycles_in_state is not kept exact, so
+    // this is only for probes used by the random-access queries.
+    void seek(unsigned long long ticks) {
+
+      TimerChannel sync = *this;
+      bool synced = false;
+      bool wrapped = false;
+      unsigned long long period = 0;
+
+      while (ticks > 0) {
+        unsigned long next_event = ticksUntilEvent();
+
+        if (next_event == 0) {
+          if (isDecrementing()) {
+            // Counting with no further events. The count repeats every counter wrap.
+            skip((unsigned long)((ticks - 1) % countModulus()) + 1);
+          }
+          return;
+        }
+
+        if (next_event > ticks) {
+          skip((unsigned long)ticks);
+          return;
+        }
+
+        skip(next_event - 1);
+        tick();
+        ticks -= next_event;
+
+        if (wrapped) {
+          continue;
+        }
+
+        if (!synced) {
+          sync = *this;
+          synced = true;
+          continue;
+        }
+
+        period += next_event;
+        if (isSameCycleState(sync)) {
+          ticks %= period;
+          wrapped = true;
+        }
+      }
+    }
+
+    // Whether the state tick() depends on and changes matches another channel's.
+    bool isSameCycleState(const TimerChannel &other) {
+      return (counting_element == other.counting_element) && (output == other.output) &&
+             (timer_state == other.timer_state) && (load_state == other.load_state) &&
+             (ce_undefined == other.ce_undefined) && (output_on_reload == other.output_on_reload) &&
+             ((cycles_in_state == 0) == (other.cycles_in_state == 0));
+    }
+
+    unsigned long ticksUntilCount(u16 value, bool exact) {
+
+      TimerChannel probe = makeProbe();
+      unsigned long target = countValue(value);
+      unsigned long elapsed = 0;
+
+      // The count sequence is periodic. If it is not reached within two counter wraps
+      // it will never be.
+      unsigned long limit = 2 * countModulus() + 2;
+
+      while (elapsed < limit) {
+        unsigned long next_event = probe.ticksUntilEvent();
+        unsigned long stretch = next_event ? (next_event - 1) : (limit - elapsed);
+
+        if (next_event == 0 && !probe.isDecrementing()) {
+          // The channel is stopped and the count is frozen.
+          if (!exact && probe.isCountAt(target, false)) {
+            return elapsed + 1;
+          }
+          return 0;
+        }
+
+        if (stretch > 0) {
+          // Ticks before the next event only decrement the counting element. An undefined
+          // count stays undefined until the next reload.
+          unsigned long reach = probe.ce_undefined ? (stretch + 1) : probe.ticksToReach(target, exact);
+          if (reach <= stretch) {
+            return elapsed + reach;
+          }
+          if (next_event == 0) {
+            return 0;
+          }
+          probe.skip(stretch);
+          elapsed += stretch;
+        }
+        else if (next_event == 0) {
+          return 0;
+        }
+
+        probe.tick();
+        elapsed++;
+
+        if (probe.isCountAt(target, exact)) {
+          return elapsed;
+        }
+      }
+      return 0;
+    }
+
+    // Whether a tick in a counting state will decrement the counting element.
+    bool isCountEnabled() {
+      switch(mode) {
+        case kHardwareRetriggerableOneShot:
+        case kHardwareTriggeredStrobe:
+          // Gate only triggers these modes.
+          return true;
+        default:
+          return gate;
+      }
+    }
+
+    // Whether a tick will decrement the counting element.
+    bool isDecrementing() {
+      bool counting = (timer_state == kCounting || timer_state == kCountingTriggered || 
+                       timer_state == kWaitingForLoadTrigger);
+      return counting && (mode <= kHardwareTriggeredStrobe) && isCountEnabled();
+    }
+
+    // Whether the counting element holds a defined count at, or if not 'exact' at or below,
+    // a position in the count sequence.
+    bool isCountAt(unsigned long target, bool exact) {
+      if (ce_undefined || (bcd_mode && !isValidBcd(counting_element))) {
+        return false;
+      }
+      if (exact) {
+        return countValue(counting_element) == target;
+      }
+      return countValue(counting_element) <= target;
+    }
+
+    static bool isValidBcd(u16 value) {
+      return ((value & 0x000F) <= 0x0009) && ((value & 0x00F0) <= 0x0090) && 
+             ((value & 0x0F00) <= 0x0900) && ((value & 0xF000) <= 0x9000);
+    }
+
+    // Convert a counting element value to its position in the count sequence. 
+    // BCD values must be valid.
+    unsigned long countValue(u16 value) {
+      if (bcd_mode) {
+        return (unsigned long)(value & 0x0F) + ((value >> 4) & 0x0F) * 10ul + 
+               ((value >> 8) & 0x0F) * 100ul + ((value >> 12) & 0x0F) * 1000ul;
+      }
+      return value;
+    }
+
+    // Convert a position in the count sequence back to a counting element value.
+    u16 countFromValue(unsigned long value) {
+      if (bcd_mode) {
+        return (u16)((value % 10) | ((value / 10 % 10) << 4) | ((value / 100 % 10) << 8) | 
+                     ((value / 1000 % 10) << 12));
+      }
+      return (u16)value;
+    }
+
+    // Number of distinct counting element values before the counter wraps.
+    unsigned long countModulus() {
+      return bcd_mode ? 10000ul : 0x10000ul;
+    }
+
+    // Number of calls to count() needed to go from one value to another. If the values are
+    // equal, this is a full wrap of the counter.
+    unsigned long countDistance(u16 from, u16 to) {
+      unsigned long m = countModulus();
+      unsigned long d = (countValue(from) + m - countValue(to)) % m;
+      return d ? d : m;
+    }
+
+    // Ticks until a counting square wave channel reaches 0 and toggles. Returns 0 if the
+    // counting element can never reach 0 at the current parity.
+    unsigned long squareWaveTicksToZero() {
+
+      if (((count_register & 1) == 0) || (type == kModel8254)) {
+        // Decrementing by two. An odd counting element will never reach 0.
+        if (counting_element & 1) {
+          return 0;
+        }
+        return countDistance(counting_element, 0) / 2;
+      }
+
+      // 8253 with an odd reload value. An odd counting element is decremented by one if output
+      // is high, or by three if low, then by two from then on.
+      if (counting_element & 1) {
+        unsigned long m = countModulus();
+        unsigned long step = output ? 1 : 3;
+        unsigned long remaining = (countValue(counting_element) + m - step) % m;
+        return 1 + remaining / 2;
+      }
+      return countDistance(counting_element, 0) / 2;
+    }
+
+    // Ticks of plain decrementing until the count is at (or if not 'exact', at or below) a 
+    // position in the count sequence. Only valid while counting with no event pending (see 
+    // ticksUntilEvent()). Returns 0xFFFFFFFF if an exact count is stepped over.
+    unsigned long ticksToReach(unsigned long target, bool exact) {
+      unsigned long m = countModulus();
+      unsigned long step = 1;
+      unsigned long first_step = 1;
+
+      if (mode == kSquareWaveGenerator) {
+        step = 2;
+        first_step = 2;
+        if ((count_register & 1) && (type == kModel8253) && (counting_element & 1)) {
+          first_step = output ? 1 : 3;
+        }
+      }
+
+      unsigned long first = (countValue(counting_element) + m - first_step) % m;
+      if (exact) {
+        unsigned long d = (first + m - target) % m;
+        return (d % step) ? 0xFFFFFFFFul : 1 + d / step;
+      }
+      if (first <= target) {
+        return 1;
+      }
+      return 1 + (first - target + step - 1) / step;
+    }
+
     // A load of the reload value has been completed. What happens now depends on whether
     // this is the first load or intial load, and the particular timer mode.
     void completeLoad() {
@@ -744,12 +1430,70 @@ class TimerChannel {
     }
 };
 
+#ifndef PIT_MAX_WATCHPOINTS
+#define PIT_MAX_WATCHPOINTS 4
+#endif
+
+enum WatchType {
+  kWatchCount,          // The counting element reaches 'value'.
+  kWatchControlWord,    // A control word is written. The low byte of 'value' is matched under the mask
+                        // in the high byte; a mask of 0 matches any control word.
+  kWatchOutputEdge,     // The channel's output changes level.
+  kWatchLoadTrigger,    // The channel is loaded and enters kWaitingForLoadTrigger.
+  kWatchUndefinedCount, // An undefined value is loaded into the counting element.
+};
+
+// Output edges are searched for this far ahead, longer than any output period, so a host
+// running a few ticks at a time searches again only once per edge.
+#define PIT_WATCH_EDGE_HORIZON 0x20000ul
+
+struct Watchpoint {
+  WatchType type;
+  u8 channel;
+  u16 value;
+  bool active;
+  bool will_trigger;        // 'due' is the next trigger, not the end of a search that found none
+  unsigned long long due;   // PIT cycle of the next tick-driven trigger, or up to which there is none
+};
+
+struct WatchHit {
+  u8 id;
+  WatchType type;
+  u8 channel;
+  unsigned long long cycle;
+};
+
+// A copy of the whole PIT's state, for save states and rewind.
+struct PitState {
+  unsigned long long pit_cycles;
+  unsigned long long cpu_cycles;
+  unsigned long long clock_remainder;
+  unsigned long clock_num;
+  unsigned long clock_den;
+  TimerChannelState channel[3];
+};
+
 class Pit {
 
   private:
     PitType type;
     unsigned long long pit_cycles;
 
+    // Clock domain adapter state. The PIT clock is the CPU clock * clock_num / clock_den.
+    unsigned long long cpu_cycles;
+    unsigned long clock_num;
+    unsigned long clock_den;
+    unsigned long long clock_remainder;
+
+    // Watchpoints. With none active, the only cost is one test per run() call or port write.
+    // Trigger cycles are kept until a write, gate change or state load could move them; 
+    // 'watch_stale' marks them all for recomputing.
+    Watchpoint watches[PIT_MAX_WATCHPOINTS];
+    u8 watch_count;
+    bool watch_stale;
+    bool watch_hit;
+    WatchHit hit;
+
   public:
 
     TimerChannel channel[3] = {
@@ -760,6 +1504,19 @@ class Pit {
 
     Pit(PitType type) : type(type) {
 
+      pit_cycles = 0;
+      cpu_cycles = 0;
+      clock_num = 1;
+      clock_den = 1;
+      clock_remainder = 0;
+
+      for (int i = 0; i < PIT_MAX_WATCHPOINTS; i++ ) {
+        watches[i].active = false;
+      }
+      watch_count = 0;
+      watch_stale = true;
+      watch_hit = false;
+
       if(type != kModel8253) {
         for (int i = 0; i < 3; i++ ) {
           channel[i].setType(type);
@@ -768,12 +1525,278 @@ class Pit {
     }
 
     void setMode(u8 c, AccessMode access_mode, TimerMode timer_mode, bool bcd) {
-      if (channel < 3) {
+      if (c < 3) {
         channel[c].setMode(access_mode, timer_mode, bcd);
       }
     }
 
     void setModeByte(u8 byte) {
+      if (watch_count) {
+        u8 outputs = getOutputs();
+        watch_stale = true;
+        writeModeByte(byte);
+        checkWriteWatches(PIT_COMMAND_PORT, byte, outputs);
+        return;
+      }
+      writeModeByte(byte);
+    }
+
+    // Set a channel's gate input.
+    void setGate(u8 c, bool gate_state) {
+      if (watch_count) {
+        u8 outputs = getOutputs();
+        watch_stale = true;
+        channel[c].setGate(gate_state);
+        // Not a port write; only output edges apply.
+        checkWriteWatches(0xFF, 0, outputs);
+        return;
+      }
+      channel[c].setGate(gate_state);
+    }
+
+    void tick() {
+      for(int i = 0; i < 3; i++ ) {
+        channel[i].tick();
+      }
+      pit_cycles++;
+    }
+
+    // Port-level I/O, decoded from the two address lines. Higher bits of 'port' are ignored.
+    inline void ioWrite(u8 port, u8 byte) {
+      port &= 0x03;
+      if (port == PIT_COMMAND_PORT) {
+        setModeByte(byte);
+      }
+      else if (watch_count) {
+        u8 outputs = getOutputs();
+        watch_stale = true;
+        channel[port].sendReloadByte(byte);
+        checkWriteWatches(port, byte, outputs);
+      }
+      else {
+        channel[port].sendReloadByte(byte);
+      }
+    }
+
+    // Reading the command port is a no-op on the 8253; the data bus floats.
+    inline u8 ioRead(u8 port) {
+      port &= 0x03;
+      if (port == PIT_COMMAND_PORT) {
+        return 0xFF;
+      }
+      return channel[port].readByte();
+    }
+
+    // Write a run of bytes to one port, as for a string output instruction. The port is 
+    // decoded once for the whole burst. Callers syncing to a CPU clock should call 
+    // advanceTo() once before the burst rather than per byte.
+    void ioWriteBurst(u8 port, const u8 *bytes, unsigned int count) {
+      port &= 0x03;
+      if (watch_count) {
+        for(unsigned int i = 0; i < count; i++ ) {
+          ioWrite(port, bytes[i]);
+        }
+      }
+      else if (port == PIT_COMMAND_PORT) {
+        for(unsigned int i = 0; i < count; i++ ) {
+          setModeByte(bytes[i]);
+        }
+      }
+      else {
+        TimerChannel &ch = channel[port];
+        for(unsigned int i = 0; i < count; i++ ) {
+          ch.sendReloadByte(bytes[i]);
+        }
+      }
+    }
+
+    // Read a run of bytes from one port, as for a string input instruction.
+    void ioReadBurst(u8 port, u8 *bytes, unsigned int count) {
+      port &= 0x03;
+      if (port == PIT_COMMAND_PORT) {
+        for(unsigned int i = 0; i < count; i++ ) {
+          bytes[i] = 0xFF;
+        }
+      }
+      else {
+        TimerChannel &ch = channel[port];
+        for(unsigned int i = 0; i < count; i++ ) {
+          bytes[i] = ch.readByte();
+        }
+      }
+    }
+
+    // Run all channels for a number of ticks. Equivalent to calling tick() 'ticks' times, 
+    // but uneventful stretches of counting are applied in one step. If a watchpoint triggers,
+    // stops after the tick that triggered it. Returns the number of ticks run.
+    unsigned long run(unsigned long ticks) {
+      if (watch_count) {
+        u8 id = 0;
+        unsigned long trigger = nextWatchTrigger(ticks, id);
+        if (trigger) {
+          runChannels(trigger);
+          recordHit(id);
+          return trigger;
+        }
+      }
+      runChannels(ticks);
+      return ticks;
+    }
+
+    unsigned long long getCycles() {
+      return pit_cycles;
+    }
+
+    // Return an independent copy of the PIT to continue from, e.g. to try several op 
+    // sequences after a shared prefix. A PIT is a few hundred bytes with no pointers to 
+    // owned data, so a plain copy is already cheaper than any copy-on-write scheme. Output
+    // handlers are not carried over, so edges in the copy don't reach this PIT's consumers.
+    Pit fork() {
+      Pit copy = *this;
+      for (int i = 0; i < 3; i++ ) {
+        copy.channel[i].setOutputHandler(0, 0);
+      }
+      return copy;
+    }
+
+    // Save the state of the PIT and its clock adapter. Watchpoints are not part of the state.
+    void getState(PitState &state) {
+      state.pit_cycles = pit_cycles;
+      state.cpu_cycles = cpu_cycles;
+      state.clock_remainder = clock_remainder;
+      state.clock_num = clock_num;
+      state.clock_den = clock_den;
+      for (int i = 0; i < 3; i++ ) {
+        channel[i].getState(state.channel[i]);
+      }
+    }
+
+    void setState(const PitState &state) {
+      pit_cycles = state.pit_cycles;
+      cpu_cycles = state.cpu_cycles;
+      clock_remainder = state.clock_remainder;
+      clock_num = state.clock_num;
+      clock_den = state.clock_den;
+      for (int i = 0; i < 3; i++ ) {
+        channel[i].setState(state.channel[i]);
+      }
+      watch_stale = true;
+    }
+
+    // Set the ratio of the PIT clock to the CPU clock driving advanceTo(). For a PC, where
+    // the PIT runs at the 4.77MHz CPU clock / 4, this is 1:4.
+    void setClockRatio(unsigned long num, unsigned long den) {
+      clock_num = num;
+      clock_den = den;
+      clock_remainder = 0;
+    }
+
+    // Advance the PIT to the given CPU cycle. Fractional PIT ticks are carried over to the 
+    // next call, and all whole ticks are run in one batch.
+    void advanceTo(unsigned long long cpu_cycle) {
+      unsigned long long elapsed = cpu_cycle - cpu_cycles;
+      cpu_cycles = cpu_cycle;
+
+      unsigned long long scaled = elapsed * clock_num + clock_remainder;
+      clock_remainder = scaled % clock_den;
+
+      // Watchpoints are recorded but do not stop the PIT falling behind the CPU.
+      unsigned long ticks = (unsigned long)(scaled / clock_den);
+      while (ticks > 0) {
+        ticks -= run(ticks);
+      }
+    }
+
+    // Return all three outputs as a mask, with channel 0 in bit 0. This matches the
+    // layout of the output pins on PINC.
+    u8 getOutputs() {
+      return (u8)channel[0].getOutput() | ((u8)channel[1].getOutput() << 1) | ((u8)channel[2].getOutput() << 2);
+    }
+
+    // Return a mask of channels whose counting element is currently undefined.
+    u8 getUndefinedMask() {
+      return (u8)channel[0].is_ce_undefined() | ((u8)channel[1].is_ce_undefined() << 1) | 
+             ((u8)channel[2].is_ce_undefined() << 2);
+    }
+
+    #if PIT_TELEMETRY
+    void resetTelemetry() {
+      for (int i = 0; i < 3; i++ ) {
+        channel[i].resetTelemetry();
+      }
+    }
+    #endif
+
+    #if PIT_DIGEST
+    // Return a digest of all three channels and the PIT cycle count. See TimerChannel::digest().
+    unsigned long long digest() {
+      unsigned long long d = TimerChannel::digestValue(PIT_DIGEST_INIT, pit_cycles, 8);
+      for (int i = 0; i < 3; i++ ) {
+        d = TimerChannel::digestValue(d, channel[i].digest(), 8);
+      }
+      return d;
+    }
+
+    void resetDigest() {
+      for (int i = 0; i < 3; i++ ) {
+        channel[i].resetDigest();
+      }
+    }
+    #endif
+
+    // Arm a watchpoint on a channel and return its id, or -1 if all are in use. Watchpoints
+    // are checked by run() and advanceTo() and by writes made through setModeByte(), 
+    // setGate() and the port I/O functions. tick() does not check them, and changes made
+    // through channel[] directly are not seen until one of those calls or setState().
+    int addWatchpoint(WatchType watch_type, u8 c, u16 value) {
+      if (c > 2) {
+        return -1;
+      }
+      for (int i = 0; i < PIT_MAX_WATCHPOINTS; i++ ) {
+        if (!watches[i].active) {
+          watches[i].type = watch_type;
+          watches[i].channel = c;
+          watches[i].value = value;
+          watches[i].active = true;
+          watch_count++;
+          watch_stale = true;
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    void removeWatchpoint(int id) {
+      if (id >= 0 && id < PIT_MAX_WATCHPOINTS && watches[id].active) {
+        watches[id].active = false;
+        watch_count--;
+      }
+    }
+
+    void clearWatchpoints() {
+      for (int i = 0; i < PIT_MAX_WATCHPOINTS; i++ ) {
+        watches[i].active = false;
+      }
+      watch_count = 0;
+    }
+
+    // Whether a watchpoint has triggered since the last clearWatchHit(). Only the first hit 
+    // is kept.
+    bool isWatchHit() {
+      return watch_hit;
+    }
+
+    WatchHit getWatchHit() {
+      return hit;
+    }
+
+    void clearWatchHit() {
+      watch_hit = false;
+    }
+
+  private:
+
+    void writeModeByte(u8 byte) {
       #if DEBUG_EMU
         mprintf("setModeByte(): Received byte %X\n", byte);
       #endif
@@ -798,9 +1821,128 @@ class Pit {
       }
     }
 
-    void tick() {
+    void runChannels(unsigned long ticks) {
       for(int i = 0; i < 3; i++ ) {
-        channel[i].tick();
+        channel[i].advance(ticks);
+      }
+      pit_cycles += ticks;
+    }
+
+    void recordHit(u8 id) {
+      if (!watch_hit) {
+        watch_hit = true;
+        hit.id = id;
+        hit.type = watches[id].type;
+        hit.channel = watches[id].channel;
+        hit.cycle = pit_cycles;
+      }
+    }
+
+    // Return the number of ticks until the first tick-driven watchpoint triggers, if it does
+    // within 'ticks' ticks, or 0 if none will. Trigger cycles found by earlier calls are
+    // reused, so a host running a few ticks at a time pays for a search only after a
+    // write, a trigger, or a run past the end of the last search.
+    unsigned long nextWatchTrigger(unsigned long ticks, u8 &id) {
+      unsigned long long end = pit_cycles + ticks;
+      unsigned long first = 0;
+
+      for (int i = 0; i < PIT_MAX_WATCHPOINTS; i++ ) {
+        Watchpoint &w = watches[i];
+        if (!w.active) {
+          continue;
+        }
+        if (watch_stale || w.due <= pit_cycles || (!w.will_trigger && w.due < end)) {
+          findWatchTrigger(w, ticks);
+        }
+
+        if (w.will_trigger && w.due <= end) {
+          unsigned long trigger = (unsigned long)(w.due - pit_cycles);
+          if (first == 0 || trigger < first) {
+            first = trigger;
+            id = (u8)i;
+          }
+        }
+      }
+      watch_stale = false;
+      return first;
+    }
+
+    // Find a watchpoint's next trigger from the current cycle with the look-ahead queries,
+    // searching at least 'ticks' ticks ahead.
+    void findWatchTrigger(Watchpoint &w, unsigned long ticks) {
+      TimerChannel &ch = channel[w.channel];
+      unsigned long trigger = 0;
+      // How far ahead a trigger is ruled out if none is found.
+      unsigned long long horizon = ~0ull;
+
+      switch(w.type) {
+        case kWatchCount:
+          trigger = ch.cyclesUntilCountIs(w.value);
+          // A count not reached now may be after the next event, e.g. by a square wave
+          // whose odd count alternates the values it passes through.
+          horizon = ch.ticksUntilEvent();
+          if (!horizon) {
+            horizon = ~0ull;
+          }
+          break;
+        case kWatchOutputEdge: {
+          OutputEdge edge;
+          horizon = ticks > PIT_WATCH_EDGE_HORIZON ? ticks : PIT_WATCH_EDGE_HORIZON;
+          if (ch.collectEdges(0, horizon, &edge, 1)) {
+            trigger = (unsigned long)edge.ticks;
+          }
+          break;
+        }
+        case kWatchUndefinedCount:
+          // Only known for the next tick.
+          trigger = ch.isLoadTriggerPending() ? 1 : 0;
+          horizon = 1;
+          break;
+        default:
+          // Triggered by writes only.
+          break;
+      }
+
+      w.will_trigger = trigger != 0;
+      if (trigger) {
+        w.due = pit_cycles + trigger;
+      }
+      else {
+        w.due = horizon == ~0ull ? horizon : pit_cycles + horizon;
+      }
+    }
+
+    // Check write-driven watchpoints after a write of 'byte' to 'port'.
+    void checkWriteWatches(u8 port, u8 byte, u8 outputs_before) {
+      u8 changed = getOutputs() ^ outputs_before;
+
+      for (int i = 0; i < PIT_MAX_WATCHPOINTS; i++ ) {
+        if (!watches[i].active) {
+          continue;
+        }
+
+        u8 c = watches[i].channel;
+        u8 mask = (u8)(watches[i].value >> 8);
+
+        switch(watches[i].type) {
+          case kWatchControlWord:
+            if (port == PIT_COMMAND_PORT && ((byte ^ (u8)watches[i].value) & mask) == 0) {
+              recordHit(i);
+            }
+            break;
+          case kWatchOutputEdge:
+            if (changed & (1 << c)) {
+              recordHit(i);
+            }
+            break;
+          case kWatchLoadTrigger:
+            if (port < 3 && port == c && channel[port].isLoadTriggerPending()) {
+              recordHit(i);
+            }
+            break;
+          default:
+            break;
+        }
       }
     }
 };
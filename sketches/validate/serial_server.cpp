@@ -0,0 +1,219 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <Arduino.h>
+#include "validate.h"
+#include "serial_server.h"
+#include "test_program.h"
+#include "pit_emulator.h"
+#include "lib.h"
+
+extern PitType pit_type;
+
+// Indexed by ServerTest.
+static bool (*const server_tests[kNumServerTests])() = {
+  test_mode0,
+  test_mode1,
+  test_mode2,
+  test_mode3,
+  test_mode4,
+  test_mode5,
+  test_bcd,
+  test_rw,
+  test_reload_lsb,
+};
+
+static void server_reply(u8 cmd, const u8 *payload, u8 len) {
+  u8 frame[5 + SRV_MAX_PAYLOAD];
+  u8 sum = cmd + len;
+
+  frame[0] = SRV_SYNC;
+  frame[1] = SRV_SYNC2;
+  frame[2] = cmd;
+  frame[3] = len;
+  for(u8 i = 0; i < len; i++) {
+    frame[4 + i] = payload[i];
+    sum += payload[i];
+  }
+  frame[4 + len] = sum;
+  Serial.write(frame, 5 + len);
+}
+
+static void server_error(u8 code) {
+  server_reply(kSrvError, &code, 1);
+}
+
+// Read the next byte of a request. Returns -1 if none arrives in SRV_FRAME_TIMEOUT ms.
+static int server_read_byte() {
+  unsigned long start = millis();
+  while(!Serial.available()) {
+    if(millis() - start > SRV_FRAME_TIMEOUT) {
+      return -1;
+    }
+  }
+  return Serial.read();
+}
+
+// Apply one op to the real PIT. Returns false if the op is invalid.
+static bool server_op(const u8 *payload, u8 *reply) {
+  u8 op = payload[0];
+  u8 chan = payload[1];
+  unsigned long arg = (unsigned long)payload[2] | ((unsigned long)payload[3] << 8) |
+                      ((unsigned long)payload[4] << 16) | ((unsigned long)payload[5] << 24);
+
+  reply[0] = 0;
+  switch(op) {
+    case WriteCommand:
+      pit_write_port(COMMAND, (u8)arg);
+      break;
+    case ReadChannel:
+      if(chan > 2) {
+        return false;
+      }
+      reply[0] = pit_read_port((pit_port)chan);
+      break;
+    case WriteChannel:
+      if(chan > 2) {
+        return false;
+      }
+      pit_write_port((pit_port)chan, (u8)arg);
+      break;
+    case Tick:
+      for(unsigned long i = 0; i < arg; i++) {
+        pit_clock_tick();
+      }
+      break;
+    case FlipGate:
+      // Only gate 2 is connected. Gates 0 and 1 stay at their strap level, so a
+      // request for that level is already met and any other can't be honoured.
+      if(!pit_set_gate(chan, arg != 0)) {
+        if(chan > 1 || (arg != 0) != GATE01_STRAP) {
+          return false;
+        }
+      }
+      break;
+    default:
+      return false;
+  }
+  reply[1] = pit_get_outputs();
+  return true;
+}
+
+// Handle one request, if one has started to arrive. Bytes before a sync byte
+// are discarded. Returns true if a request was handled.
+bool serial_server_poll() {
+  u8 payload[SRV_MAX_PAYLOAD];
+  u8 reply[SRV_MAX_PAYLOAD];
+
+  if(!Serial.available() || Serial.read() != SRV_SYNC) {
+    return false;
+  }
+
+  int cmd = server_read_byte();
+  int len = server_read_byte();
+  if(cmd < 0 || len < 0) {
+    return false;
+  }
+  if(len > SRV_MAX_PAYLOAD) {
+    server_error(SRV_ERROR_REQUEST);
+    return true;
+  }
+
+  u8 sum = cmd + len;
+  for(int i = 0; i < len; i++) {
+    int b = server_read_byte();
+    if(b < 0) {
+      return false;
+    }
+    payload[i] = (u8)b;
+    sum += payload[i];
+  }
+  int checksum = server_read_byte();
+  if(checksum < 0) {
+    return false;
+  }
+  if((u8)checksum != sum) {
+    server_error(SRV_ERROR_CHECKSUM);
+    return true;
+  }
+
+  switch(cmd) {
+    case kSrvHello:
+      reply[0] = 'P';
+      reply[1] = 'I';
+      reply[2] = 'T';
+      reply[3] = SRV_VERSION;
+      reply[4] = (u8)pit_type;
+      server_reply(kSrvHello, reply, 5);
+      break;
+    case kSrvReset:
+      SET_G2_LOW;
+      pit_reset();
+      server_reply(kSrvReset, NULL, 0);
+      break;
+    case kSrvOp:
+      if(len != 6 || !server_op(payload, reply)) {
+        server_error(SRV_ERROR_REQUEST);
+        break;
+      }
+      server_reply(kSrvOp, reply, 2);
+      break;
+    case kSrvTest:
+      if(len != 1 || payload[0] >= kNumServerTests) {
+        server_error(SRV_ERROR_REQUEST);
+        break;
+      }
+      reply[0] = server_tests[payload[0]]() ? 1 : 0;
+      server_reply(kSrvTest, reply, 1);
+      break;
+    case kSrvLoad: {
+      unsigned int offset = (len >= 2) ? (payload[0] | ((unsigned int)payload[1] << 8)) : 0;
+      if(len < 3 || offset + (len - 2) > TEST_PROGRAM_MAX) {
+        server_error(SRV_ERROR_REQUEST);
+        break;
+      }
+      memcpy(TEST_PROGRAM_UPLOAD + offset, payload + 2, len - 2);
+      server_reply(kSrvLoad, NULL, 0);
+      break;
+    }
+    case kSrvProgram: {
+      unsigned int program_len = (len == 2) ? (payload[0] | ((unsigned int)payload[1] << 8)) : 0;
+      if(program_len == 0 || program_len > TEST_PROGRAM_MAX) {
+        server_error(SRV_ERROR_REQUEST);
+        break;
+      }
+      reply[0] = run_test_program(TEST_PROGRAM_UPLOAD, false, program_len) ? 1 : 0;
+      server_reply(kSrvProgram, reply, 1);
+      break;
+    }
+    default:
+      server_error(SRV_ERROR_REQUEST);
+      break;
+  }
+  return true;
+}
+
+// Serve requests forever.
+void serial_server() {
+  mprintf(F("Serial server ready.\n"));
+  while(true) {
+    serial_server_poll();
+  }
+}
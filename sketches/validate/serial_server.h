@@ -0,0 +1,91 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Serial request server. With serial_server() running, the board executes bus
+// ops and test programs on request from a host, replying with framed binary
+// results, so a host orchestrator can drive many boards at once. The board only
+// reports what the real PIT does; comparing against the emulator is left to the
+// host.
+//
+// Request:  u8 SRV_SYNC, u8 cmd, u8 len, u8 payload[len], u8 checksum
+// Response: u8 SRV_SYNC, u8 SRV_SYNC2, u8 cmd, u8 len, u8 payload[len], u8 checksum
+//
+// The checksum is the sum of the cmd, len and payload bytes. Both sync bytes are
+// outside the ASCII range, so a host can skip over the text the sketch prints
+// between responses. Multi-byte fields are little-endian.
+//
+// Requests and their response payloads:
+//   kSrvHello                       -> 'P' 'I' 'T' SRV_VERSION <model>
+//   kSrvReset                       -> (none)  Gate 2 LOW, then reset the PIT
+//   kSrvOp  <op> <chan> <u32 arg>   -> <byte> <outputs>  One FuzzerOp, as a host PitOp
+//   kSrvTest <test>                 -> <passed>  Run a ServerTest
+//   kSrvLoad <u16 offset> <bytes>   -> (none)  Store up to SRV_MAX_PAYLOAD - 2 bytes of a
+//                                              test program (test_program.h) at 'offset'
+//   kSrvProgram <u16 len>           -> <passed>  Run the first 'len' bytes loaded
+// A request that fails its checksum or is invalid gets a kSrvError response.
+//
+// A host may have up to SRV_WINDOW op requests in flight, which fits the Uno's
+// receive buffer.
+
+#ifndef _SERIAL_SERVER_H
+#define _SERIAL_SERVER_H
+
+#include "arduino_8253.h"
+
+#define SRV_SYNC 0xA5
+#define SRV_SYNC2 0x5A
+#define SRV_VERSION 2
+#define SRV_MAX_PAYLOAD 8
+#define SRV_WINDOW 4
+
+// Milliseconds a partly received request may stall before it is dropped.
+#define SRV_FRAME_TIMEOUT 500
+
+enum ServerCommand {
+  kSrvHello = 'H',
+  kSrvReset = 'R',
+  kSrvOp = 'O',
+  kSrvTest = 'T',
+  kSrvLoad = 'L',
+  kSrvProgram = 'P',
+  kSrvError = 'E',
+};
+
+// kSrvError payload.
+#define SRV_ERROR_CHECKSUM 1
+#define SRV_ERROR_REQUEST 2
+
+enum ServerTest {
+  kSrvTestMode0,
+  kSrvTestMode1,
+  kSrvTestMode2,
+  kSrvTestMode3,
+  kSrvTestMode4,
+  kSrvTestMode5,
+  kSrvTestBcd,
+  kSrvTestRw,
+  kSrvTestReloadLsb,
+  kNumServerTests
+};
+
+bool serial_server_poll();
+void serial_server();
+
+#endif
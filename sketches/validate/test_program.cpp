@@ -0,0 +1,255 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <Arduino.h>
+#include "validate.h"
+#include "arduino_8253.h"
+#include "pit_emulator.h"
+#include "test_program.h"
+#include "lib.h"
+
+extern Pit emu;
+extern PitType pit_type;
+
+static_assert(TEST_PROGRAM_MAX <= sizeof capture_runs, "uploads must fit the capture buffer");
+
+static const char *level_str(u8 level) {
+  return level ? "HIGH" : "LOW";
+}
+
+// Reads ops and operands from flash or RAM. A RAM program has a known length,
+// and reading past it is flagged.
+class ProgramReader {
+
+  private:
+    const u8 *pc;
+    const u8 *end;
+    bool in_progmem;
+
+  public:
+    bool overrun = false;
+
+    ProgramReader(const u8 *program, bool in_progmem, unsigned int len) :
+      pc(program), end(len ? program + len : 0), in_progmem(in_progmem) {}
+
+    u8 byte() {
+      if(end && pc >= end) {
+        overrun = true;
+        return kNumTestOps;
+      }
+      u8 b = in_progmem ? pgm_read_byte(pc) : *pc;
+      pc++;
+      return b;
+    }
+
+    u16 word() {
+      u16 lsb = byte();
+      return lsb | ((u16)byte() << 8);
+    }
+};
+
+bool run_test_program(const u8 *program, bool in_progmem, unsigned int len) {
+
+  ProgramReader reader(program, in_progmem, len);
+  bool skipping = false;
+  unsigned int step = 0;
+
+  for(;;) {
+    u8 op = reader.byte();
+    bool ok = true;
+    step++;
+
+    // Operands are always read, so skipped ops keep the program in step.
+    u8 arg = 0;
+    u16 value = 0;
+
+    switch(op) {
+      case kTpReset:
+      case kTpMode:
+      case kTpGate:
+      case kTpCheckCount:
+      case kTpCompareCount:
+      case kTpSoftCompare:
+      case kTpExpectOutput:
+      case kTpReadByte:
+      case kTpPrintCount:
+        arg = reader.byte();
+        break;
+      case kTpWrite:
+      case kTpExpectCount:
+        arg = reader.byte();
+        value = reader.word();
+        break;
+      case kTpTicks:
+      case kTpDelay:
+        value = reader.word();
+        break;
+      default:
+        break;
+    }
+
+    if(reader.overrun) {
+      mprintf(F("Test program ends inside step %u\n"), step);
+      return false;
+    }
+
+    if(op == kTpAllModels) {
+      skipping = false;
+      continue;
+    }
+    if(skipping) {
+      continue;
+    }
+
+    switch(op) {
+      case kTpEnd:
+        mprintf(F("TEST PASSED!\n"));
+        return true;
+
+      case kTpReset:
+        mprintf(F(">>> Resetting PIT. Gate %s\n"), level_str(arg));
+        pit_reset();
+        emu = Pit(pit_type);
+        v_set_gate(TEST_CHAN, arg);
+        break;
+
+      case kTpMode:
+        mprintf(F(">>> Setting mode %u, access %u, BCD %u\n"), (arg >> 1) & 0x07, (arg >> 4) & 0x03, arg & 1);
+        v_set_mode(TEST_CHAN, (pit_access)((arg >> 4) & 0x03), (pit_mode)((arg >> 1) & 0x07), arg & 1);
+        break;
+
+      case kTpWrite:
+        mprintf(F(">>> Writing counter %u (%X), access %u\n"), value, value, arg);
+        v_write_counter(TEST_CHAN, (pit_access)arg, value);
+        break;
+
+      case kTpTicks:
+        mprintf(F(">>> Ticking %u\n"), value);
+        v_ticks(value);
+        break;
+
+      case kTpGate:
+        mprintf(F(">>> Setting gate %s\n"), level_str(arg));
+        v_set_gate(TEST_CHAN, arg);
+        break;
+
+      case kTpLatch:
+        mprintf(F(">>> Latching count\n"));
+        v_latch(TEST_CHAN);
+        break;
+
+      case kTpDelay:
+        delay(value);
+        break;
+
+      case kTpExpectCount:
+        ok = test_counters_exact(TEST_CHAN, (pit_access)arg, value);
+        break;
+
+      case kTpCheckCount:
+        ok = test_counters(TEST_CHAN, (pit_access)arg);
+        break;
+
+      case kTpCompareCount:
+      case kTpSoftCompare:
+        if(v_compare_counters(TEST_CHAN, (pit_access)arg)) {
+          mprintf(F(">>> Counters match. %s\n"), PASS);
+        }
+        else {
+          mprintf(F(">>> Counters don't match. %s\n"), FAIL);
+          ok = (op == kTpSoftCompare);
+        }
+        break;
+
+      case kTpExpectOutput:
+        ok = test_output(TEST_CHAN, arg);
+        break;
+
+      case kTpReadByte: {
+        u8 pit_byte = pit_read_counter(TEST_CHAN, LSB);
+        u8 emu_byte = emu.channel[TEST_CHAN].readByte();
+
+        mprintf(F("Read emu byte: %X, pit byte: %X\n"), emu_byte, pit_byte);
+        if(emu_byte != pit_byte) {
+          mprintf(F("Bytes don't match! %s\n"), FAIL);
+          ok = !arg;
+        }
+        break;
+      }
+
+      case kTpPrintCount:
+        mprintf(F("Counter value read: %X\n"), pit_read_counter(TEST_CHAN, (pit_access)arg));
+        break;
+
+      case kTpPrintState:
+        emu.channel[TEST_CHAN].printState();
+        break;
+
+      case kTpOnly8253:
+        skipping = (pit_type != kModel8253);
+        break;
+
+      default:
+        mprintf(F("Bad test op %u at step %u\n"), op, step);
+        return false;
+    }
+
+    if(!ok) {
+      mprintf(F("TEST FAILED at step %u\n"), step);
+      return false;
+    }
+  }
+}
+
+bool test_program_serial() {
+
+  u8 *program = TEST_PROGRAM_UPLOAD;
+  unsigned int received = 0;
+  unsigned int len = 0;
+  unsigned long start = millis();
+
+  mprintf(F("Waiting for test program...\n"));
+
+  // Two length bytes, then the program.
+  while(received < 2 + len) {
+    if(millis() - start > 5000) {
+      mprintf(F("Timed out receiving test program (%u bytes).\n"), received);
+      return false;
+    }
+    if(!Serial.available()) {
+      continue;
+    }
+    u8 b = (u8)Serial.read();
+    if(received < 2) {
+      len |= (unsigned int)b << (8 * received);
+      if(received == 1 && (len == 0 || len > TEST_PROGRAM_MAX)) {
+        mprintf(F("Bad test program length: %u\n"), len);
+        return false;
+      }
+    }
+    else {
+      program[received - 2] = b;
+    }
+    received++;
+  }
+
+  mprintf(F("Running uploaded test program (%u bytes)...\n"), len);
+  return run_test_program(program, false, len);
+}
@@ -0,0 +1,105 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// A compact bytecode for scripted validation tests. A test program is a byte
+// array, normally in PROGMEM, of ops that each drive both the real and the
+// emulated PIT on TEST_CHAN or check them against each other and an expected
+// value. The interpreter narrates every op, so programs need no strings of their
+// own. The same interpreter runs tests on the board, from a program uploaded over
+// serial, or natively against the mock chip in a host build.
+//
+// Multi-byte operands are little-endian. Programs are written with the TP_*
+// macros below and end with TP_END.
+
+#ifndef _TEST_PROGRAM_H
+#define _TEST_PROGRAM_H
+
+#include "arduino_8253.h"
+#include "capture.h"
+
+enum TestOp {
+  kTpEnd,           // Program complete: test passed
+  kTpReset,         // <gate>           Set the gate and reset both PITs
+  kTpMode,          // <control>        Control word bits 0-5: access, mode, BCD
+  kTpWrite,         // <access> <u16>   Write a counter value
+  kTpTicks,         // <u16>            Clock both PITs
+  kTpGate,          // <level>          Set the gate
+  kTpLatch,         //                  Latch the count
+  kTpDelay,         // <u16>            Wait, in milliseconds
+  kTpExpectCount,   // <access> <u16>   Counts must match and equal the value
+  kTpCheckCount,    // <access>         Counts must match, unless the emulator's is undefined
+  kTpCompareCount,  // <access>         Counts must match
+  kTpSoftCompare,   // <access>         Compare counts, but only report a mismatch
+  kTpExpectOutput,  // <level>          Outputs must match and equal the level
+  kTpReadByte,      // <strict>         Read one byte from both; a mismatch fails if strict
+  kTpPrintCount,    // <access>         Read and print the real PIT's count only
+  kTpPrintState,    //                  Print the emulated channel's state
+  kTpOnly8253,      //                  Skip the following ops unless testing an 8253...
+  kTpAllModels,     //                  ...up to here
+  kNumTestOps
+};
+
+#define TP_U16(v) (u8)((v) & 0xFF), (u8)(((v) >> 8) & 0xFF)
+
+#define TP_END kTpEnd
+#define TP_RESET(gate) kTpReset, (gate)
+#define TP_MODE(access, mode, bcd) kTpMode, (u8)(((access) << 4) | ((mode) << 1) | (bcd))
+#define TP_WRITE(access, value) kTpWrite, (access), TP_U16(value)
+#define TP_TICKS(n) kTpTicks, TP_U16(n)
+#define TP_GATE(level) kTpGate, (level)
+#define TP_LATCH kTpLatch
+#define TP_DELAY(ms) kTpDelay, TP_U16(ms)
+#define TP_EXPECT_COUNT(access, value) kTpExpectCount, (access), TP_U16(value)
+#define TP_CHECK_COUNT(access) kTpCheckCount, (access)
+#define TP_COMPARE_COUNT(access) kTpCompareCount, (access)
+#define TP_SOFT_COMPARE(access) kTpSoftCompare, (access)
+#define TP_EXPECT_OUTPUT(level) kTpExpectOutput, (level)
+#define TP_READ_BYTE(strict) kTpReadByte, (strict)
+#define TP_PRINT_COUNT(access) kTpPrintCount, (access)
+#define TP_PRINT_STATE kTpPrintState
+#define TP_ONLY_8253 kTpOnly8253
+#define TP_ALL_MODELS kTpAllModels
+
+// Largest program test_program_serial() or serial_server() accepts.
+#define TEST_PROGRAM_MAX 256
+
+// Where programs received over serial are stored. Programs never capture, so
+// uploads reuse the capture run buffer rather than cost the board more RAM.
+#define TEST_PROGRAM_UPLOAD ((u8 *)capture_runs)
+
+// Run a program from flash or, if 'in_progmem' is false, from RAM. A non-zero 'len'
+// bounds the program. Returns false at the first failed check or malformed op.
+bool run_test_program(const u8 *program, bool in_progmem, unsigned int len = 0);
+
+// Receive a program over serial as a 16-bit little-endian length followed by the
+// program bytes, then run it.
+bool test_program_serial();
+
+extern const u8 tp_mode0[] PROGMEM;
+extern const u8 tp_mode1[] PROGMEM;
+extern const u8 tp_mode2[] PROGMEM;
+extern const u8 tp_mode3[] PROGMEM;
+extern const u8 tp_mode4[] PROGMEM;
+extern const u8 tp_mode5[] PROGMEM;
+extern const u8 tp_bcd[] PROGMEM;
+extern const u8 tp_rw[] PROGMEM;
+extern const u8 tp_reload_lsb[] PROGMEM;
+
+#endif // _TEST_PROGRAM_H
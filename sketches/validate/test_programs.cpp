@@ -0,0 +1,378 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// The scripted mode tests, as test programs. See test_program.h.
+
+#include <Arduino.h>
+#include "test_program.h"
+
+// Mode 0: count 0x80. The count loads on the first tick but only decrements with
+// GATE HIGH, and OUT goes HIGH at terminal count and stays there.
+const u8 tp_mode0[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSB, InterruptOnTerminalCount, false),
+  TP_EXPECT_OUTPUT(false),
+  TP_WRITE(LSB, 0x80),
+  TP_EXPECT_OUTPUT(false),
+  TP_EXPECT_COUNT(LSB, 0),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 0x80),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 0x80),
+  TP_GATE(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 0x7F),
+  TP_TICKS(10),
+  TP_EXPECT_COUNT(LSB, 0x75),
+  TP_TICKS(200),
+  TP_EXPECT_COUNT(LSB, 0xAD),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1000),
+  TP_EXPECT_OUTPUT(true),
+  TP_END
+};
+
+// Mode 1: count 0xFF. Before the first trigger the counter holds a small undefined
+// value. A gate edge loads the count and drives OUT LOW until terminal count, and
+// a gate pulse between clocks retriggers it.
+const u8 tp_mode1[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSB, HardwareRetriggerableOneShot, false),
+  TP_PRINT_STATE,
+  TP_EXPECT_COUNT(LSB, 0),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 0),
+  TP_TICKS(10),
+  TP_EXPECT_COUNT(LSB, 0),
+  TP_WRITE(LSB, 0xFF),
+  TP_CHECK_COUNT(LSB),
+  TP_PRINT_STATE,
+  TP_TICKS(1),
+  TP_PRINT_STATE,
+  TP_CHECK_COUNT(LSB),
+  TP_TICKS(1),
+  TP_CHECK_COUNT(LSB),
+  TP_TICKS(1),
+  TP_CHECK_COUNT(LSB),
+  TP_PRINT_STATE,
+  TP_TICKS(100),
+  TP_PRINT_STATE,
+  TP_CHECK_COUNT(LSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_GATE(true),
+  TP_CHECK_COUNT(LSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 0xFF),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(300),
+  TP_COMPARE_COUNT(LSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_WRITE(LSB, 0x80),
+  TP_COMPARE_COUNT(LSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(500),
+  TP_COMPARE_COUNT(LSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_GATE(false),
+  TP_DELAY(100),
+  TP_GATE(true),
+  TP_TICKS(1),
+  TP_COMPARE_COUNT(LSB),
+  TP_EXPECT_OUTPUT(false),
+  TP_END
+};
+
+// Mode 2: count 0xFF. OUT pulses LOW for one clock as the count passes 1.
+const u8 tp_mode2[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSB, RateGenerator, false),
+  TP_EXPECT_OUTPUT(true),
+  TP_PRINT_STATE,
+  TP_EXPECT_COUNT(LSB, 0),
+  TP_TICKS(10),
+  TP_EXPECT_COUNT(LSB, 0),
+  TP_WRITE(LSB, 0xFF),
+  TP_EXPECT_COUNT(LSB, 0),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 0xFF),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 0xFF),
+  TP_GATE(true),
+  TP_TICKS(254),
+  TP_EXPECT_COUNT(LSB, 2),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSB, 1),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_COMPARE_COUNT(LSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(100),
+  TP_EXPECT_COUNT(LSB, 155),
+  TP_EXPECT_OUTPUT(true),
+  TP_END
+};
+
+// Mode 3 with an even count (0x1000), then an odd one (0x1001). The 8253 takes an
+// extra clock to load an odd count, and a new count takes effect at the next reload.
+// Counts in the odd half are compared but a mismatch is only reported.
+const u8 tp_mode3[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSBMSB, SquareWaveGenerator, false),
+  TP_PRINT_STATE,
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(true),
+  TP_WRITE(LSBMSB, 0x1000),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x1000),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x1000),
+  TP_GATE(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x1000),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x0FFE),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(2046),
+  TP_EXPECT_COUNT(LSBMSB, 2),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_COMPARE_COUNT(LSBMSB),
+  TP_EXPECT_OUTPUT(false),
+
+  TP_RESET(true),
+  TP_MODE(LSBMSB, SquareWaveGenerator, false),
+  TP_DELAY(100),
+  TP_WRITE(LSBMSB, 0x1001),
+  TP_COMPARE_COUNT(LSBMSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_PRINT_STATE,
+  TP_ONLY_8253,
+  TP_TICKS(1),
+  TP_SOFT_COMPARE(LSBMSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_ALL_MODELS,
+  TP_PRINT_STATE,
+  TP_TICKS(1),
+  TP_SOFT_COMPARE(LSBMSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_WRITE(LSBMSB, 0x1001),
+  TP_SOFT_COMPARE(LSBMSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(2047),
+  TP_WRITE(LSBMSB, 0x1001),
+  TP_SOFT_COMPARE(LSBMSB),
+  TP_EXPECT_OUTPUT(false),
+  TP_ONLY_8253,
+  TP_TICKS(1),
+  TP_SOFT_COMPARE(LSBMSB),
+  TP_EXPECT_OUTPUT(false),
+  TP_ALL_MODELS,
+  TP_TICKS(500),
+  TP_WRITE(LSBMSB, 0x500),
+  TP_CHECK_COUNT(LSBMSB),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1547),
+  TP_EXPECT_COUNT(LSBMSB, 0x500),
+  TP_EXPECT_OUTPUT(true),
+  TP_END
+};
+
+// Mode 4: count 0xFFFF. OUT strobes LOW for one clock at terminal count, after
+// which the counter wraps. A new count loads on the next clock.
+const u8 tp_mode4[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSBMSB, SoftwareTriggeredStrobe, false),
+  TP_PRINT_STATE,
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(true),
+  TP_WRITE(LSBMSB, 0xFFFF),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0xFFFF),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0xFFFF),
+  TP_GATE(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0xFFFE),
+  TP_TICKS(65533),
+  TP_EXPECT_COUNT(LSBMSB, 1),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 65535),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(100),
+  TP_EXPECT_COUNT(LSBMSB, 65435),
+  TP_EXPECT_OUTPUT(true),
+  TP_WRITE(LSBMSB, 1000),
+  TP_EXPECT_COUNT(LSBMSB, 65435),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 1000),
+  TP_EXPECT_OUTPUT(true),
+  TP_END
+};
+
+// Mode 5: count 0x8000. As mode 1, the counter is undefined until the first gate
+// edge loads it; OUT then strobes LOW for one clock at terminal count.
+const u8 tp_mode5[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSBMSB, HardwareTriggeredStrobe, false),
+  TP_PRINT_STATE,
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(true),
+  TP_WRITE(LSBMSB, 0x8000),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_CHECK_COUNT(LSBMSB),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_CHECK_COUNT(LSBMSB),
+  TP_GATE(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x8000),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(0x7FFF),
+  TP_EXPECT_COUNT(LSBMSB, 1),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 65535),
+  TP_EXPECT_OUTPUT(true),
+  TP_END
+};
+
+// BCD counting in mode 0. Invalid BCD counts (0xFFFF, 0x100F) are loaded as-is and
+// count down in binary until they reach valid digits.
+const u8 tp_bcd[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSBMSB, InterruptOnTerminalCount, true),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(false),
+  TP_WRITE(LSBMSB, 0xFFFF),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 65535),
+  TP_EXPECT_OUTPUT(false),
+  TP_GATE(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 65534),
+  TP_EXPECT_OUTPUT(false),
+  TP_WRITE(LSBMSB, 0x9999),
+  TP_EXPECT_COUNT(LSBMSB, 65534),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x9999),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x9998),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(10),
+  TP_EXPECT_COUNT(LSBMSB, 0x9988),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(9987),
+  TP_EXPECT_COUNT(LSBMSB, 1),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x9999),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x9998),
+  TP_EXPECT_OUTPUT(true),
+  TP_TICKS(15000),
+  TP_EXPECT_COUNT(LSBMSB, 0x4998),
+  TP_EXPECT_OUTPUT(true),
+  TP_WRITE(LSBMSB, 0x100F),
+  TP_EXPECT_COUNT(LSBMSB, 0x4998),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x100F),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0x100E),
+  TP_EXPECT_OUTPUT(false),
+  TP_TICKS(0x0F),
+  TP_EXPECT_COUNT(LSBMSB, 0x0999),
+  TP_EXPECT_OUTPUT(false),
+  TP_WRITE(LSBMSB, 0xFFFF),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 65535),
+  TP_EXPECT_OUTPUT(false),
+  TP_WRITE(LSBMSB, 0xFFFF),
+  TP_TICKS(10),
+  TP_EXPECT_COUNT(LSBMSB, 65526),
+  TP_EXPECT_OUTPUT(false),
+  TP_END
+};
+
+// Interleaved reads and writes in LSBMSB mode. On the 8253, writing a byte to a
+// channel's count register seems to reset the read state back to LSB. Only the
+// first read must match; the rest are reported.
+const u8 tp_rw[] PROGMEM = {
+  TP_RESET(false),
+  TP_MODE(LSBMSB, InterruptOnTerminalCount, false),
+  TP_WRITE(LSBMSB, 0xBEEF),
+  TP_TICKS(1),
+  TP_EXPECT_COUNT(LSBMSB, 0xBEEF),
+  TP_EXPECT_OUTPUT(false),
+  TP_LATCH,
+  TP_READ_BYTE(true),
+  TP_WRITE(LSB, 0xAA),
+  TP_READ_BYTE(false),
+  TP_READ_BYTE(false),
+  TP_WRITE(LSB, 0xAA),
+  TP_READ_BYTE(false),
+  TP_READ_BYTE(false),
+  TP_END
+};
+
+// Mode 2 with a count of 2, rewritten one byte at a time in LSBMSB mode. Prints the
+// real PIT's count after each write for inspection.
+const u8 tp_reload_lsb[] PROGMEM = {
+  TP_RESET(true),
+  TP_MODE(LSBMSB, RateGenerator, false),
+  TP_WRITE(LSBMSB, 0x0002),
+  TP_TICKS(2),
+  TP_PRINT_COUNT(LSBMSB),
+  TP_WRITE(LSB, 0xFF),
+  TP_TICKS(2),
+  TP_PRINT_COUNT(LSBMSB),
+  TP_WRITE(LSB, 0xFF),
+  TP_TICKS(2),
+  TP_PRINT_COUNT(LSBMSB),
+  TP_END
+};
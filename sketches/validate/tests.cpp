@@ -21,6 +21,8 @@
 #include "validate.h"
 #include "arduino_8253.h"
 #include "pit_emulator.h"
+#include "capture.h"
+#include "test_program.h"
 #include "lib.h"
 
 extern Pit emu;
@@ -96,889 +98,66 @@ bool test_init() {
 
 bool test_mode0() {
   mprintf(F("Starting test of mode #0, InterruptOnTerminalCount...\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0x80;
-  pit_access test_access = LSB;
-
-  mprintf(F(">>> Setting mode. Output should be LOW after mode set.\n"));
-  v_set_mode(TEST_CHAN, test_access, InterruptOnTerminalCount, false);
-
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  mprintf(F(">>> Writing counter of %d\n"), test_counter);
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  mprintf(F(">>> Reading counters. Counters should be 0 after counter set.\n"));
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should be loaded.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should not change (GATE==LOW).\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-
-  mprintf(F(">>> Setting gate high.\n"));
-  v_set_gate(2, true);
-
-  mprintf(F(">>> Ticking once.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter-1)) return false;
-
-  mprintf(F(">>> Ticking 10.\n"));
-  v_ticks(10);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter-11)) return false;
-
-  mprintf(F(">>> Ticking 200.\n"));
-  v_ticks(200);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, (test_counter - 211) & 0xFF)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 1000.\n"));
-  v_ticks(1000);
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F("TEST PASSED!\n"));
-  return true;
+  return run_test_program(tp_mode0, true);
 }
 
 bool test_mode1() {
   mprintf(F("Starting test of mode #1, HardwareRetriggerableOneShot...\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0xFF;
-  pit_access test_access = LSB;
-
-  v_set_mode(TEST_CHAN, test_access, HardwareRetriggerableOneShot, false);
-  
-  emu.channel[TEST_CHAN].printState();
-
-  mprintf(F(">>> Counters should be 0 after mode set.\n"));
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should still be 0 as reload value not set.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  mprintf(F(">>> Ticking 10. Counters should still be 0 as reload value not set.\n"));
-  v_ticks(10);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  mprintf(F(">>> Setting reload value. Counters should still be 0.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-
-  emu.channel[TEST_CHAN].printState();
-
-  mprintf(F(">>> Ticking once. Counter may be a small, undefined value.\n"));
-  v_ticks(1);
-
-  emu.channel[TEST_CHAN].printState();
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-
-  mprintf(F(">>> Ticking once. Counter should decrement from its initial undefined value.\n"));
-  v_ticks(1);
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-
-  mprintf(F(">>> Ticking once. Counter should decrement from its initial undefined value.\n"));
-  v_ticks(1);
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-
-  emu.channel[TEST_CHAN].printState();
-
-  mprintf(F(">>> Ticking 100. Counter should decrement from its initial undefined value.\n"));
-  v_ticks(100);
-
-  emu.channel[TEST_CHAN].printState();
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-
-  mprintf(F(">>> Output should still be high.\n"));
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Setting gate HIGH. Counters should still be undefined as reload cycle has not completed.\n"));
-  v_set_gate(TEST_CHAN, true);
-
-  mprintf(F(">>> Reading counters after gate set...\n"));
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;  
-
-  mprintf(F(">>> Ticking once. Counters should now be loaded. Output should now be low.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  mprintf(F(">>> Ticking 300. One-shot should trigger and output should be HIGH.\n"));
-  v_ticks(300);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    return false;
-  }
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Setting reload value. Counters should be unchanged. Output should remain HIGH.\n"));
-  v_write_counter(TEST_CHAN, test_access, 0x80);  
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    return false;
-  }
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 500. Output should remain HIGH.\n"));
-  v_ticks(500);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    return false;
-  }
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Toggling Gate between clock cycles. Ticking once. Counters should be reloaded. Output should become LOW.\n"));
-  v_set_gate(TEST_CHAN, false);
-  delay(100);
-  v_set_gate(TEST_CHAN, true);
-  v_ticks(1);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    return false;
-  }
-
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  mprintf(F("TEST PASSED!\n"));
-  return true;
+  return run_test_program(tp_mode1, true);
 }
 
 bool test_mode2() {
   mprintf(F("Starting test of mode #2, RateGenerator...\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0xFF;
-  pit_access test_access = LSB;
-
-  v_set_mode(TEST_CHAN, test_access, RateGenerator, false);
-
-  if(!test_output(TEST_CHAN, true)) return false;
-  
-  emu.channel[2].printState();
-
-  mprintf(F(">>> Counters should be 0 after mode set.\n"));
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  mprintf(F(">>> Ticking 10. Counters should still be 0 as reload value not set.\n"));
-  v_ticks(10);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;   
-
-  mprintf(F(">>> Setting reload value. Counters should still be 0.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should be set.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should be unchanged as GATE==LOW.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false; 
-
-  mprintf(F(">>> Setting GATE==HIGH. Ticking 254. Counters should be 2. Output should be high.\n"));
-  v_set_gate(TEST_CHAN, true);
-  v_ticks(254);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 2)) return false;     
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking once. Output should go low.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 1)) return false;        
-
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  mprintf(F(">>> Ticking once. Output should go high.\n"));
-  v_ticks(1);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    return false;
-  }      
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 100. Output should remain high.\n"));
-  v_ticks(100);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 155)) return false;    
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F("TEST PASSED!\n"));
-  return true;
+  return run_test_program(tp_mode2, true);
 }
 
 bool test_mode3() {
-  mprintf(F("Starting test of mode #3, SquareWaveGenerator (even reload value)...\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0x1000;
-  pit_access test_access = LSBMSB;
-
-  v_set_mode(TEST_CHAN, test_access, SquareWaveGenerator, false);
-
-  emu.channel[TEST_CHAN].printState();
-
-  mprintf(F(">>> Counters should be 0 after mode set and output should be HIGH.\n"));
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Setting reload value. Counters should still be 0.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should load.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should be unchanged as GATE==LOW.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;  
-
-  mprintf(F(">>> Setting GATE=HIGH and ticking once. Counter should reload. Output should remain HIGH.\n"));
-  v_set_gate(TEST_CHAN, true);
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking once. Counter should update. Output should remain HIGH.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter - 2)) return false;
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 2046. Counter should update to 2. Output should remain high.\n"));
-  v_ticks(2046);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 2)) return false;
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 1. Output should flip LOW.\n"));
-  v_ticks(1);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    return false;
-  }
-
-  if(!test_output(TEST_CHAN, false)) return false;
-  
-  mprintf(F("Starting test of mode #3, SquareWaveGenerator (odd reload value)\n"));
-
-  mprintf(F(">>> Resetting PIT. Setting gate HIGH.\n"));
-
-  v_set_gate(TEST_CHAN, true);
-  pit_reset();
-
-  test_counter = 0x1001;
-  test_access = LSBMSB;
-
-  v_set_mode(TEST_CHAN, test_access, SquareWaveGenerator, false);
-  delay(100);
-
-  mprintf(F(">>> Setting reload value. Counters should be 0 and output HIGH.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    return false;
-  }
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  emu.channel[TEST_CHAN].printState();
-
-  if(pit_type == kModel8253) {
-    mprintf(F(">>> MODEL 8253: Ticking once. Counters should be loaded to %u and output HIGH.\n"), test_counter);
-    v_ticks(1);
-
-    if(v_compare_counters(TEST_CHAN, test_access)) {
-      mprintf(F(">>> Counters match. %s\n"), PASS);
-    }
-    else {
-      mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-      //return false;
-    }
-    if(!test_output(TEST_CHAN, true)) return false;
-  }
-  
-  emu.channel[TEST_CHAN].printState();
-
-  mprintf(F(">>> Ticking once. Counter be %u and output HIGH.\n"), test_counter - 1);
-  v_ticks(1);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    //return false;
-  }
-
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking once. Counters should decrement by 2 and output HIGH.\n"));
-  v_ticks(1);
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    //return false;
-  }
-
-  if(!test_output(TEST_CHAN, true)) return false;
-  
-  mprintf(F(">>> Ticking 2047. Counters should be reloaded and output LOW.\n"));
-  v_ticks(2047);
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(v_compare_counters(TEST_CHAN, test_access)) {
-    mprintf(F(">>> Counters match. %s\n"), PASS);
-  }
-  else {
-    mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-    //return false;
-  }
-
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  if(pit_type == kModel8253) {
-    mprintf(F(">>> MODEL 8253: Ticking once. Counters should be %u and output LOW.\n"), test_counter - 3);
-    v_ticks(1);
-
-    if(v_compare_counters(TEST_CHAN, test_access)) {
-      mprintf(F(">>> Counters match. %s\n"), PASS);
-    }
-    else {
-      mprintf(F(">>> Counters don't match. %s\n"), FAIL);
-      //return false;
-    }
-
-    if(!test_output(TEST_CHAN, false)) return false;
-  }
-
-  mprintf(F(">>> Ticking 500 and setting new reload value (0x500). Counter should decrement and output LOW.\n"));
-  v_ticks(500);
-  v_write_counter(TEST_CHAN, test_access, 0x500);
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  mprintf(F(">>> Ticking 1547. Counter should reload to new value (0x500) and output HIGH.\n"));
-  v_ticks(1547);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x500)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F("TEST PASSED!\n"));
-  return true;
+  mprintf(F("Starting test of mode #3, SquareWaveGenerator (even, then odd reload value)...\n"));
+  return run_test_program(tp_mode3, true);
 }
 
 bool test_mode4() {
   mprintf(F("Starting test of mode #4, SoftwareTriggeredStrobe\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0xFFFF;
-  pit_access test_access = LSBMSB;
-
-  v_set_mode(TEST_CHAN, test_access, SoftwareTriggeredStrobe, false);
-
-  emu.channel[TEST_CHAN].printState();
-
-  mprintf(F(">>> Counters should be 0 after mode set and output should be HIGH.\n"));
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Setting reload value. Counters should be 0 and output HIGH.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-  
-  mprintf(F(">>> Ticking once. Counter should be loaded and output HIGH.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking once. Counter should be unchanged as GATE==LOW.\n"));
-  v_ticks(1);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-
-  mprintf(F(">>> Setting GATE==HIGH and ticking once. Counter should decrement.\n"));
-  v_set_gate(TEST_CHAN, true);  
-  v_ticks(1);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter-1)) return false;
-
-  mprintf(F(">>> Ticking 65533. Counter should be 1 and output HIGH.\n"));
-  v_ticks(65533);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, 1)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 1. Counter should be 0 and output LOW.\n"));
-  v_ticks(1);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;
-
-  mprintf(F(">>> Ticking 1. Counter should be 65535 and output HIGH.\n"));
-  v_ticks(1);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, 65535)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;  
-
-  mprintf(F(">>> Ticking 100. Counter should be 65435 and output HIGH.\n"));
-  v_ticks(100);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, 65435)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;  
-
-  mprintf(F(">>> Setting new reload value of 1000. Counter should be 65435 and output HIGH.\n"));
-  v_write_counter(TEST_CHAN, test_access, 1000);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, 65435)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;    
-
-  mprintf(F(">>> Ticking once. Counter should be 1000 and output HIGH.\n"));
-  v_ticks(1);
-  
-  if(!test_counters_exact(TEST_CHAN, test_access, 1000)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;    
-
-  mprintf(F("TEST PASSED!\n"));
-  return true;
+  return run_test_program(tp_mode4, true);
 }
 
 bool test_mode5() {
   mprintf(F("Starting test of mode #5, HardwareTriggeredStrobe\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0x8000;
-  pit_access test_access = LSBMSB;
-
-  v_set_mode(TEST_CHAN, test_access, HardwareTriggeredStrobe, false);
-
-  emu.channel[TEST_CHAN].printState();
-
-  mprintf(F(">>> Counters should be 0 after mode set and output should be HIGH.\n"));
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Setting reload value. Counters should be 0 and output HIGH.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-  
-  mprintf(F(">>> Ticking once. Counter is loaded with a small undefined value and output HIGH.\n"));
-  v_ticks(1);
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;  
-
-  mprintf(F(">>> Ticking once. Counter will decrement. Output may go LOW if terminal count reached.\n"));
-  v_ticks(1);
-
-  if(!test_counters(TEST_CHAN, test_access)) return false;
-
-  mprintf(F(">>> Setting GATE=HIGH and ticking once. Counters should load. Output should be HIGH.\n"));
-  v_set_gate(TEST_CHAN, true);
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 7FFF. Counters should be 1. Output should be HIGH.\n"));
-  v_ticks(0x7FFF);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 1)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;
-
-  mprintf(F(">>> Ticking 1. Counters should be 0. Output should be LOW.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;  
-
-  mprintf(F(">>> Ticking 1. Counters should be 65535. Output should be HIGH.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 65535)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;  
-
-  mprintf(F("TEST PASSED!\n"));
-  return true;
+  return run_test_program(tp_mode5, true);
 }
 
 bool test_bcd() {
   mprintf(F("Starting test of BCD support using Mode0: InterruptOnTerminalCount\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0xFFFF;
-  pit_access test_access = LSBMSB;
-
-  mprintf(F("Setting mode. BCD==TRUE. Counters should be 0, output should be LOW.\n"));
-  v_set_mode(TEST_CHAN, test_access, InterruptOnTerminalCount, true);
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;  
-
-  mprintf(F(">>> Setting reload value to invalid BCD value (FFFF). Counters should be 0 and output remains LOW.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;  
-
-  mprintf(F(">>> Ticking once. Counter should be 65535 (0xFFFF).\n"));
-  v_ticks(1);
-  if(!test_counters_exact(TEST_CHAN, test_access, 65535)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-  mprintf(F(">>> Setting GATE=HIGH and ticking once. Counter should be 65534 (0xFFFE).\n"));
-  v_set_gate(TEST_CHAN, true);
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 65534)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-  test_counter = 0x9999;
-  mprintf(F(">>> Setting reload value to a valid BCD value (9999). Counters should be unchanged and output remains LOW.\n"));
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 65534)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;   
-
-  mprintf(F(">>> Ticking once. Since an valid BCD value was provided, the counters should reload.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, test_counter)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-  mprintf(F(">>> Ticking once. The counters should decrement.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x9998)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-
-  mprintf(F(">>> Ticking 10. The counters should decrement.\n"));
-  v_ticks(10);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x9988)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-  mprintf(F(">>> Ticking 9987. The counters should become 1. Output should remain LOW.\n"));
-  v_ticks(9987);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 1)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-  mprintf(F(">>> Ticking 1. The counters should become 0. Output should go HIGH.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;    
-
-  mprintf(F(">>> Ticking 1. The counters should become 0x9999. Output should remain HIGH.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x9999)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;    
-
-  mprintf(F("TEST PASSED!\n"));
-
-  mprintf(F(">>> Ticking 1. Output should remain HIGH.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x9998)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;    
-
-  mprintf(F(">>> Ticking 15000. Output should remain HIGH.\n"));
-  v_ticks(15000);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x4998)) return false;
-  if(!test_output(TEST_CHAN, true)) return false;    
-
-  mprintf(F(">>> Setting reload value to invalid BCD value (0x100F). Counter should be unchanged and Output should go LOW.\n"));
-  v_write_counter(TEST_CHAN, test_access, 0x100F);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x4998)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-  mprintf(F(">>> Ticking once. Counter should be 0x100F and Output should remain LOW.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x100F)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;    
-
-  mprintf(F(">>> Ticking once. Counter should be 0x100E and Output should remain LOW.\n"));
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x100E)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;   
-
-  mprintf(F(">>> Ticking 0x0F. Counter should be 0x0999 and Output should remain LOW.\n"));
-  v_ticks(0x0F);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0x0999)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;   
-
-  mprintf(F(">>> Setting reload value to invalid BCD value (FFFF) and ticking once. Output should remain LOW.\n"));
-  v_write_counter(TEST_CHAN, test_access, 0xFFFF);
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 65535)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;  
-
-  mprintf(F(">>> Ticking 10. Output should remain LOW.\n"));
-  v_write_counter(TEST_CHAN, test_access, 0xFFFF);
-  v_ticks(10);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 65526)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;  
-
-  mprintf(F("TEST PASSED!\n"));
-  return true;
+  return run_test_program(tp_bcd, true);
 }
 
 bool test_rw() {
   mprintf(F("Starting test of interleaved RW using Mode0: InterruptOnTerminalCount\n"));
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate LOW\n"));
-  v_set_gate(TEST_CHAN, false);
-  pit_reset();
-
-  u16 test_counter = 0xBEEF;
-  pit_access test_access = LSBMSB;
-  u8 emu_lsb_byte = 0;
-  u8 pit_lsb_byte = 0;
-  u8 msb_byte = 0;
-
-  mprintf(F("Setting mode 0, LSBMSB. Setting counter to 0xBEEF, ticking once to set. Output should be LOW.\n"));
-  v_set_mode(TEST_CHAN, test_access, InterruptOnTerminalCount, false);
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-  v_ticks(1);
-
-  if(!test_counters_exact(TEST_CHAN, test_access, 0xBEEF)) return false;
-  if(!test_output(TEST_CHAN, false)) return false;  
-
-  mprintf(F("Latching count...\n"));
-  v_latch(TEST_CHAN);
-
-  mprintf(F("Reading LSB in LSBMSB mode.\n"));
-
-  pit_lsb_byte = pit_read_counter(TEST_CHAN, LSB);
-  emu_lsb_byte = emu.channel[TEST_CHAN].readByte();
-
-  mprintf(F("Read emu byte: %X, pit byte: %X\n"), emu_lsb_byte, pit_lsb_byte);
-  if (emu_lsb_byte != pit_lsb_byte) {
-    mprintf(F("Bytes don't match! %s"), FAIL);
-    return false;
-  }
-
-  mprintf(F("Writing a byte in the middle of LSBMSB read.\n"));
-  v_write_counter(TEST_CHAN, LSB, 0xAA);
-
-  // On the 8253, writing a byte to a channel's count register seems to reset the 
-  // read state back to LSB.
-  mprintf(F("Reading another byte to see what we get.\n"));
-  pit_lsb_byte = pit_read_counter(TEST_CHAN, LSB);
-  emu_lsb_byte = emu.channel[TEST_CHAN].readByte();
-
-  mprintf(F("Read emu byte: %X, pit byte: %X\n"), emu_lsb_byte, pit_lsb_byte);
-  if (emu_lsb_byte != pit_lsb_byte) {
-    mprintf(F("Bytes don't match! %s\n"), FAIL);
-    //return false;
-  }  
-
-  mprintf(F("Reading another byte to see what we get.\n"));
-  pit_lsb_byte = pit_read_counter(TEST_CHAN, LSB);
-  emu_lsb_byte = emu.channel[TEST_CHAN].readByte();
-
-  mprintf(F("Read emu byte: %X, pit byte: %X\n"), emu_lsb_byte, pit_lsb_byte);
-  if (emu_lsb_byte != pit_lsb_byte) {
-    mprintf(F("Bytes don't match! %s\n"), FAIL);
-    //return false;
-  }
-
-  mprintf(F("Writing a byte of count register in LSBMSB mode (0xAA).\n"));
-  v_write_counter(TEST_CHAN, LSB, 0xAA);
-
-  mprintf(F("Reading a byte to see what we get.\n"));
-  pit_lsb_byte = pit_read_counter(TEST_CHAN, LSB);
-  emu_lsb_byte = emu.channel[TEST_CHAN].readByte();
-
-  mprintf(F("Read emu byte: %X, pit byte: %X\n"), emu_lsb_byte, pit_lsb_byte);
-  if (emu_lsb_byte != pit_lsb_byte) {
-    mprintf(F("Bytes don't match! %s\n"), FAIL);
-    //return false;
-  }
-
-  mprintf(F("Reading another byte to see what we get.\n"));
-  pit_lsb_byte = pit_read_counter(TEST_CHAN, LSB);
-  emu_lsb_byte = emu.channel[TEST_CHAN].readByte();
-
-  mprintf(F("Read emu byte: %X, pit byte: %X\n"), emu_lsb_byte, pit_lsb_byte);
-  if (emu_lsb_byte != pit_lsb_byte) {
-    mprintf(F("Bytes don't match! %s\n"), FAIL);
-    //return false;
-  }
+  return run_test_program(tp_rw, true);
 }
 
 bool test_reload_lsb() {
+  mprintf(F("Starting test of single byte reloads using Mode2: RateGenerator\n"));
+  return run_test_program(tp_reload_lsb, true);
+}
 
-  u16 test_counter = 0x0002;
-  u16 cur_counter = 0;
-  pit_access test_access = LSBMSB;
-
-  mprintf(F(">>> Resetting PIT\n"));
-  mprintf(F(">>> Gate HIGH\n"));
-  v_set_gate(TEST_CHAN, true);
-  pit_reset();
-
-  mprintf(F("Setting mode 2, LSBMSB. Setting counter to 0x0002, ticking once to set. Output should be HIGH.\n"));
-  v_set_mode(TEST_CHAN, test_access, RateGenerator, false);
-  v_write_counter(TEST_CHAN, test_access, test_counter);
-  v_ticks(2);
-
-  mprintf(F("Reading timer value in LSBMSB mode.\n"));
-  cur_counter  = pit_read_counter(TEST_CHAN, LSBMSB);
-  mprintf(F("New timer value is: %X\n"), cur_counter);
-
-  mprintf(F("Writing one byte 0xFF in LSBMSB mode.\n"));
-  v_write_counter(TEST_CHAN, LSB, 0xFF);
-
-  mprintf(F("Ticking twice to roll over counter.\n"));
-  v_ticks(2);
-
-  mprintf(F("Reading timer value in LSBMSB mode.\n"));
-  cur_counter = pit_read_counter(TEST_CHAN, LSBMSB);
-
-  mprintf(F("New timer value is: %X\n"), cur_counter);
-
-  mprintf(F("Writing one byte 0xFF in LSBMSB mode.\n"));
-  v_write_counter(TEST_CHAN, LSB, 0xFF);
 
-  mprintf(F("Ticking twice...\n"));
-  v_ticks(2);   
+// Pick a tick count one before, on, or one after the next event, given the distance
+// reported by the emulator. An occasional uniformly random count keeps the fuzzer from
+// only ever visiting states reachable through event boundaries.
+u16 fuzz_event_ticks(unsigned long ticks_to_event) {
 
-  mprintf(F("Reading timer value in LSBMSB mode.\n"));
-  cur_counter = pit_read_counter(TEST_CHAN, LSBMSB);
+  if (ticks_to_event == 0 || random(4) == 0) {
+    return random(0xFFFF);
+  }
 
-  mprintf(F("New timer value is: %X\n"), cur_counter);  
+  unsigned long ticks = ticks_to_event + random(3) - 1;
+  if (ticks == 0) {
+    ticks = 1;
+  }
+  return (ticks > 0xFFFF) ? 0xFFFF : (u16)ticks;
 }
 
-
 bool test_fuzzer() {
 
   unsigned long fuzz_ct = 0;
@@ -1018,14 +197,14 @@ bool test_fuzzer() {
 
         mprintf(F("FUZZER: Writing %X to command port...\n"), fuzz_byte);
         pit_write_port(COMMAND, fuzz_byte);
-        emu.setModeByte(fuzz_byte);
+        emu.ioWrite(COMMAND, fuzz_byte);
         break;
 
       case ReadChannel:
         // Read a byte from the FUZZ_CHAN and compare.
         mprintf(F("FUZZER: Reading from data channel...\n"));
 
-        emu_byte = emu.channel[FUZZ_CHAN].readByte();
+        emu_byte = emu.ioRead(FUZZ_CHAN);
         pit_byte = pit_read_port(FUZZ_CHAN);
         
         if(emu_byte != pit_byte) {
@@ -1045,25 +224,31 @@ bool test_fuzzer() {
         // Generate a random data byte
         fuzz_byte = random(256);
         mprintf(F("FUZZER: Writing %X to data channel...\n"), fuzz_byte);
-        emu.channel[FUZZ_CHAN].sendReloadByte(fuzz_byte);
+        emu.ioWrite(FUZZ_CHAN, fuzz_byte);
         pit_write_port(FUZZ_CHAN, fuzz_byte);
         break;
       
       case Tick:
-        // Generate a random number of ticks.
-        
-        fuzz_ticks = random(0xFFFF);
-        mprintf(F("FUZZER: Ticking %X...\n"), fuzz_ticks);
-        v_ticks(fuzz_ticks);
-        mprintf(F("FUZZER: Ticking %X...\n"), fuzz_ticks);
-        v_ticks(fuzz_ticks); // Do it twice, to make wrapping counter more likely.
-
+        #if FUZZ_EVENT_TICKS
+          fuzz_ticks = fuzz_event_ticks(emu.channel[FUZZ_CHAN].ticksUntilEvent());
+          mprintf(F("FUZZER: Ticking %X...\n"), fuzz_ticks);
+          v_ticks(fuzz_ticks);
+        #else
+          // Generate a random number of ticks.
+          
+          fuzz_ticks = random(0xFFFF);
+          mprintf(F("FUZZER: Ticking %X...\n"), fuzz_ticks);
+          v_ticks(fuzz_ticks);
+          mprintf(F("FUZZER: Ticking %X...\n"), fuzz_ticks);
+          v_ticks(fuzz_ticks); // Do it twice, to make wrapping counter more likely.
+        #endif
         break;
 
       case FlipGate:
         
         // Change the gate status
         gate_status = !gate_status;
+        mprintf(F("FUZZER: Setting gate %d...\n"), gate_status);
         v_set_gate(FUZZ_CHAN, gate_status);
         break;
 
@@ -1086,3 +271,149 @@ bool test_fuzzer() {
   }
   
 }
+
+// Fuzz all three channels at once. Each op targets a randomly chosen channel, so every
+// channel sees its own independent stream of commands, reads, writes and gate changes
+// while all three share the clock. Outputs are compared as a 3-bit mask after every clock,
+// so each hardware tick validates all three channels.
+bool test_fuzzer_lockstep() {
+
+  unsigned long fuzz_ct = 0;
+
+  u8 fuzz_chan = 0;
+  bool gate_status = false;
+  u8 fuzz_byte = 0;
+  u8 emu_byte = 0;
+  u8 pit_byte = 0;
+  u16 fuzz_ticks = 0;
+  bool fuzz_error = false;
+
+  // Set initial gate state. Only gate #2 is driven; gates 0 and 1 are strapped.
+  v_set_gate(2, gate_status);
+  emu.channel[0].setGate(GATE01_STRAP);
+  emu.channel[1].setGate(GATE01_STRAP);
+  pit_reset();
+
+  // Set initial mode and counter for all channels.
+  for(u8 c = 0; c < 3; c++) {
+    v_set_mode(c, LSBMSB, InterruptOnTerminalCount, false);
+    v_write_counter(c, LSBMSB, 0xFFFF);
+  }
+
+  delay(1000);
+
+  mprintf(F("FUZZER: Beginning lockstep fuzzer!\n"));
+  while (fuzz_ct < 10000 && !fuzz_error) {
+
+    fuzz_chan = random(3);
+
+    switch ((FuzzerOp)random(NUM_FUZZER_OPS)) {
+
+      case WriteCommand:
+        // Generate a random command byte for the selected channel
+        fuzz_byte = random(256);
+        fuzz_byte &= 0x3F;
+        fuzz_byte |= (fuzz_chan << 6);
+
+        mprintf(F("FUZZER: Writing %X to command port...\n"), fuzz_byte);
+        pit_write_port(COMMAND, fuzz_byte);
+        emu.ioWrite(COMMAND, fuzz_byte);
+        break;
+
+      case ReadChannel:
+        mprintf(F("FUZZER: Reading from data channel %d...\n"), fuzz_chan);
+
+        emu_byte = emu.ioRead(fuzz_chan);
+        pit_byte = pit_read_port(fuzz_chan);
+        
+        if(emu_byte != pit_byte) {
+          // Allow a difference if the emulator says we are in undefined mode.
+          if (emu.channel[fuzz_chan].is_ce_undefined()) {
+            mprintf(F("Bytes read from data channel differ, but emulator reports undefined status. Continuing.\n"));
+          }
+          else {
+            mprintf(F("Bytes read from data channel differ! emu: %X pit: %X\n"), emu_byte, pit_byte);
+            emu.channel[fuzz_chan].printState();
+            fuzz_error = true;
+          }
+        }
+        break;
+
+      case WriteChannel:
+        fuzz_byte = random(256);
+        mprintf(F("FUZZER: Writing %X to data channel %d...\n"), fuzz_byte, fuzz_chan);
+        emu.ioWrite(fuzz_chan, fuzz_byte);
+        pit_write_port(fuzz_chan, fuzz_byte);
+        break;
+      
+      case Tick:
+        // The clock is shared, so ticks are not specific to the selected channel.
+        #if FUZZ_EVENT_TICKS
+        {
+          unsigned long next_event = 0;
+          for(u8 c = 0; c < 3; c++) {
+            unsigned long ticks = emu.channel[c].ticksUntilEvent();
+            if(ticks && (!next_event || ticks < next_event)) {
+              next_event = ticks;
+            }
+          }
+          fuzz_ticks = fuzz_event_ticks(next_event);
+        }
+        #else
+          fuzz_ticks = random(0xFFFF);
+        #endif
+        mprintf(F("FUZZER: Ticking %X...\n"), fuzz_ticks);
+        if(!v_ticks_lockstep(fuzz_ticks)) {
+          fuzz_error = true;
+        }
+        break;
+
+      case FlipGate:
+        // Only gate #2 is connected, so the other channels' streams have no gate changes.
+        if(fuzz_chan == 2) {
+          gate_status = !gate_status;
+          mprintf(F("FUZZER: Setting gate %d...\n"), gate_status);
+          v_set_gate(2, gate_status);
+        }
+        break;
+
+      default:
+        mprintf(F("Invalid fuzzer op!\n"));
+        break;
+    }
+
+    if(!fuzz_error && !v_compare_outputs()) {
+      mprintf(F("Output states differ!\n"));
+      fuzz_error = true;
+    }
+
+    fuzz_ct++;
+  }
+
+  mprintf(F("FUZZER: %lu ops. %s\n"), fuzz_ct, fuzz_error ? FAIL : PASS);
+  return !fuzz_error;
+}
+
+// Capture the outputs of all three channels over a long run and send the waveform to the
+// host. The host repeats this setup (host/capture_test.ops) on the emulator and compares 
+// the whole waveform with capture_check.
+bool test_capture() {
+  mprintf(F("Starting output capture...\n"));
+
+  v_set_gate(2, true);
+  emu.channel[0].setGate(GATE01_STRAP);
+  emu.channel[1].setGate(GATE01_STRAP);
+  pit_reset();
+
+  v_set_mode(0, LSBMSB, RateGenerator, false);
+  v_write_counter(0, LSBMSB, 1000);
+  v_set_mode(1, LSBMSB, SquareWaveGenerator, false);
+  v_write_counter(1, LSBMSB, 301);
+  v_set_mode(2, LSBMSB, SquareWaveGenerator, false);
+  v_write_counter(2, LSBMSB, 0x200);
+
+  unsigned long captured = v_capture(100000);
+
+  mprintf(F("\nCaptured %lu cycles in %u runs.\n"), captured, capture_get_run_count());
+  return true;
+}
@@ -37,6 +37,11 @@ enum FuzzerOp {
 #define TEST_CHAN 2
 #define FUZZ_CHAN 2
 
+// When set, the fuzzer's Tick op asks the emulator how far away the next event is
+// (terminal count, reload, output edge or undefined load) and lands just before, on
+// or after it, instead of ticking a uniformly random count.
+#define FUZZ_EVENT_TICKS 0
+
 #define PASS " ~~~ PASS ~~~ "
 #define FAIL " *** FAIL *** "
 
@@ -51,12 +56,15 @@ bool test_mode5();
 bool test_bcd();
 bool test_rw();
 bool test_fuzzer();
+bool test_fuzzer_lockstep();
+bool test_capture();
 bool test_reload_lsb();
 
 
 bool test_output(int c, bool state);
 bool test_counters(int c, pit_access access);
 bool test_counters_exact(int c, pit_access access, u16 value);
+u16 fuzz_event_ticks(unsigned long ticks_to_event);
 
 // Validator declarations
 void v_set_mode(u8 c, pit_access access, pit_mode mode, bool bcd );
@@ -67,6 +75,9 @@ void v_ticks(unsigned long ticks);
 void v_tick();
 bool v_validate_output(u8 c, bool output_state);
 bool v_compare_output(u8 c);
+bool v_compare_outputs();
+bool v_ticks_lockstep(unsigned long ticks);
+unsigned long v_capture(unsigned long ticks);
 bool v_compare_counters(u8 c, pit_access access);
 
 
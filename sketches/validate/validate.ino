@@ -23,6 +23,10 @@
 #include "arduino_8253.h"
 #include "lib.h"
 #include "pit_emulator.h"
+#include "capture.h"
+#include "calibrate.h"
+#include "serial_server.h"
+#include "test_program.h"
 
 #define TEST_AMODE LSB
 #define TIMER_SECOND 1
@@ -75,6 +79,9 @@ void setup() {
 
   randomSeed(SEED);
 
+  // Use this board's calibrated bus delays, if calibrate_bus_timing() has stored any.
+  bus_timing_load();
+
   //pit_init();
   Serial.println("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
 }
@@ -99,6 +106,11 @@ void loop() {
     //test_bcd();
     //test_rw();
     //test_fuzzer();
+    //test_fuzzer_lockstep();
+    //test_capture();
+    //test_program_serial();
+    //calibrate_bus_timing(CALIBRATE_MARGIN);
+    //serial_server();
 
     if(!started_test) {
       Serial.println("********** BAD STATE ***********");
@@ -223,131 +235,3 @@ void clock_tick() {
   pit_clock_tick();
   pit_cps += 1;
 }
-
-// Simultaneously set the real PIT and emulated PIT mode.
-void v_set_mode(u8 c, pit_access access, pit_mode mode, bool bcd ) {
-  
-  pit_set_mode(c, access, mode, bcd);
-
-  u8 byte = build_command_byte(c, access, mode, bcd);
-
-  emu.setModeByte(byte);
-  //emu.channel[c].setMode((AccessMode)access, (TimerMode)mode, bcd);
-}
-
-void v_send_command_byte(u8 byte) {
-
-
-  emu.setModeByte(byte);
-}
-
-// Simultaneously set the real PIT and emulated PIT gate.
-void v_set_gate(u8 c, bool gate_state ) {
-  // We only support gate #2
-  if(c==2) {
-    pit_set_gate(c, gate_state);
-    emu.channel[c].setGate(gate_state);
-  }
-}
-
-// Simultaneously send the latch command to the real PIT and emulated PIT.
-void v_latch(u8 c) {
-  pit_set_latch(c);
-  emu.channel[c].latch();
-}
-
-// Simultaneously load a reload byte into the real PIT and emulated PIT.
-void v_write_counter(u8 c, pit_access access, u16 value) {
-
-  pit_write_counter(c, access, value);
-
-  switch(access) {
-    case MSB:
-      emu.channel[c].sendReloadByte(value >> 8);
-      break;
-    case LSB:
-      emu.channel[c].sendReloadByte(value & 0xFF);
-      break;
-    case LSBMSB:
-      emu.channel[c].sendReloadByte(value & 0xFF);
-      emu.channel[c].sendReloadByte(value >> 8);
-      break;
-  };
-}
-
-// Execute 'ticks' number of ticks.
-void v_ticks(unsigned long ticks) {
-  for(unsigned long i = 0; i < ticks; i++ ) {
-    v_tick();
-  }
-}
-
-// Simultaneously tick the real PIT and emulated PIT.
-void v_tick() {
-  
-  pit_clock_tick();
-  emu.tick();
-  pit_cps += 1;
-}
-
-bool v_validate_output(u8 c, bool output_state) {
-
-  bool pit_output_correct = false;
-  bool pit_output = pit_get_output(c);
-
-  if(pit_output != output_state) {
-    mprintf("v_validate_output(): PIT state did not validate. State: %d Expected %d\n", pit_output, output_state);
-    return false;
-  }
-
-  if(v_compare_output(c)) {
-    //mprintf("v_validate_output(): Emulated output matches PIT output.\n");
-    return true;
-  }
-  else {
-    mprintf("v_validate_output(): Emulated output does not match PIT output.\n");
-    return false;
-  }
-
-}
-
-// Check the output of the real PIT vs emulated PIT. Return false if they do not match.
-bool v_compare_output(u8 c) {
-  
-  bool emu_output = emu.channel[c].getOutput();
-
-  bool pit_output = false;
-  switch(c) {
-    case 0:
-      pit_output = READ_OUT0;
-      break;
-
-    case 1:
-      pit_output = READ_OUT1;
-      break;
-
-    case 2:
-      pit_output = READ_OUT2;
-      break;
-
-    default:
-      mprintf(F("Bad counter #\n"));
-      return false;
-      break;
-  };
-
-  mprintf(F("v_compare_output(): emu output: %d pit output: %d\n"), emu_output, pit_output);
-
-  return emu_output == pit_output;
-}
-
-bool v_compare_counters(u8 c, pit_access access) {
-
-  u16 emu_counter = emu.channel[c].readCount();
-  u16 pit_counter = pit_read_counter(c, access);
-
-  mprintf(F("v_compare_counters(): emu: %u (%X) pit: %u (%X)\n"), emu_counter, emu_counter, pit_counter, pit_counter);
-
-  return emu_counter == pit_counter;
-}
-
@@ -0,0 +1,188 @@
+/*
+    (C)2023 Daniel Balsom
+    https://github.com/dbalsom/arduino_8253
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+
+// Validator primitives: each applies the same operation to the real PIT and the
+// emulated one, or compares the two. Kept out of the sketch file so host builds
+// can run the tests against a mock chip.
+
+#include <Arduino.h>
+#include "validate.h"
+#include "arduino_8253.h"
+#include "pit_emulator.h"
+#include "capture.h"
+#include "lib.h"
+
+extern Pit emu;
+extern unsigned long pit_cps;
+
+// Simultaneously set the real PIT and emulated PIT mode.
+void v_set_mode(u8 c, pit_access access, pit_mode mode, bool bcd ) {
+  
+  pit_set_mode(c, access, mode, bcd);
+
+  u8 byte = build_command_byte(c, access, mode, bcd);
+
+  emu.setModeByte(byte);
+  //emu.channel[c].setMode((AccessMode)access, (TimerMode)mode, bcd);
+}
+
+void v_send_command_byte(u8 byte) {
+
+
+  emu.setModeByte(byte);
+}
+
+// Simultaneously set the real PIT and emulated PIT gate.
+void v_set_gate(u8 c, bool gate_state ) {
+  // We only support gate #2
+  if(c==2) {
+    pit_set_gate(c, gate_state);
+    emu.setGate(c, gate_state);
+  }
+}
+
+// Simultaneously send the latch command to the real PIT and emulated PIT.
+void v_latch(u8 c) {
+  pit_set_latch(c);
+  emu.channel[c].latch();
+}
+
+// Simultaneously load a reload byte into the real PIT and emulated PIT.
+void v_write_counter(u8 c, pit_access access, u16 value) {
+
+  pit_write_counter(c, access, value);
+
+  switch(access) {
+    case MSB:
+      emu.ioWrite(c, value >> 8);
+      break;
+    case LSB:
+      emu.ioWrite(c, value & 0xFF);
+      break;
+    case LSBMSB: {
+      u8 bytes[2] = { (u8)(value & 0xFF), (u8)(value >> 8) };
+      emu.ioWriteBurst(c, bytes, 2);
+      break;
+    }
+  };
+}
+
+// Execute 'ticks' number of ticks.
+void v_ticks(unsigned long ticks) {
+  for(unsigned long i = 0; i < ticks; i++ ) {
+    v_tick();
+  }
+}
+
+// Simultaneously tick the real PIT and emulated PIT.
+void v_tick() {
+  
+  pit_clock_tick();
+  emu.tick();
+  pit_cps += 1;
+}
+
+// Capture the real PIT's outputs for 'ticks' cycles and send the capture to the host for
+// comparison. The emulated PIT is then ticked the same number of cycles to stay in step.
+unsigned long v_capture(unsigned long ticks) {
+
+  unsigned long captured = capture_outputs(ticks);
+  capture_send();
+
+  emu.run(captured);
+  pit_cps += captured;
+  return captured;
+}
+
+bool v_validate_output(u8 c, bool output_state) {
+
+  bool pit_output_correct = false;
+  bool pit_output = pit_get_output(c);
+
+  if(pit_output != output_state) {
+    mprintf("v_validate_output(): PIT state did not validate. State: %d Expected %d\n", pit_output, output_state);
+    return false;
+  }
+
+  if(v_compare_output(c)) {
+    //mprintf("v_validate_output(): Emulated output matches PIT output.\n");
+    return true;
+  }
+  else {
+    mprintf("v_validate_output(): Emulated output does not match PIT output.\n");
+    return false;
+  }
+
+}
+
+// Check the output of the real PIT vs emulated PIT. Return false if they do not match.
+bool v_compare_output(u8 c) {
+  
+  if(c > 2) {
+    mprintf(F("Bad counter #\n"));
+    return false;
+  }
+
+  bool emu_output = emu.channel[c].getOutput();
+  bool pit_output = (READ_OUTPUTS >> c) & 1;
+
+  mprintf(F("v_compare_output(): emu output: %d pit output: %d\n"), emu_output, pit_output);
+
+  return emu_output == pit_output;
+}
+
+// Check all three outputs of the real PIT vs emulated PIT with a single port read.
+// Channels the emulator reports as undefined are ignored. Return false if they do not match.
+bool v_compare_outputs() {
+
+  u8 pit_outputs = READ_OUTPUTS;
+  u8 emu_outputs = emu.getOutputs();
+  u8 mismatch = (pit_outputs ^ emu_outputs) & ~emu.getUndefinedMask() & 0x07;
+
+  if(mismatch) {
+    mprintf(F("v_compare_outputs(): emu outputs: %X pit outputs: %X\n"), emu_outputs, pit_outputs);
+    return false;
+  }
+  return true;
+}
+
+// Simultaneously tick the real PIT and emulated PIT, comparing all three outputs after every
+// clock. Stops and returns false on the first mismatch.
+bool v_ticks_lockstep(unsigned long ticks) {
+  for(unsigned long i = 0; i < ticks; i++ ) {
+    v_tick();
+    if(!v_compare_outputs()) {
+      mprintf(F("v_ticks_lockstep(): outputs differ after tick %lu of %lu\n"), i + 1, ticks);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool v_compare_counters(u8 c, pit_access access) {
+
+  u16 emu_counter = emu.channel[c].readCount();
+  u16 pit_counter = pit_read_counter(c, access);
+
+  mprintf(F("v_compare_counters(): emu: %u (%X) pit: %u (%X)\n"), emu_counter, emu_counter, pit_counter, pit_counter);
+
+  return emu_counter == pit_counter;
+}
+